@@ -0,0 +1,187 @@
+#include <cstring>
+#include "ot_capability.h"
+
+OT_Access	ot_access(uint8_t id)
+{
+	switch(id)
+	{
+		//Команды и уставки ведущего
+		case 1:		//Tset
+		case 2:		//Master configuration
+		case 4:		//Remote request
+		case 7:		//Cooling control
+		case 8:		//TsetCH2
+		case 14:	//Max rel. modulation
+		case 16:	//TrSet
+		case 23:	//TrSetCH2
+		case 24:	//Tr
+		case 124:	//OpenTherm version master
+		case 126:	//Master product version
+			return OT_Access::write;
+
+		//Параметры, которые ведущий и читает, и записывает
+		case 11:	//TSP entry
+		case 20:	//Day of week & time
+		case 21:	//Date
+		case 22:	//Year
+		case 56:	//TdhwSet
+		case 57:	//MaxTSet
+		case 58:	//Hcratio
+		case 116: case 117: case 118: case 119:		//Счётчики пусков
+		case 120: case 121: case 122: case 123:		//Счётчики наработки
+			return OT_Access::read_write;
+
+		//Все остальные, включая неописанные и OEM, опрашиваются чтением
+		default:
+			return OT_Access::read;
+	}
+}
+
+OT_Support	OT_Capabilities::get(uint8_t id) const
+{
+	uint8_t	byte	= map[id/2];
+	return static_cast<OT_Support>((id & 1) ? (byte >> 4) : (byte & 0x0f));
+}
+
+void	OT_Capabilities::set(uint8_t id, OT_Support support)
+{
+	uint8_t&	byte	= map[id/2];
+	if(id & 1)	byte	= (byte & 0x0f) | (static_cast<uint8_t>(support) << 4);
+	else		byte	= (byte & 0xf0) | static_cast<uint8_t>(support);
+}
+
+bool	OT_Capabilities::is_unsupported(uint8_t id) const
+{
+	//DATA_INVALID не исключает ID: значение может появиться (датчик подключат или он восстановится).
+	//Нет ответа - тоже: при обходе котёл мог быть выключен или без связи
+	return get(id) == OT_Support::unknown;
+}
+
+void	OT_Capabilities::start()
+{
+	//Статус (ID 0) обязателен, а его запрос несёт флаги ведущего: чтение с нулём выключило бы отопление
+	memset(map, 0, sizeof(map));
+	set(0, OT_Support::read_only);
+	cursor		= 1;
+	attempts	= 0;
+	running		= true;
+	retry		= false;
+	complete	= false;
+}
+
+bool	OT_Capabilities::reprobe()
+{
+	if(running || !count(OT_Support::no_response))
+		return false;
+
+	cursor		= 1;
+	attempts	= 0;
+	recovered	= 0;
+	running		= true;
+	retry		= true;
+	return true;
+}
+
+int	OT_Capabilities::next_probe()
+{
+	//ID только для записи не опрашиваются: чтение для них не определено, а запись изменила бы режим котла
+	if(!running)
+		return -1;
+
+	while(cursor < id_count && (ot_access(uint8_t(cursor)) == OT_Access::write || (retry && get(uint8_t(cursor)) != OT_Support::no_response)))
+		cursor++;
+
+	if(cursor >= id_count)
+	{
+		running		= false;
+		retry		= false;
+		complete	= true;
+		return -1;
+	}
+
+	return cursor;
+}
+
+void	OT_Capabilities::probe_result(uint8_t id, OT_Status status)
+{
+	if(!running || id != cursor)
+		return;
+
+	OT_Support	support	= classify(id, status);
+	if(support == OT_Support::untested)
+	{
+		//Ошибка обмена: тот же ID ещё раз, после max_attempts - нет ответа
+		if(++attempts < max_attempts)
+			return;
+		support	= OT_Support::no_response;
+	}
+	else if(retry)
+		recovered++;
+
+	set(id, support);
+	attempts	= 0;
+	cursor++;
+}
+
+OT_Support	OT_Capabilities::classify(uint8_t id, OT_Status status)
+{
+	switch(status)
+	{
+		case OT_Status::sucsess:		return ot_access(id) == OT_Access::read ? OT_Support::read_only : OT_Support::supported;
+		case OT_Status::unknownID:		return OT_Support::unknown;
+		case OT_Status::dataInvalid:	return OT_Support::data_invalid;
+		default:						return OT_Support::untested;
+	}
+}
+
+size_t	OT_Capabilities::count(OT_Support support) const
+{
+	size_t	num	= 0;
+	for(size_t id = 0; id < id_count; id++)
+		if(get(uint8_t(id)) == support)	num++;
+
+	return num;
+}
+
+size_t	OT_Capabilities::serialize(uint8_t* out, size_t size) const
+{
+	if(size < blob_size)
+		return 0;
+
+	out[0]	= version;
+	out[1]	= complete ? 1 : 0;
+	memcpy(out + 2, map, sizeof(map));
+	return blob_size;
+}
+
+bool	OT_Capabilities::parse(const uint8_t* data, size_t size)
+{
+	if(size != blob_size || data[0] != version)
+		return false;
+
+	for(size_t i = 0; i < sizeof(map); i++)
+		if((data[2 + i] & 0x0f) > static_cast<uint8_t>(OT_Support::no_response) || (data[2 + i] >> 4) > static_cast<uint8_t>(OT_Support::no_response))
+			return false;
+
+	memcpy(map, data + 2, sizeof(map));
+	complete	= data[1] != 0;
+	cursor		= complete ? id_count : 0;
+	attempts	= 0;
+	running		= false;
+	retry		= false;
+	return true;
+}
+
+const char*	OT_Capabilities::to_string(OT_Support support)
+{
+	switch(support)
+	{
+		case OT_Support::untested:		return "untested";
+		case OT_Support::supported:		return "supported";
+		case OT_Support::read_only:		return "read_only";
+		case OT_Support::unknown:		return "unknown";
+		case OT_Support::data_invalid:	return "data_invalid";
+		case OT_Support::no_response:	return "no_response";
+		default:						return "wrong_support";
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef OT_CAPABILITY_H
+#define OT_CAPABILITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include "ot_exchange.h"
+
+//Направление обмена по спецификации OpenTherm 2.2 (со стороны ведущего)
+enum class OT_Access: uint8_t{read, write, read_write};
+OT_Access	ot_access(uint8_t id);
+
+//Поддержка Data-ID ведомым по итогам обхода
+enum class OT_Support: uint8_t{
+	untested,		//Не опрашивался (или только для записи: пробная запись изменила бы режим котла)
+	supported,		//Отвечает на чтение, по спецификации доступен и для записи
+	read_only,		//Отвечает на чтение, по спецификации только для чтения
+	unknown,		//UNKNOWN_DATAID
+	data_invalid,	//DATA_INVALID: ID известен, но значения нет (например, датчик не подключён)
+	no_response		//Ошибки обмена на всех попытках: не окончательно, котёл мог быть выключен
+};
+
+//Карта поддержки Data-ID 0..255 (включая OEM-диапазон 128..255).
+//Заполняется однократным обходом: по одному чтению в свободное окно шины, ошибки обмена повторяются.
+//Хранится в NVS одним блоком, чтобы обход не повторялся после перезагрузки.
+//ID без ответа не исключаются из опроса и проверяются повторно (reprobe) после перезагрузки и восстановления связи
+class OT_Capabilities
+{
+public:
+	static constexpr size_t		id_count		= 256;
+	static constexpr uint8_t	version			= 1;
+	static constexpr size_t		blob_size		= 2 + id_count/2;	//Версия, признак завершения, по 4 бита на ID
+	static constexpr uint8_t	max_attempts	= 3;				//Попыток на ID при ошибках обмена
+
+private:
+	uint8_t		map[id_count/2]	= {};
+	uint16_t	cursor		= 0;		//Следующий ID обхода
+	uint8_t		attempts	= 0;
+	bool		running		= false;
+	bool		retry		= false;	//Повторная проверка только ID без ответа
+	uint16_t	recovered	= 0;		//Ответили при повторной проверке
+	bool		complete	= false;	//Обход завершён (или карта загружена из NVS)
+
+public:
+	OT_Support	get(uint8_t id) const;
+	void		set(uint8_t id, OT_Support support);
+
+	//Ведомый заведомо не ответит (UNKNOWN_DATAID): опрос такого ID только тратит время шины
+	bool		is_unsupported(uint8_t id) const;
+
+	//Обход: start, затем next_probe и probe_result по одному ID, пока next_probe не вернёт -1
+	void		start();
+	//Повторная проверка ID без ответа тем же next_probe/probe_result, остальная карта не меняется. false - таких ID нет
+	bool		reprobe();
+	bool		sweeping() const	{return running;}
+	bool		reprobing() const	{return running && retry;}
+	uint16_t	reprobe_recovered() const	{return recovered;}
+	bool		is_complete() const	{return complete;}
+	uint16_t	progress() const	{return cursor;}
+	int			next_probe();
+	void		probe_result(uint8_t id, OT_Status status);
+
+	static OT_Support	classify(uint8_t id, OT_Status status);	//untested - результат не окончательный, повторить
+
+	size_t	count(OT_Support support) const;
+
+	size_t	serialize(uint8_t* out, size_t size) const;
+	bool	parse(const uint8_t* data, size_t size);
+
+	static const char*	to_string(OT_Support support);
+};
+
+#endif	//OT_CAPABILITY_H
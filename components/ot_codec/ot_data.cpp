@@ -0,0 +1,140 @@
+#include <cstdio>
+#include "ot_data.h"
+
+static const OT_DataIdDesc	data_ids[]	= {
+	{0,		OT_DataType::flag8_flag8,	"Status"},
+	{1,		OT_DataType::f8_8,			"TSet"},
+	{2,		OT_DataType::flag8_u8,		"MConfigMMemberIDcode"},
+	{3,		OT_DataType::flag8_u8,		"SConfigSMemberIDcode"},
+	{4,		OT_DataType::u8_u8,			"Command"},
+	{5,		OT_DataType::flag8_u8,		"ASFflags"},
+	{6,		OT_DataType::flag8_flag8,	"RBPflags"},
+	{7,		OT_DataType::f8_8,			"CoolingControl"},
+	{8,		OT_DataType::f8_8,			"TsetCH2"},
+	{9,		OT_DataType::f8_8,			"TrOverride"},
+	{10,	OT_DataType::u8_u8,			"TSP"},
+	{11,	OT_DataType::u8_u8,			"TSPindexTSPvalue"},
+	{12,	OT_DataType::u8_u8,			"FHBsize"},
+	{13,	OT_DataType::u8_u8,			"FHBindexFHBvalue"},
+	{14,	OT_DataType::f8_8,			"MaxRelModLevelSetting"},
+	{15,	OT_DataType::u8_u8,			"MaxCapacityMinModLevel"},
+	{16,	OT_DataType::f8_8,			"TrSet"},
+	{17,	OT_DataType::f8_8,			"RelModLevel"},
+	{18,	OT_DataType::f8_8,			"CHPressure"},
+	{19,	OT_DataType::f8_8,			"DHWFlowRate"},
+	{20,	OT_DataType::u8_u8,			"DayTime"},
+	{21,	OT_DataType::u8_u8,			"Date"},
+	{22,	OT_DataType::u16,			"Year"},
+	{23,	OT_DataType::f8_8,			"TrSetCH2"},
+	{24,	OT_DataType::f8_8,			"Tr"},
+	{25,	OT_DataType::f8_8,			"Tboiler"},
+	{26,	OT_DataType::f8_8,			"Tdhw"},
+	{27,	OT_DataType::f8_8,			"Toutside"},
+	{28,	OT_DataType::f8_8,			"Tret"},
+	{29,	OT_DataType::f8_8,			"Tstorage"},
+	{30,	OT_DataType::f8_8,			"Tcollector"},
+	{31,	OT_DataType::f8_8,			"TflowCH2"},
+	{32,	OT_DataType::f8_8,			"Tdhw2"},
+	{33,	OT_DataType::s16,			"Texhaust"},
+	{36,	OT_DataType::f8_8,			"FlameCurrent"},
+	{48,	OT_DataType::s8_s8,			"TdhwSetUBTdhwSetLB"},
+	{49,	OT_DataType::s8_s8,			"MaxTSetUBMaxTSetLB"},
+	{50,	OT_DataType::s8_s8,			"HcratioUBHcratioLB"},
+	{56,	OT_DataType::f8_8,			"TdhwSet"},
+	{57,	OT_DataType::f8_8,			"MaxTSet"},
+	{58,	OT_DataType::f8_8,			"Hcratio"},
+	{100,	OT_DataType::flag8_flag8,	"RemoteOverrideFunction"},
+	{115,	OT_DataType::u16,			"OEMDiagnosticCode"},
+	{116,	OT_DataType::u16,			"BurnerStarts"},
+	{117,	OT_DataType::u16,			"CHPumpStarts"},
+	{118,	OT_DataType::u16,			"DHWPumpValveStarts"},
+	{119,	OT_DataType::u16,			"DHWBurnerStarts"},
+	{120,	OT_DataType::u16,			"BurnerOperationHours"},
+	{121,	OT_DataType::u16,			"CHPumpOperationHours"},
+	{122,	OT_DataType::u16,			"DHWPumpValveOperationHours"},
+	{123,	OT_DataType::u16,			"DHWBurnerOperationHours"},
+	{124,	OT_DataType::f8_8,			"OpenThermVersionMaster"},
+	{125,	OT_DataType::f8_8,			"OpenThermVersionSlave"},
+	{126,	OT_DataType::u8_u8,			"MasterVersion"},
+	{127,	OT_DataType::u8_u8,			"SlaveVersion"},
+};
+
+const OT_DataIdDesc*	ot_data_desc(uint8_t id)
+{
+	//Таблица упорядочена по ID
+	size_t	lo	= 0;
+	size_t	hi	= sizeof(data_ids)/sizeof(data_ids[0]);
+	while(lo < hi)
+	{
+		size_t	mid	= (lo + hi)/2;
+		if(data_ids[mid].id < id)	lo	= mid + 1;
+		else						hi	= mid;
+	}
+
+	return (lo < sizeof(data_ids)/sizeof(data_ids[0]) && data_ids[lo].id == id) ? &data_ids[lo] : nullptr;
+}
+
+OT_DataType	ot_data_type(uint8_t id)
+{
+	const OT_DataIdDesc*	desc	= ot_data_desc(id);
+	return desc ? desc->type : OT_DataType::u16;
+}
+
+float	OT_Value::number() const
+{
+	switch(type)
+	{
+		case OT_DataType::f8_8:	return f8_8();
+		case OT_DataType::s16:	return s16();
+		default:				return raw;
+	}
+}
+
+size_t	OT_Value::format(char* buf, size_t size, const char* number_format) const
+{
+	int	len;
+	switch(type)
+	{
+		case OT_DataType::f8_8:
+		case OT_DataType::u16:
+		case OT_DataType::s16:		len	= snprintf(buf, size, number_format ? number_format : "%g", number());	break;
+		case OT_DataType::s8_s8:	len	= snprintf(buf, size, "%d/%d", hb_s8(), lb_s8());						break;
+		default:					len	= snprintf(buf, size, "%u/%u", hb(), lb());								break;
+	}
+
+	return len > 0 ? size_t(len) : 0;
+}
+
+bool	OT_DataStore::update(uint8_t id, uint16_t raw, uint32_t time_ms)
+{
+	size_t	index;
+	if(slot[id])
+		index	= slot[id] - 1;
+	else if(used < capacity)
+	{
+		index		= used++;
+		slot[id]	= uint8_t(index + 1);
+		ids[index]	= id;
+		counts[index]	= 0;
+	}
+	else
+		return false;
+
+	bool	changed	= counts[index] == 0 || raws[index] != raw;
+	raws[index]		= raw;
+	times[index]	= time_ms;
+	counts[index]++;
+	return changed;
+}
+
+bool	OT_DataStore::get(uint8_t id, OT_Value* value, uint32_t* time_ms) const
+{
+	if(!slot[id])
+		return false;
+
+	size_t	index	= slot[id] - 1;
+	*value	= ot_value(id, raws[index]);
+	if(time_ms)
+		*time_ms	= times[index];
+	return true;
+}
@@ -0,0 +1,84 @@
+#ifndef OT_DATA_H
+#define OT_DATA_H
+
+#include <cstddef>
+#include <cstdint>
+#include "ot_protocol.h"
+
+//Описание Data-ID по спецификации OpenTherm 2.2 (и ток пламени ID 36 из 2.3)
+struct OT_DataIdDesc
+{
+	uint8_t			id;
+	OT_DataType		type;
+	const char*		name;
+};
+
+//nullptr - ID не описан в спецификации (в том числе OEM 128..255)
+const OT_DataIdDesc*	ot_data_desc(uint8_t id);
+//Неописанные ID разбираются как u16
+OT_DataType				ot_data_type(uint8_t id);
+
+//Флаги младшего байта ID 0: состояние ведомого
+enum class OT_SlaveStatus: uint8_t{fault, ch_active, dhw_active, flame, cooling, ch2_active, diagnostic};
+//Флаги старшего байта ID 0: команды ведущего
+enum class OT_MasterStatus: uint8_t{ch_enable, dhw_enable, cooling_enable, otc_active, ch2_enable, summer_mode, dhw_blocking};
+//Флаги старшего байта ID 3: конфигурация ведомого. Младший байт - MemberID
+enum class OT_SlaveConfig: uint8_t{dhw_present, on_off_control, cooling, dhw_storage, low_off_pump_not_allowed, ch2_present};
+//Флаги старшего байта ID 5 (ASF). Младший байт - OEM код ошибки
+enum class OT_FaultFlag: uint8_t{service_request, lockout_reset, low_water_press, gas_flame_fault, air_press_fault, water_over_temp};
+
+//Поле данных кадра вместе с его типом. Пары: старший байт - первое значение, младший - второе
+struct OT_Value
+{
+	OT_DataType	type	= OT_DataType::u16;
+	uint16_t	raw		= 0;
+
+	uint8_t		hb() const		{return raw >> 8;}
+	uint8_t		lb() const		{return raw & 0xff;}
+	int8_t		hb_s8() const	{return int8_t(hb());}
+	int8_t		lb_s8() const	{return int8_t(lb());}
+	int16_t		s16() const		{return int16_t(raw);}
+	float		f8_8() const	{return ot_f8_8(raw);}
+
+	template<typename Flag>	bool	hb_flag(Flag bit) const	{return hb() & (1u << static_cast<uint8_t>(bit));}
+	template<typename Flag>	bool	lb_flag(Flag bit) const	{return lb() & (1u << static_cast<uint8_t>(bit));}
+
+	//Число для f8.8, u16 и s16. Пары байтов - сырое значение: их сравнивают только на равенство
+	float		number() const;
+
+	//Текст для публикации: number_format для числовых типов (по умолчанию %g), "hb/lb" для пар
+	size_t		format(char* buf, size_t size, const char* number_format = nullptr) const;
+};
+
+inline OT_Value	ot_value(uint8_t id, uint16_t raw)	{return OT_Value{ot_data_type(id), raw};}
+
+//Последние принятые значения по Data-ID в виде структуры массивов: разбор по типу делается
+//при чтении, а MQTT, журнал и статус берут значения отсюда, не разбирая кадры заново.
+//Строка выделяется ID при первом значении, индекс по ID - один байт на каждый из 256 ID
+class OT_DataStore
+{
+public:
+	static constexpr size_t	capacity	= 32;
+
+private:
+	uint8_t		slot[256]		= {};	//Номер строки + 1, 0 - значения нет
+	uint8_t		ids[capacity]	= {};
+	uint16_t	raws[capacity]	= {};
+	uint32_t	times[capacity]	= {};	//Момент последнего значения, мс
+	uint32_t	counts[capacity]	= {};	//Принято значений
+	uint8_t		used			= 0;
+
+public:
+	//Запись принятого значения. true - значение новое или изменилось
+	bool		update(uint8_t id, uint16_t raw, uint32_t time_ms);
+	bool		get(uint8_t id, OT_Value* value, uint32_t* time_ms = nullptr) const;
+	bool		has(uint8_t id) const	{return slot[id] != 0;}
+
+	size_t		size() const				{return used;}
+	uint8_t		id(size_t index) const		{return ids[index];}
+	OT_Value	value(size_t index) const	{return ot_value(ids[index], raws[index]);}
+	uint32_t	time_ms(size_t index) const	{return times[index];}
+	uint32_t	updates(size_t index) const	{return counts[index];}
+};
+
+#endif	//OT_DATA_H
@@ -0,0 +1,318 @@
+#include "ot_decoder.h"
+
+//Номинальные длительности импульсов для заданной оценки тактовой частоты
+struct OT_Bases
+{
+	uint16_t	high1;	//Одинарный высокий уровень
+	uint16_t	high2;	//Двойной высокий уровень
+	uint16_t	low1;	//Одинарный низкий уровень
+	uint16_t	low2;	//Двойной низкий уровень
+	uint16_t	half;	//Полупериод бита
+};
+
+static OT_Bases OT_IRAM	ot_bases(const OT_Decoder::Clock& clock)
+{
+	int32_t	half	= (clock.half_bit_q4 + 8) >> 4;
+	int32_t	asym	= (clock.asymmetry_q4 + 8) >> 4;
+
+	OT_Bases	b;
+	b.half	= half;
+	b.high1	= half + asym;
+	b.high2	= 2*half + asym;
+	b.low1	= half - asym;
+	b.low2	= 2*half - asym;
+	return b;
+}
+
+static inline int32_t OT_IRAM	ot_abs(int32_t x)
+{
+	return x < 0 ? -x : x;
+}
+
+//Число полубитов в паре "высокий + низкий". Запаздывающий спад переносит время из низкого уровня
+//в высокий, поэтому пара делится на полубиты целиком, а на уровни - по границе высокого
+static bool OT_IRAM	ot_split_pair(int32_t high, int32_t low, int32_t half, int32_t high_split, int32_t* k_high, int32_t* k_low)
+{
+	int32_t	halves	= (high + low + half/2) / half;
+	*k_high	= (high > high_split) ? 2 : 1;
+	*k_low	= halves - *k_high;
+	return halves >= 2 && halves <= 4 && *k_low >= 1 && *k_low <= 2;
+}
+
+//Учёт отклонения участка от номинала, если оно не дальше 60 мкс от опорной асимметрии
+static void OT_IRAM	ot_accumulate(int32_t residual_q4, int32_t center_q4, int32_t* sum, int32_t* count)
+{
+	if(ot_abs(residual_q4 - center_q4) <= (60 << 4)){
+		*sum	+= residual_q4;
+		(*count)++;
+	}
+}
+
+//Допустимое отличие оценки пакета от накопленной, после которого разбор идёт по оценке пакета, мкс
+static constexpr int32_t	clock_tolerance_us	= 15;
+
+//Скорость сглаживания накопленной оценки: 1/clock_ema_depth
+static constexpr uint32_t	clock_ema_depth		= 8;
+
+OT_Decoder::Status OT_IRAM	OT_Decoder::decode(ot_symbol_t* symbols, size_t num_symbols, uint32_t* frame, Clock* clock)
+{
+	*frame	= 0;
+	if(num_symbols == 0)
+		return Status::no_symbols;
+
+	Clock			nominal;
+	const Clock*	use	= clock ? clock : &nominal;
+
+	//Оценка по самому пакету. Ведомый с заметно другой частотой разбирается по ней сразу,
+	//не дожидаясь схождения накопленной оценки
+	Clock	estimate;
+	bool	measured	= clock && measure(symbols, num_symbols, *clock, &estimate);
+	if(measured && (ot_abs(estimate.half_bit_q4 - clock->half_bit_q4) > (clock_tolerance_us << 4) ||
+					ot_abs(estimate.asymmetry_q4 - clock->asymmetry_q4) > (clock_tolerance_us << 4)))
+		use	= &estimate;
+
+	Status	status	= correct(symbols, num_symbols, *use);
+	if(status != Status::ok)
+		return status;
+
+	*frame	= extract(symbols, num_symbols, *use);
+
+	//Накопленная оценка уточняется только по корректно принятым пакетам
+	if(measured && parity_ok(*frame))
+	{
+		uint32_t	depth	= clock->updates < clock_ema_depth ? clock->updates + 1 : clock_ema_depth;
+		clock->half_bit_q4	+= (estimate.half_bit_q4 - clock->half_bit_q4) / int32_t(depth);
+		clock->asymmetry_q4	+= (estimate.asymmetry_q4 - clock->asymmetry_q4) / int32_t(depth);
+		clock->updates++;
+	}
+
+	return Status::ok;
+}
+
+bool OT_IRAM	OT_Decoder::measure(const ot_symbol_t* symbols, size_t num_symbols, const Clock& reference, Clock* estimate)
+{
+	//Первый высокий уровень может быть укорочен поздним стартом приёма,
+	//последний символ обрывается таймаутом. В оценку идут только внутренние участки
+	if(num_symbols < 3)
+		return false;
+
+	//Полупериод для классификации участков: самая короткая пара "высокий + низкий" состоит
+	//из двух одинарных полубитов. Сумма пары не зависит от переноса спада внутри неё,
+	//поэтому ведомый с другой частотой распознаётся без опорной оценки
+	int32_t	min_pair	= 0x7fffffff;
+	for(size_t i = 1; i + 1 < num_symbols; i++)
+	{
+		int32_t	pair	= symbols[i].duration0 + symbols[i].duration1;
+		if(pair < min_pair)
+			min_pair	= pair;
+	}
+
+	OT_Bases	b	= ot_bases(reference);
+	if(min_pair/2 >= 400 && min_pair/2 <= 650)
+		b.half	= min_pair/2;
+	int32_t		asym		= (reference.asymmetry_q4 + 8) >> 4;
+	int32_t		high_split	= 3*b.half/2 + asym;
+	int32_t		low_split	= 3*b.half/2 - asym;
+
+	int32_t	high_sum	= 0,	low_sum		= 0;	//Суммарная длительность уровней
+	int32_t	high_halves	= 0,	low_halves	= 0;	//Количество полубитов в них
+	int32_t	high_runs	= 0,	low_runs	= 0;	//Количество участков
+	for(size_t i = 0; i + 1 < num_symbols; i++)
+	{
+		const ot_symbol_t&	item	= symbols[i];
+		if(item.level0 == 0 || item.level1 != 0)
+			return false;
+
+		int32_t	k_high	= 0;
+		int32_t	k_low	= (item.duration1 > low_split) ? 2 : 1;
+		if(i > 0)
+		{
+			if(!ot_split_pair(item.duration0, item.duration1, b.half, high_split, &k_high, &k_low))
+				return false;
+			high_sum	+= item.duration0;
+			high_halves	+= k_high;
+			high_runs++;
+		}
+
+		low_sum		+= item.duration1;
+		low_halves	+= k_low;
+		low_runs++;
+	}
+
+	if(high_runs < 8 || low_runs < 8)
+		return false;
+
+	//high_sum = high_halves*half + high_runs*asym
+	//low_sum  = low_halves*half - low_runs*asym
+	int32_t	det				= high_halves*low_runs + low_halves*high_runs;
+	int32_t	half_bit_q4		= (high_sum*low_runs + low_sum*high_runs)*16 / det;
+	int32_t	asymmetry_q4	= (high_sum*low_halves - low_sum*high_halves)*16 / det;
+
+	//Спецификация допускает период бита 0.9..1.15 мс, с запасом
+	if(half_bit_q4 < (400 << 4) || half_bit_q4 > (650 << 4) || ot_abs(asymmetry_q4) > (200 << 4))
+		return false;
+
+	//Перенесённые фронты смещают асимметрию. Второй проход уточняет её только по участкам,
+	//отличающимся от опорной асимметрии не более чем на 60 мкс
+	int32_t	residual_sum	= 0;
+	int32_t	residual_count	= 0;
+	for(size_t i = 0; i + 1 < num_symbols; i++)
+	{
+		const ot_symbol_t&	item	= symbols[i];
+
+		int32_t	k_high	= 0;
+		int32_t	k_low	= (item.duration1 > low_split) ? 2 : 1;
+		if(i > 0)
+		{
+			ot_split_pair(item.duration0, item.duration1, b.half, high_split, &k_high, &k_low);
+			ot_accumulate(item.duration0*16 - k_high*half_bit_q4, reference.asymmetry_q4, &residual_sum, &residual_count);
+		}
+		ot_accumulate(k_low*half_bit_q4 - item.duration1*16, reference.asymmetry_q4, &residual_sum, &residual_count);
+	}
+	if(residual_count >= 16)
+		asymmetry_q4	= residual_sum / residual_count;
+
+	estimate->half_bit_q4	= half_bit_q4;
+	estimate->asymmetry_q4	= asymmetry_q4;
+	estimate->updates		= 1;
+	return true;
+}
+
+OT_Decoder::Status OT_IRAM	OT_Decoder::correct(ot_symbol_t* symbols, size_t num_symbols, const Clock& clock)
+{
+	if(num_symbols == 0)
+		return Status::no_symbols;
+
+	OT_Bases	b	= ot_bases(clock);
+
+	//Дополнительная проверка на первый импульс, короче нормального
+	if(symbols[0].duration0 < b.high1)
+		symbols[0].duration0	= b.high1;
+
+	uint16_t	shift	= 0;	//Сдвиг длительности следующего сигнала
+	for(size_t i = 0; i < num_symbols; i++)
+	{
+		ot_symbol_t&	item	= symbols[i];
+
+		//Начальный уровень 0 - дальнейшая коррекция не выполняется
+		if(item.level0 == 0)
+			break;
+
+		//Проверка на короткий импульс. Последний символ завершается таймаутом приёма
+		if(item.duration0 < 150 || item.duration1 < 150){
+			if(i < num_symbols-1)
+				return Status::strange_duration;
+		}
+
+		//Коррекция первого имульса при искаженном предыдущем
+		item.duration0	+= shift;
+		shift	= 0;
+
+		//Проверка длительности первого импульса с коррекцией второго
+		uint16_t	len		= item.duration0;
+		uint16_t	base1	= b.high1;
+		uint16_t	base2	= b.high2;
+		uint16_t	delta	= 30;
+		if(len < base2-2*delta){
+			if(!(len > base1-delta && len < base1+delta)){
+				//Получено не 550, а 800 или около того
+				item.duration0	= base1;
+				item.duration1	+= (len - base1);
+			}
+		}
+		else if(!(len > (base2-delta) && len < (base2+delta))){
+			//Получено не 1060, а 1300 или около того
+			item.duration0	= base2;
+			item.duration1	+= (len - base2);
+		}
+
+		//Проверка длительности второго импульса
+		len		= item.duration1;
+		base1	= b.low1;
+		base2	= b.low2;
+		if(len < base2-2*delta){
+			if(!(len > base1-delta && len < base1+delta)){
+				shift	= len - base1;
+				item.duration1	= base1;
+			}
+		}
+		else if(!(len > base2-delta && len < base2+delta)){
+			shift	= len - base2;
+			item.duration1	= base2;
+		}
+	}
+
+	return Status::ok;
+}
+
+uint32_t OT_IRAM	OT_Decoder::extract(const ot_symbol_t* symbols, size_t num_symbols, const Clock& clock)
+{
+	//Граница между одинарным и двойным полубитом - посередине для каждого уровня
+	OT_Bases	b			= ot_bases(clock);
+	uint16_t	high_split	= (b.high1 + b.high2)/2;
+	uint16_t	low_split	= (b.low1 + b.low2)/2;
+
+	uint32_t	resp		= 0;
+	size_t		bits_count	= 0;
+	uint8_t		slot_index	= 1;	//Приём начинается со второй половины стартового бита
+	for(size_t i = 0; i < num_symbols; i++)
+	{
+		const ot_symbol_t&	item	= symbols[i];
+
+		uint16_t	split	= item.level0 ? high_split : low_split;
+		if(item.duration0 < 30)			slot_index	+= 0;
+		else if(item.duration0 < split)	slot_index	+= 1;
+		else							slot_index	+= 2;
+
+		if(slot_index >= 2)
+		{
+			bits_count++;
+			if(bits_count != 1)	resp	= (resp << 1) | (item.level0? 1 : 0);
+			if(bits_count > 32) break;
+			slot_index	-= 2;
+		}
+
+		split	= item.level1 ? high_split : low_split;
+		if(item.duration1 < 30)			slot_index	+= 0;
+		else if(item.duration1 < split)	slot_index	+= 1;
+		else							slot_index	+= 2;
+
+		if(slot_index >= 2)
+		{
+			bits_count++;
+			if(bits_count != 1)	resp	= (resp << 1) | (item.level1? 1 : 0);
+			if(bits_count > 32) break;
+			slot_index	-= 2;
+		}
+	}
+
+	return resp;
+}
+
+bool OT_IRAM	OT_Decoder::is_clock_burst(const ot_symbol_t* symbols, size_t num_symbols)
+{
+	return num_symbols > 0 && (symbols[0].duration0 < 30 || symbols[0].duration1 < 30);
+}
+
+bool OT_IRAM	OT_Decoder::parity_ok(uint32_t frame)
+{
+	uint8_t	p = 0;
+	while(frame > 0)
+	{
+		if(frame & 1)	p++;
+		frame	= frame >> 1;
+	}
+
+	return !(p & 1);
+}
+
+const char*	OT_Decoder::to_string(Status status)
+{
+	switch(status)
+	{
+		case Status::ok:				return "ok";
+		case Status::no_symbols:		return "no_symbols";
+		case Status::strange_duration:	return "strange_duration";
+		default:						return "wrong_status";
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef OT_DECODER_H
+#define OT_DECODER_H
+
+#include "ot_symbol.h"
+
+//Разбор принятого пакета OpenTherm из символов RMT (разрешение 1 мкс)
+class OT_Decoder
+{
+public:
+	enum class Status: uint8_t{ok, no_symbols, strange_duration};
+
+	//Оценка тактовой частоты ведомого в 1/16 мкс.
+	//Высокий уровень длится k*half_bit + asymmetry, низкий k*half_bit - asymmetry (k = 1, 2)
+	struct Clock
+	{
+		int32_t		half_bit_q4		= 510 << 4;	//Половина периода бита
+		int32_t		asymmetry_q4	= 40 << 4;	//Удлинение высокого уровня за счёт низкого
+		uint32_t	updates			= 0;		//Количество пакетов, учтённых в оценке
+	};
+
+	//Полный разбор: коррекция длительностей на месте и извлечение 32 бит ответа.
+	//Если задана оценка clock, разбор идёт по ней, а после успешного приёма она уточняется
+	static Status	decode(ot_symbol_t* symbols, size_t num_symbols, uint32_t* frame, Clock* clock = nullptr);
+
+	//Оценка полупериода и асимметрии по длительностям одного пакета.
+	//Участки классифицируются на одинарные и двойные по опорной оценке reference
+	static bool		measure(const ot_symbol_t* symbols, size_t num_symbols, const Clock& reference, Clock* estimate);
+
+	//Коррекция искажённых длительностей импульсов котла. Символы изменяются на месте
+	static Status	correct(ot_symbol_t* symbols, size_t num_symbols, const Clock& clock);
+
+	//Извлечение 32 бит ответа (без стартового и стопового битов) по слотам полубитов
+	static uint32_t	extract(const ot_symbol_t* symbols, size_t num_symbols, const Clock& clock);
+
+	//Начальные тактовые импульсы, которые котёл присылает перед основным ответом
+	static bool		is_clock_burst(const ot_symbol_t* symbols, size_t num_symbols);
+
+	//Проверка чётности пакета (true - число единиц чётное)
+	static bool		parity_ok(uint32_t frame);
+
+	static const char*	to_string(Status status);
+};
+
+#endif	//OT_DECODER_H
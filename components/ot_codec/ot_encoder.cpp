@@ -0,0 +1,43 @@
+#include "ot_encoder.h"
+
+//Таблица символов для каждого байта запроса: 8 символов, старший бит первым
+struct OT_ByteSymbols
+{
+	uint32_t	val[256][8];
+};
+
+static constexpr OT_ByteSymbols	make_byte_symbols()
+{
+	OT_ByteSymbols	table	= {};
+	for(unsigned byte = 0; byte < 256; byte++)
+		for(unsigned bit = 0; bit < 8; bit++)
+			table.val[byte][bit]	= (byte & (0x80 >> bit)) ? OT_Encoder::bit1 : OT_Encoder::bit0;
+
+	return table;
+}
+
+static constexpr OT_ByteSymbols	byte_symbols	= make_byte_symbols();
+static_assert(byte_symbols.val[0xA5][0] == OT_Encoder::bit1 && byte_symbols.val[0xA5][1] == OT_Encoder::bit0, "MSB first");
+
+size_t	OT_Encoder::encode(uint32_t request, size_t position, ot_symbol_t* symbols, size_t symbols_free)
+{
+	if(position >= frame_symbols)
+		return 0;
+
+	size_t	count	= frame_symbols - position;
+	if(count > symbols_free)
+		count	= symbols_free;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		//Позиция 0 - стартовый бит, 1..32 - биты запроса, 33 - стоповый бит.
+		//Для позиции 0 беззнаковый bit переполняется, поэтому оба служебных бита попадают в else
+		size_t	bit	= position + i - 1;
+		if(bit < 32)
+			symbols[i].val	= byte_symbols.val[(request >> (24 - (bit & ~size_t(7)))) & 0xff][bit & 7];
+		else
+			symbols[i].val	= bit1;
+	}
+
+	return count;
+}
@@ -0,0 +1,22 @@
+#ifndef OT_ENCODER_H
+#define OT_ENCODER_H
+
+#include "ot_symbol.h"
+
+//Формирование символов RMT для передачи запроса OpenTherm (разрешение 1 мкс).
+//Бит передаётся одним символом из двух полупериодов, на выходе канала уровни инвертируются схемой
+class OT_Encoder
+{
+public:
+	static constexpr size_t		frame_symbols	= 34;	//Стартовый бит, 32 бита запроса, стоповый бит
+	static constexpr uint16_t	half_bit_us		= 500;
+
+	static constexpr uint32_t	bit0	= ot_symbol_val(half_bit_us, 1, half_bit_us, 0);
+	static constexpr uint32_t	bit1	= ot_symbol_val(half_bit_us, 0, half_bit_us, 1);
+
+	//Запись символов кадра, начиная с позиции position, не более symbols_free.
+	//Возвращает число записанных символов. Кадр закончен, когда position + результат == frame_symbols
+	static size_t	encode(uint32_t request, size_t position, ot_symbol_t* symbols, size_t symbols_free);
+};
+
+#endif	//OT_ENCODER_H
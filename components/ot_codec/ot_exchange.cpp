@@ -0,0 +1,91 @@
+#include "ot_exchange.h"
+#include "ot_decoder.h"
+
+OT_Message_t	ot_make_request(OT_Command cmd, uint8_t id, uint16_t data)
+{
+	OT_MsgType	msg_type;
+	switch(cmd)
+	{
+		case OT_Command::write:		msg_type = OT_MsgType::WRITE_DATA;		break;
+		case OT_Command::invalid:	msg_type = OT_MsgType::INVALID_DATA;	break;
+		default:					msg_type = OT_MsgType::READ_DATA;		break;
+	}
+
+	OT_Message_t	request;
+	request.all				= 0;
+	request.bit.msg_type	= static_cast<uint8_t>(msg_type);
+	request.bit.id			= id;
+	request.bit.spare		= 0;
+	request.bit.data		= data;
+	request.bit.parity		= OT_Decoder::parity_ok(request.all) ? 0 : 1;
+	return request;
+}
+
+OT_Response	ot_exchange(OT_Transport& transport, OT_Command cmd, uint8_t id, uint16_t data, bool data_invalid_expected, OT_FailsCounter& fails)
+{
+	OT_Message_t	request	= ot_make_request(cmd, id, data);
+
+	//Отправка команды
+	OT_Message_t	response;
+	OT_Transport::Result	response_status	= transport.processOT(request.all, &response.all);
+
+	OT_Response	out;
+	out.data		= 0;
+	out.request		= request.all;
+	out.response	= response.all;
+	out.status 		= OT_Status::sucsess;
+
+	if(response_status == OT_Transport::Result::sucsess){
+		//Проверка четности
+		if(!OT_Decoder::parity_ok(response.all))	{fails.parityFail++;								out.status	= OT_Status::parityFail;}
+		else{
+			//Проверка на ACK
+			switch(static_cast<OT_MsgType>(response.bit.msg_type)){
+				case OT_MsgType::READ_ACK:			{if(cmd == OT_Command::write)	{fails.ACK_fail++;		out.status	= OT_Status::ACK_fail;}}	break;
+				case OT_MsgType::WRITE_ACK:			{if(cmd == OT_Command::read) 	{fails.ACK_fail++;		out.status	= OT_Status::ACK_fail;}}	break;
+				case OT_MsgType::DATA_INVALID:		{if(!data_invalid_expected)		{fails.dataInvalid++;	out.status	= OT_Status::dataInvalid;}}	break;
+				case OT_MsgType::UNKNOWN_DATAID:	{fails.unknownID++;										out.status	= OT_Status::unknownID;}	break;
+				default:							{fails.msgType_unknown++;								out.status	= OT_Status::msgType_unknown;}
+			}
+
+			//Проверка на SPARE
+			if(out.status == OT_Status::sucsess && response.bit.spare != 0)
+													{fails.SPARE_fail++;								out.status	= OT_Status::SPARE_fail;}
+
+			//Проверка на ID. Только в этом случае все проверки на корректность ответа котла пройдены
+			if(out.status == OT_Status::sucsess){
+				if(response.bit.id != id)			{fails.responseID_fail++;							out.status	= OT_Status::responseID_fail;}
+				else								out.data	= response.bit.data;
+			}
+		}
+	}
+	else if(response_status == OT_Transport::Result::receive_timeout){
+		fails.timeout++;
+		out.status	= OT_Status::timeout;
+	}
+	else{
+		fails.rx_invalid++;
+		out.status	= OT_Status::rx_invalid;
+	}
+
+	return out;
+}
+
+const char*	ot_status_to_string(OT_Status status)
+{
+	switch(status)
+	{
+		case OT_Status::sucsess:			return "sucsess";
+		case OT_Status::notInited:			return "notInited";
+		case OT_Status::timeout:			return "timeout";
+		case OT_Status::rx_invalid:			return "rx_invalid";
+		case OT_Status::parityFail:			return "parityFail";
+		case OT_Status::unknownID:			return "unknownID";
+		case OT_Status::dataInvalid:		return "dataInvalid";
+		case OT_Status::ACK_fail:			return "ACK_fail";
+		case OT_Status::msgType_unknown:	return "msgType_unknown";
+		case OT_Status::SPARE_fail:			return "SPARE_fail";
+		case OT_Status::responseID_fail:	return "responseID_fail";
+		default:							return "wrong_status";
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef OT_EXCHANGE_H
+#define OT_EXCHANGE_H
+
+#include <cstdint>
+#include "ot_protocol.h"
+
+//Транспорт кадров OpenTherm: шина RMT на ESP32 или симулятор ведомого на хосте
+class OT_Transport
+{
+public:
+	enum class Result: uint8_t{sucsess, receive_timeout, receive_invalid_state, receive_invalid_arg, receive_fail, fail};
+
+	virtual ~OT_Transport() = default;
+	virtual Result	processOT(const uint32_t request, uint32_t* response) = 0;
+};
+
+enum class OT_Command: uint8_t {read, write, invalid};
+enum class OT_Status: uint8_t{sucsess, notInited, timeout, rx_invalid, parityFail, unknownID, dataInvalid, ACK_fail, msgType_unknown, SPARE_fail, responseID_fail};
+
+//Счётчики ошибок обмена. Каждый неудачный обмен учитывается ровно одним счётчиком
+struct OT_FailsCounter
+{
+	uint32_t	notInited		= 0;
+	uint32_t	timeout			= 0;
+	uint32_t	rx_invalid		= 0;
+	uint32_t	parityFail		= 0;
+	uint32_t	unknownID		= 0;
+	uint32_t	dataInvalid		= 0;
+	uint32_t	ACK_fail		= 0;
+	uint32_t	msgType_unknown	= 0;
+	uint32_t	SPARE_fail		= 0;
+	uint32_t	responseID_fail	= 0;
+};
+
+struct	OT_Response
+{
+	OT_Status	status;
+	uint16_t	data;
+	uint32_t	response;
+	uint32_t	request;
+
+	float	get_float()	{return (data & 32768) ? -(65536 - data)/256.f : data/256.f;}
+};
+
+//Запрос ведущего с битом чётности
+OT_Message_t	ot_make_request(OT_Command cmd, uint8_t id, uint16_t data);
+
+//Обмен с проверкой ответа ведомого: чётность, тип подтверждения, SPARE и ID
+OT_Response		ot_exchange(OT_Transport& transport, OT_Command cmd, uint8_t id, uint16_t data, bool data_invalid_expected, OT_FailsCounter& fails);
+
+const char*		ot_status_to_string(OT_Status status);
+
+#endif	//OT_EXCHANGE_H
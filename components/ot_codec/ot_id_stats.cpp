@@ -0,0 +1,63 @@
+#include "ot_id_stats.h"
+
+size_t	OT_IdStats::bucket(uint32_t value_ms, const uint16_t* bounds, size_t size)
+{
+	size_t	i	= 0;
+	while(i < size && value_ms >= bounds[i])
+		i++;
+	return i;
+}
+
+const OT_IdStats::Entry*	OT_IdStats::find(uint8_t id) const
+{
+	for(size_t i = 0; i < count; i++)
+		if(entries[i].id == id)
+			return &entries[i];
+
+	return nullptr;
+}
+
+void	OT_IdStats::record(uint8_t id, OT_Status status, int64_t response_us, int64_t gap_us)
+{
+	Entry*	entry	= nullptr;
+	for(size_t i = 0; i < count && !entry; i++)
+		if(entries[i].id == id)
+			entry	= &entries[i];
+
+	if(!entry)
+	{
+		if(count < max_ids){
+			entry		= &entries[count++];
+			entry->id	= id;
+		}
+		else	entry	= &other;
+	}
+
+	entry->attempts++;
+	size_t	s	= static_cast<size_t>(status);
+	if(s < status_count)
+		entry->status[s]++;
+
+	if(response_us >= 0)
+	{
+		uint32_t	ms	= uint32_t(response_us/1000);
+		if(ms > UINT16_MAX)
+			ms	= UINT16_MAX;
+
+		entry->responses++;
+		entry->histogram[bucket(ms, response_bounds_ms, response_buckets - 1)]++;
+		entry->response_sum_ms	+= ms;
+		if(ms < entry->response_min_ms)	entry->response_min_ms	= ms;
+		if(ms > entry->response_max_ms)	entry->response_max_ms	= ms;
+	}
+
+	if(gap_us >= 0)
+	{
+		uint32_t	us	= gap_us > UINT32_MAX ? UINT32_MAX : uint32_t(gap_us);
+		gap_stat.count++;
+		gap_stat.histogram[bucket(us/1000, gap_bounds_ms, gap_buckets - 1)]++;
+		gap_stat.sum_us	+= us;
+		if(us < gap_stat.min_us)	gap_stat.min_us	= us;
+		if(us > gap_stat.max_us)	gap_stat.max_us	= us;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef OT_ID_STATS_H
+#define OT_ID_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "ot_exchange.h"
+
+//Статистика обменов по Data-ID: попытки, исход каждого обмена по OT_Status и гистограмма времени ответа
+//от начала передачи запроса до конца приёма ответа. Память фиксирована: строки выделяются ID при первом
+//обмене, когда они кончаются, обмены учитываются в общей строке other. Запись - несколько сложений,
+//поэтому статистика собирается всегда
+class OT_IdStats
+{
+public:
+	static constexpr size_t		max_ids			= 24;
+	static constexpr size_t		status_count	= static_cast<size_t>(OT_Status::responseID_fail) + 1;
+	static constexpr size_t		response_buckets	= 8;
+	static constexpr size_t		gap_buckets		= 7;
+
+	//Верхние границы корзин, мс. Последняя корзина - всё, что больше.
+	//Ответ приходит не раньше 20 мс и не позже 800 мс после запроса, сами кадры идут по 34 мс
+	static constexpr uint16_t	response_bounds_ms[response_buckets - 1]	= {100, 150, 200, 300, 400, 600, 900};
+	//Пауза между концом ответа и следующим запросом: не меньше 100 мс по спецификации
+	static constexpr uint16_t	gap_bounds_ms[gap_buckets - 1]				= {105, 150, 250, 500, 1000, 5000};
+
+	struct Entry
+	{
+		uint8_t		id			= 0;
+		uint32_t	attempts	= 0;
+		uint32_t	status[status_count]	= {};	//Исход каждого обмена, сумма равна attempts
+		uint32_t	responses	= 0;				//Обмены с принятым ответом (все, кроме timeout)
+		uint32_t	histogram[response_buckets]	= {};
+		uint32_t	response_sum_ms	= 0;
+		uint16_t	response_min_ms	= UINT16_MAX;
+		uint16_t	response_max_ms	= 0;
+	};
+
+	//Паузы между кадрами на шине, без разбивки по ID
+	struct Gap
+	{
+		uint32_t	count		= 0;
+		uint32_t	histogram[gap_buckets]	= {};
+		uint64_t	sum_us		= 0;
+		uint32_t	min_us		= UINT32_MAX;
+		uint32_t	max_us		= 0;
+	};
+
+private:
+	Entry		entries[max_ids];
+	Entry		other;				//ID, которым не хватило строки
+	uint8_t		count	= 0;
+	Gap			gap_stat;
+
+	static size_t	bucket(uint32_t value_ms, const uint16_t* bounds, size_t size);
+
+public:
+	//response_us < 0 - ответа нет, gap_us < 0 - пауза неизвестна (первый обмен)
+	void	record(uint8_t id, OT_Status status, int64_t response_us, int64_t gap_us);
+
+	size_t			size() const				{return count;}
+	const Entry&	entry(size_t index) const	{return entries[index];}
+	const Entry&	overflow() const			{return other;}
+	const Gap&		gap() const					{return gap_stat;}
+	const Entry*	find(uint8_t id) const;
+};
+
+#endif	//OT_ID_STATS_H
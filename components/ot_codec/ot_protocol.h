@@ -0,0 +1,42 @@
+#ifndef OT_PROTOCOL_H
+#define OT_PROTOCOL_H
+
+#include <cstdint>
+
+//Формат сообщения OpenTherm
+union OT_Message_t
+{
+	struct {
+		uint16_t	data		:16;	//Data value
+		uint8_t		id			:8;		//Data ID
+		uint8_t		spare		:4;		//SPARE
+		uint8_t		msg_type	:3;		//Message type
+		uint8_t		parity		:1;		//Бит четности
+	}bit;
+	uint32_t	all	= 0;
+};
+
+static_assert(sizeof(OT_Message_t) == sizeof(uint32_t), "OT_Message_t must be one frame");
+
+enum class OT_MsgType: uint8_t{
+	//Master to slave
+	READ_DATA 		= 0b000,
+	WRITE_DATA 		= 0b001,
+	INVALID_DATA	= 0b010,
+	reserved		= 0b011,
+
+	//Slave to master
+	READ_ACK		= 0b100,
+	WRITE_ACK		= 0b101,
+	DATA_INVALID	= 0b110,
+	UNKNOWN_DATAID	= 0b111
+};
+
+//Типы поля данных (спецификация OpenTherm 2.2, раздел 5.2).
+//Пары байтов: старший байт - первое значение, младший - второе
+enum class OT_DataType: uint8_t{f8_8, u16, s16, flag8_flag8, u8_u8, s8_s8, flag8_u8};
+
+//Число со знаком в формате f8.8
+inline float	ot_f8_8(uint16_t data)	{return int16_t(data)/256.f;}
+
+#endif	//OT_PROTOCOL_H
@@ -0,0 +1,107 @@
+#include <cstring>
+#include <cstddef>
+#include "ot_recorder.h"
+
+static_assert(offsetof(OT_Recorder::Record, symbols) == OT_Recorder::record_header_size, "packed record header");
+static_assert(sizeof(OT_Recorder::Header) == 20, "packed file header");
+
+OT_Recorder::OT_Recorder(size_t capacity): capacity(capacity)
+{
+	records	= new Record[capacity];
+}
+
+OT_Recorder::~OT_Recorder()
+{
+	delete[]	records;
+}
+
+void	OT_Recorder::record(uint32_t time_ms, uint32_t request, uint32_t response, uint8_t status, uint16_t wait_ms, const ot_symbol_t* symbols, size_t num_symbols)
+{
+	if(!capacity)
+		return;
+
+	if(num_symbols > max_symbols)
+		num_symbols	= max_symbols;
+
+	Record&	rec		= records[head];
+	rec.time_ms		= time_ms;
+	rec.request		= request;
+	rec.response	= response;
+	rec.wait_ms		= wait_ms;
+	rec.status		= status;
+	rec.num_symbols	= num_symbols;
+	for(size_t i = 0; i < num_symbols; i++)
+		rec.symbols[i]	= symbols[i].val;
+
+	head	= (head + 1) % capacity;
+	if(count < capacity)
+		count++;
+	total++;
+}
+
+size_t	OT_Recorder::serialized_size() const
+{
+	size_t	size	= sizeof(Header);
+	for(size_t i = 0; i < count; i++)
+		size	+= record_header_size + records[i].num_symbols*sizeof(uint32_t);
+
+	return size;
+}
+
+size_t	OT_Recorder::serialize(uint8_t* out, size_t out_size, uint32_t uptime_ms) const
+{
+	if(out_size < serialized_size())
+		return 0;
+
+	Header	header;
+	header.magic		= magic;
+	header.version		= version;
+	header.max_symbols	= max_symbols;
+	header.count		= count;
+	header.total		= total;
+	header.uptime_ms	= uptime_ms;
+	memcpy(out, &header, sizeof(header));
+	size_t	pos	= sizeof(header);
+
+	//От старой записи к новой, символы только принятые
+	size_t	first	= (head + capacity - count) % capacity;
+	for(size_t i = 0; i < count; i++)
+	{
+		const Record&	rec		= records[(first + i) % capacity];
+		size_t			size	= record_header_size + rec.num_symbols*sizeof(uint32_t);
+		memcpy(out + pos, &rec, size);
+		pos	+= size;
+	}
+
+	return pos;
+}
+
+bool	OT_Recorder::parse(const uint8_t* data, size_t size, Header* header, std::vector<Record>& out)
+{
+	if(size < sizeof(Header))
+		return false;
+
+	memcpy(header, data, sizeof(Header));
+	if(header->magic != magic || header->version != version)
+		return false;
+
+	size_t	pos	= sizeof(Header);
+	for(uint32_t i = 0; i < header->count; i++)
+	{
+		Record	rec;
+		if(pos + record_header_size > size)
+			return false;
+		memcpy(&rec, data + pos, record_header_size);
+		pos	+= record_header_size;
+
+		size_t	symbols_size	= rec.num_symbols*sizeof(uint32_t);
+		if(rec.num_symbols > max_symbols || pos + symbols_size > size)
+			return false;
+		memcpy(rec.symbols, data + pos, symbols_size);
+		pos	+= symbols_size;
+
+		out.push_back(rec);
+	}
+
+	return true;
+}
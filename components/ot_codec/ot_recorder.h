@@ -0,0 +1,66 @@
+#ifndef OT_RECORDER_H
+#define OT_RECORDER_H
+
+#include <vector>
+#include "ot_symbol.h"
+
+//Бортовой самописец обменов OpenTherm: кольцо последних транзакций с исходными символами приёма.
+//Выгружается одним блоком в двоичном виде (порядок байт little-endian, как у ESP32):
+//	Header, затем записи от старой к новой, каждая - 16 байт заголовка и num_symbols слов символов
+class OT_Recorder
+{
+public:
+	static constexpr uint32_t	magic		= 0x5246544f;	//"OTFR"
+	static constexpr uint16_t	version		= 1;
+	static constexpr size_t		max_symbols	= 40;			//Ответ котла с запасом на дробление фронтов
+
+	struct Header
+	{
+		uint32_t	magic;
+		uint16_t	version;
+		uint16_t	max_symbols;
+		uint32_t	count;		//Записей в выгрузке
+		uint32_t	total;		//Записей с момента старта, включая вытесненные
+		uint32_t	uptime_ms;	//Время выгрузки
+	};
+
+	struct Record
+	{
+		uint32_t	time_ms;		//Время обмена от старта
+		uint32_t	request;
+		uint32_t	response;		//Ответ в том виде, в каком его вернул декодер
+		uint16_t	wait_ms;		//Ожидание ответа
+		uint8_t		status;			//OT_Status
+		uint8_t		num_symbols;	//Символов приёма (лишние отбрасываются)
+		uint32_t	symbols[max_symbols];
+	};
+	static constexpr size_t	record_header_size	= 16;
+
+private:
+	Record*		records		= nullptr;
+	size_t		capacity	= 0;
+	size_t		head		= 0;	//Следующая запись
+	size_t		count		= 0;
+	uint32_t	total		= 0;
+
+public:
+	explicit OT_Recorder(size_t capacity);
+	~OT_Recorder();
+	OT_Recorder(const OT_Recorder&) = delete;
+	OT_Recorder&	operator=(const OT_Recorder&) = delete;
+
+	void	record(uint32_t time_ms, uint32_t request, uint32_t response, uint8_t status, uint16_t wait_ms, const ot_symbol_t* symbols, size_t num_symbols);
+	void	clear()	{head = count = 0;}
+
+	size_t		size() const		{return count;}
+	uint32_t	recorded() const	{return total;}
+
+	//Выгрузка в двоичный блок. Возвращает число записанных байт или 0, если не хватает места
+	size_t	serialized_size() const;
+	size_t	serialize(uint8_t* out, size_t out_size, uint32_t uptime_ms) const;
+
+	//Разбор выгрузки на хосте
+	static bool	parse(const uint8_t* data, size_t size, Header* header, std::vector<Record>& out);
+};
+
+#endif	//OT_RECORDER_H
@@ -0,0 +1,89 @@
+#include "ot_repeat.h"
+
+OT_Repeats::Result	OT_Repeats::report(size_t type, bool ok, int64_t now_us)
+{
+	if(type >= max_types)
+		return Result::ok;
+
+	Slot&	slot		= slots[type];
+	bool	is_retry	= repeating == int(type);
+	if(is_retry)
+		reported	= true;
+
+	//Удачный обмен снимает ожидающий повтор: значение уже у котла
+	if(ok){
+		if(slot.pending && is_retry)
+			stat.succeeded++;
+		slot	= Slot();
+		return Result::ok;
+	}
+
+	if(!slot.pending){
+		slot.pending	= true;
+		slot.attempts	= 0;
+		slot.due_us		= now_us + backoff_us;
+		stat.queued++;
+		return Result::queued;
+	}
+
+	//Новая неудачная команда того же типа: повтор и так отправит последнее значение
+	if(!is_retry){
+		stat.coalesced++;
+		return Result::coalesced;
+	}
+
+	//Неудачный повтор: следующий вдвое позже, после max_attempts - отказ
+	slot.attempts++;
+	if(slot.attempts >= max_attempts){
+		stat.given_up++;
+		slot	= Slot();
+		return Result::given_up;
+	}
+	slot.due_us	= now_us + (backoff_us << slot.attempts);
+	return Result::retry_failed;
+}
+
+int	OT_Repeats::begin(int64_t now_us)
+{
+	budget		+= float(now_us - budget_us)/budget_refill_us;
+	budget_us	= now_us;
+	if(budget > budget_max)	budget	= budget_max;
+	if(budget < 1.f)
+		return -1;
+
+	//Самый давно ожидающий повтор, срок которого подошёл
+	int	best	= -1;
+	for(size_t i = 0; i < max_types; i++)
+		if(slots[i].pending && slots[i].due_us <= now_us && (best < 0 || slots[i].due_us < slots[best].due_us))
+			best	= int(i);
+	if(best < 0)
+		return -1;
+
+	budget		-= 1.f;
+	stat.retried++;
+	repeating	= best;
+	reported	= false;
+	return best;
+}
+
+OT_Repeats::Result	OT_Repeats::end(int64_t now_us)
+{
+	Result	result	= Result::ok;
+	if(repeating >= 0 && !reported){
+		stat.unreported++;
+		result	= report(size_t(repeating), false, now_us);
+	}
+	repeating	= -1;
+	reported	= false;
+
+	return result;
+}
+
+size_t	OT_Repeats::pending() const
+{
+	size_t	count	= 0;
+	for(const Slot& slot : slots)
+		if(slot.pending)	count++;
+
+	return count;
+}
@@ -0,0 +1,66 @@
+#ifndef OT_REPEAT_H
+#define OT_REPEAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+//Повтор неудачных обменов: по слоту на тип, поэтому несколько неудачных записей одной уставки
+//сливаются в один повтор с последним значением. Каждый следующий повтор вдвое дальше предыдущего,
+//после max_attempts неудачных повторов слот освобождается. Бюджет повторов пополняется со временем
+//и не даёт повторам занять всю шину при потере связи.
+//Повтор выполняется между begin и end. Если за это время результат не сообщён через report,
+//end считает повтор неудачным: слот не может остаться с прошедшим сроком навсегда
+class OT_Repeats
+{
+public:
+	static constexpr size_t		max_types			= 16;
+	static constexpr uint8_t	max_attempts		= 5;
+	static constexpr int64_t	backoff_us			= 1000000;	//Первый повтор через 1 с, затем 2, 4, 8 с
+	static constexpr float		budget_max			= 10;		//Повторов подряд после долгой тишины
+	static constexpr int64_t	budget_refill_us	= 6000000;	//Один повтор в 6 с в среднем
+
+	enum class Result: uint8_t{ok, queued, coalesced, retry_failed, given_up};
+
+	struct Slot
+	{
+		bool		pending		= false;
+		uint8_t		attempts	= 0;
+		int64_t		due_us		= 0;
+	};
+
+	struct Stats
+	{
+		uint32_t	queued		= 0;
+		uint32_t	coalesced	= 0;
+		uint32_t	retried		= 0;
+		uint32_t	succeeded	= 0;
+		uint32_t	given_up	= 0;
+		uint32_t	unreported	= 0;	//Повтор завершился без report
+	};
+
+private:
+	Slot		slots[max_types];
+	Stats		stat;
+	int			repeating	= -1;		//Какой повтор выполняется сейчас
+	bool		reported	= false;
+	float		budget		= budget_max;
+	int64_t		budget_us	= 0;
+
+public:
+	explicit OT_Repeats(int64_t now_us = 0)	{budget_us = now_us;}
+
+	//Результат обмена типа type. ok снимает ожидающий повтор
+	Result	report(size_t type, bool ok, int64_t now_us);
+
+	//Тип, повтор которого нужно выполнить сейчас (бюджет списан), или -1
+	int		begin(int64_t now_us);
+	//Завершение повтора, начатого begin
+	Result	end(int64_t now_us);
+
+	size_t			pending() const;
+	const Slot&		slot(size_t type) const		{return slots[type];}
+	const Stats&	stats() const				{return stat;}
+	float			budget_left() const			{return budget;}
+};
+
+#endif	//OT_REPEAT_H
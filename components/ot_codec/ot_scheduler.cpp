@@ -0,0 +1,155 @@
+#include "ot_scheduler.h"
+
+int	OT_Scheduler::add(uint8_t id, uint32_t period_ms, uint8_t priority, uint32_t deadline_ms, uint32_t max_period_ms)
+{
+	if(count >= max_jobs || period_ms == 0)
+		return -1;
+
+	Job&	job		= jobs[count];
+	job				= Job();
+	job.id			= id;
+	job.priority	= priority;
+	job.period_ms	= period_ms;
+	job.min_period_ms	= period_ms;
+	job.max_period_ms	= max_period_ms > period_ms ? max_period_ms : period_ms;
+	job.deadline_ms	= (deadline_ms == 0 || deadline_ms > period_ms) ? period_ms : deadline_ms;
+	job.release_us	= stat.start_us;
+	job.due_us		= job.release_us + int64_t(job.deadline_ms)*1000;
+	return int(count++);
+}
+
+void	OT_Scheduler::set_period(size_t index, uint32_t period_ms)
+{
+	if(index >= count || period_ms == 0)
+		return;
+
+	//Срок сохраняет долю периода. Ближайший выход переносится, только если он теперь позже нового периода
+	Job&	job		= jobs[index];
+	job.deadline_ms	= uint32_t(uint64_t(job.deadline_ms)*period_ms/job.period_ms);
+	if(job.deadline_ms == 0)
+		job.deadline_ms	= 1;
+
+	//Вызывается после complete: release_us - уже следующий выход по старому периоду
+	int64_t	last_release	= job.release_us - int64_t(job.period_ms)*1000;
+	job.period_ms	= period_ms;
+	if(job.release_us > last_release + int64_t(period_ms)*1000)
+		job.release_us	= last_release + int64_t(period_ms)*1000;
+	job.due_us		= job.release_us + int64_t(job.deadline_ms)*1000;
+}
+
+void	OT_Scheduler::set_enabled(size_t index, bool enabled, int64_t now_us)
+{
+	if(index >= count || jobs[index].enabled == enabled)
+		return;
+
+	Job&	job		= jobs[index];
+	job.enabled		= enabled;
+	if(enabled)
+	{
+		job.release_us	= now_us;
+		job.due_us		= now_us + int64_t(job.deadline_ms)*1000;
+	}
+}
+
+void	OT_Scheduler::adapt(size_t index, bool changing)
+{
+	if(index >= count)
+		return;
+
+	const Job&	job	= jobs[index];
+	if(job.max_period_ms == job.min_period_ms)
+		return;
+
+	if(changing)						set_period(index, job.min_period_ms);
+	else if(job.period_ms < job.max_period_ms)
+		set_period(index, job.period_ms*2 < job.max_period_ms ? job.period_ms*2 : job.max_period_ms);
+}
+
+void	OT_Scheduler::boost()
+{
+	for(size_t i = 0; i < count; i++)
+		if(jobs[i].max_period_ms != jobs[i].min_period_ms)
+			set_period(i, jobs[i].min_period_ms);
+}
+
+int	OT_Scheduler::next(int64_t now_us) const
+{
+	int	best	= -1;
+	for(size_t i = 0; i < count; i++)
+	{
+		const Job&	job	= jobs[i];
+		if(!job.enabled || job.release_us > now_us)
+			continue;
+
+		if(best < 0){
+			best	= int(i);
+			continue;
+		}
+
+		//Сроки в пределах одного обмена считаются одинаковыми: решает приоритет
+		const Job&	cur		= jobs[best];
+		int64_t		diff	= job.due_us - cur.due_us;
+		if(diff < -stat.cost_us || diff > stat.cost_us){
+			if(diff < 0)	best	= int(i);
+		}
+		else if(job.priority < cur.priority || (job.priority == cur.priority && diff < 0))
+			best	= int(i);
+	}
+
+	return best;
+}
+
+int64_t	OT_Scheduler::idle_for_us(int64_t now_us) const
+{
+	int64_t	nearest	= -1;
+	for(size_t i = 0; i < count; i++)
+		if(jobs[i].enabled && (nearest < 0 || jobs[i].release_us < nearest))
+			nearest	= jobs[i].release_us;
+
+	return nearest > now_us ? nearest - now_us : 0;
+}
+
+void	OT_Scheduler::complete(size_t index, int64_t start_us, int64_t end_us)
+{
+	if(index >= count)
+		return;
+
+	Job&	job	= jobs[index];
+	job.runs++;
+	stat.runs++;
+	if(end_us > job.due_us)
+	{
+		job.misses++;
+		stat.misses++;
+		if(end_us - job.due_us > job.max_late_us)
+			job.max_late_us	= end_us - job.due_us;
+	}
+
+	//Средняя длительность обмена с глубиной 8
+	int64_t	cost	= end_us - start_us;
+	stat.busy_us	+= cost;
+	stat.cost_us	+= int32_t((cost - stat.cost_us)/8);
+
+	//Следующий выход по сетке периода. После долгого простоя сетка привязывается к текущему времени
+	int64_t	period_us	= int64_t(job.period_ms)*1000;
+	job.release_us	+= period_us;
+	if(job.release_us + period_us < end_us)
+		job.release_us	= end_us;
+	job.due_us		= job.release_us + int64_t(job.deadline_ms)*1000;
+}
+
+double	OT_Scheduler::utilization(int64_t now_us) const
+{
+	int64_t	elapsed	= now_us - stat.start_us;
+	return elapsed > 0 ? double(stat.busy_us)/elapsed : 0.;
+}
+
+double	OT_Scheduler::demand() const
+{
+	double	sum	= 0;
+	for(size_t i = 0; i < count; i++)
+		if(jobs[i].enabled)
+			sum	+= double(stat.cost_us)/(int64_t(jobs[i].period_ms)*1000);
+
+	return sum;
+}
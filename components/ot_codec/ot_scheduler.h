@@ -0,0 +1,80 @@
+#ifndef OT_SCHEDULER_H
+#define OT_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+
+//Планировщик периодических обменов с ведомым на одной шине.
+//Каждый обмен (job) выходит с периодом period и должен быть выполнен до deadline после выхода.
+//Из готовых выбирается обмен с ближайшим сроком (EDF); если сроки ближе одного обмена друг к другу,
+//выигрывает меньший priority. Шина занимается только одним обменом, поэтому вытеснения нет.
+//Период адаптивного обмена (max_period_ms > period_ms) удваивается, пока значение стоит на месте,
+//и сбрасывается к наименьшему, как только оно начинает меняться
+class OT_Scheduler
+{
+public:
+	static constexpr size_t		max_jobs	= 16;
+
+	struct Job
+	{
+		uint8_t		id			= 0;	//Data-ID, только для отчёта
+		uint8_t		priority	= 0;	//0 - самый важный
+		uint32_t	period_ms	= 1000;	//Текущий период
+		uint32_t	min_period_ms	= 1000;
+		uint32_t	max_period_ms	= 1000;
+		uint32_t	deadline_ms	= 1000;	//Относительный срок, не больше периода
+		int64_t		release_us	= 0;	//Выход текущего экземпляра
+		int64_t		due_us		= 0;	//Абсолютный срок текущего экземпляра
+		uint32_t	runs		= 0;
+		uint32_t	misses		= 0;	//Выполнен позже срока
+		int64_t		max_late_us	= 0;	//Наибольшее опоздание
+		bool		enabled		= true;	//false - ведомый ID не поддерживает, обмен не выходит
+	};
+
+	struct Stats
+	{
+		uint32_t	runs		= 0;
+		uint32_t	misses		= 0;
+		int64_t		busy_us		= 0;	//Время шины под обменами планировщика
+		int64_t		start_us	= 0;
+		int32_t		cost_us		= 200000;	//Средняя длительность обмена (пауза, запрос, ответ)
+	};
+
+private:
+	Job			jobs[max_jobs];
+	size_t		count	= 0;
+	Stats		stat;
+
+public:
+	explicit OT_Scheduler(int64_t now_us = 0)	{stat.start_us = now_us;}
+
+	//Добавление обмена. Первый выход - сразу. Возвращает индекс или -1, если места нет
+	int		add(uint8_t id, uint32_t period_ms, uint8_t priority, uint32_t deadline_ms = 0, uint32_t max_period_ms = 0);
+	void	set_period(size_t index, uint32_t period_ms);
+
+	//Отключение обмена. Включённый снова выходит сразу
+	void	set_enabled(size_t index, bool enabled, int64_t now_us);
+
+	//Подстройка адаптивного периода по результату опроса (после complete): changing - значение заметно изменилось
+	void	adapt(size_t index, bool changing);
+	void	boost();	//Все адаптивные обмены - на наименьший период (например, при смене состояния горелки)
+
+	//Обмен, который нужно выполнить сейчас, или -1, если ни один не вышел
+	int		next(int64_t now_us) const;
+
+	//Время до ближайшего выхода (0 - уже есть готовый)
+	int64_t	idle_for_us(int64_t now_us) const;
+
+	//Учёт выполненного обмена и выход следующего экземпляра
+	void	complete(size_t index, int64_t start_us, int64_t end_us);
+
+	//Загрузка шины планировщиком: доля занятого времени и расчётная потребность sum(cost/period)
+	double	utilization(int64_t now_us) const;
+	double	demand() const;
+
+	size_t			size() const				{return count;}
+	const Job&		job(size_t index) const		{return jobs[index];}
+	const Stats&	stats() const				{return stat;}
+};
+
+#endif	//OT_SCHEDULER_H
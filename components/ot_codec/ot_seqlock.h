@@ -0,0 +1,54 @@
+#ifndef OT_SEQLOCK_H
+#define OT_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//Снимок состояния одного писателя для читателей из других задач и ядер (seqlock).
+//Писатель не ждёт никогда. Читатель копирует значение и повторяет копию, если писатель за это время
+//его обновлял, поэтому всегда получает согласованный экземпляр. Нечётная последовательность - идёт запись.
+//Писатель должен иметь приоритет не ниже читателей на своём ядре, иначе читатель может крутиться,
+//пока вытесненный писатель не закончит запись
+template<typename T>
+class OT_Seqlock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "OT_Seqlock copies the value byte by byte");
+
+private:
+	std::atomic<uint32_t>	sequence{0};
+	T						value	= T();
+
+public:
+	//Только из задачи-писателя
+	void	write(const T& v)
+	{
+		uint32_t	seq	= sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(static_cast<void*>(&value), &v, sizeof(T));
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	//Согласованная копия. Возвращает поколение снимка (0 - ещё ни одной записи)
+	uint32_t	read(T* out) const
+	{
+		for(;;)
+		{
+			uint32_t	before	= sequence.load(std::memory_order_acquire);
+			if(before & 1)
+				continue;
+
+			memcpy(static_cast<void*>(out), &value, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(sequence.load(std::memory_order_relaxed) == before)
+				return before/2;
+		}
+	}
+
+	//Поколение без копирования: читатель может пропустить неизменившийся снимок
+	uint32_t	generation() const	{return sequence.load(std::memory_order_acquire)/2;}
+};
+
+#endif	//OT_SEQLOCK_H
@@ -0,0 +1,38 @@
+#ifndef OT_SYMBOL_H
+#define OT_SYMBOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#include "hal/rmt_types.h"
+using ot_symbol_t	= rmt_symbol_word_t;
+
+//Разбор вызывается из прерывания завершения приёма RMT, поэтому код размещается в IRAM
+#define OT_IRAM	IRAM_ATTR
+#else
+#define OT_IRAM
+
+//Копия rmt_symbol_word_t с той же раскладкой для сборки на хосте
+union ot_symbol_t
+{
+	struct {
+		uint16_t	duration0	:15;
+		uint16_t	level0		:1;
+		uint16_t	duration1	:15;
+		uint16_t	level1		:1;
+	};
+	uint32_t	val;
+};
+#endif
+
+static_assert(sizeof(ot_symbol_t) == sizeof(uint32_t), "ot_symbol_t must match rmt_symbol_word_t");
+
+//Слово символа RMT из полей (младшие 16 бит - первый уровень, старшие - второй)
+constexpr uint32_t	ot_symbol_val(uint16_t duration0, bool level0, uint16_t duration1, bool level1)
+{
+	return uint32_t(duration0 & 0x7fff) | (uint32_t(level0) << 15) | (uint32_t(duration1 & 0x7fff) << 16) | (uint32_t(level1) << 31);
+}
+
+#endif	//OT_SYMBOL_H
@@ -1,9 +1,12 @@
 #include <vector>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "esp_log.h"
 #include "sdkconfig.h"
 #include "driver/gpio.h"
 #include "json.hpp"
@@ -11,21 +14,40 @@ using json = nlohmann::json;
 
 #include "secure_config.h"
 #include "ot_boiler.h"
+#include "ot_gateway.h"
 #include "telegram.h"
 #include "mqtt.h"
 #include "tcp_server.h"
 #include "thermo.h"
 #include "room_thermostat.h"
+#include "settings_cache.h"
+#include "command_bus.h"
 
-// static const char*	TAG = "boiler_task";
+static const char*	TAG = "boiler_task";
 
-//Шина Opentherm
+//Шины Opentherm. Первая - ведущий котёл с термостатом и командами,
+//остальные котлы каскада опрашиваются в своих задачах параллельно с ней
 bool	OT_is_enabled	= true;
-constexpr	gpio_num_t	pin_ot_in			= GPIO_NUM_16;
-constexpr	gpio_num_t	pin_ot_out			= GPIO_NUM_4;
-constexpr	int			slaveID				= 4;
-constexpr	int64_t		mqtt_period			= 3600;			//Количество секунд между полной отправкой состояния в MQTT
+struct OT_BusConfig
+{
+	gpio_num_t	pin_in;
+	gpio_num_t	pin_out;
+	int			slaveID;
+	const char*	name;		//Подраздел топиков MQTT и раздел NVS ведомых котлов
+};
+constexpr	OT_BusConfig	ot_buses[]	= {
+	{GPIO_NUM_16,	GPIO_NUM_4,	4,	""},
+	// {GPIO_NUM_17,	GPIO_NUM_5,	4,	"boiler2"},	//Второй котёл каскада
+};
+constexpr	size_t		ot_bus_count		= sizeof(ot_buses)/sizeof(ot_buses[0]);
+
+//Шлюз между комнатным термостатом и ведущим котлом
+constexpr	bool		gateway_enabled		= false;
+constexpr	gpio_num_t	pin_gateway_in		= GPIO_NUM_18;
+constexpr	gpio_num_t	pin_gateway_out		= GPIO_NUM_19;
+static_assert(ot_bus_count + (gateway_enabled ? 1 : 0) <= 4, "ESP32 RMT has 8 channels, one RX/TX pair per bus");
 constexpr	int64_t		thermostat_period	= 60;	//Частота работы термостата
+constexpr	int64_t		idle_poll_ms		= 50;	//Наибольший сон без обменов, чтобы очереди команд не ждали
 
 const std::string	boiler_topic	= SecureConfig::boiler_topic;
 const std::string	boiler_OT_topic	= SecureConfig::boiler_OT_topic;
@@ -33,19 +55,123 @@ const std::string	boiler_command_topic(SecureConfig::boiler_command_topic);
 
 //Константный доступ для запросов статуса из других задач
 const OT_Boiler*	pBoiler			= nullptr;
-const json*			pControlStatus	= nullptr;
+OT_Gateway*			pGateway		= nullptr;
+static const OT_Boiler*	pCascade[ot_bus_count]	= {};
+
+//Режим управления меняется редко, поэтому копия для других задач просто под мьютексом
+static std::mutex	control_mutex;
+static json			control_status;
+static void	publish_control_status(const json& status)
+{
+	std::lock_guard<std::mutex>	lock(control_mutex);
+	control_status	= status;
+}
+
+json	control_json_status()
+{
+	std::lock_guard<std::mutex>	lock(control_mutex);
+	return control_status;
+}
+
+//Команды из топиков boiler_command_topic. Код команды - индекс в mqtt_command_names
+//Пределы те же, что у уставок OT_Boiler: значение вне них отбрасывается, а не обрезается при записи в NVS
+enum class MqttCommand_t: uint8_t{CH, DHW, SummerMode, ch_temp_zad, ch_temp_max, ch_mod_max, Reset_error, count};
+static const struct {const char* name; float min; float max;}	mqtt_commands[]	= {
+	{"CH",			0,	1},
+	{"DHW",			0,	1},
+	{"SummerMode",	0,	1},
+	{"ch_temp_zad",	0,	100},
+	{"ch_temp_max",	0,	127},
+	{"ch_mod_max",	0,	100},
+	{"Reset_error",	0,	1}
+};
+static_assert(sizeof(mqtt_commands)/sizeof(mqtt_commands[0]) == static_cast<size_t>(MqttCommand_t::count), "MQTT commands");
+
+//Команда MQTT уходит в шину команд как set_boiler_data или BLOR от TCP и Telegram: тот же учёт задержки,
+//та же запись уставок. Ответ не нужен, состояние вернётся в топики control/* и уставок.
+//Запрос берётся из пула шины со значением без json: в задаче клиента MQTT нет выделений памяти
+static bool	mqtt_command(uint8_t command, float value)
+{
+	if(command >= static_cast<uint8_t>(MqttCommand_t::count))
+		return false;
+	if(value < mqtt_commands[command].min || value > mqtt_commands[command].max){
+		ESP_LOGW(TAG, "Команда MQTT %s вне пределов: %g", mqtt_commands[command].name, value);
+		return false;
+	}
+
+	BoilerCommand_t		type	= BoilerCommand_t::set_boiler_data;
+	CommandBus::Value	param;
+	switch(static_cast<MqttCommand_t>(command))
+	{
+		case MqttCommand_t::CH:				param	= {"centralHeating",	value != 0,				true};	break;
+		case MqttCommand_t::DHW:			param	= {"dhw",				value != 0,				true};	break;
+		case MqttCommand_t::SummerMode:		param	= {"SummerMode",		value != 0,				true};	break;
+		case MqttCommand_t::ch_temp_zad:	param	= {"ch_temp_zad",		int32_t(roundf(value)),	false};	break;
+		case MqttCommand_t::ch_temp_max:	param	= {"ch_temp_max",		int32_t(roundf(value)),	false};	break;
+		case MqttCommand_t::ch_mod_max:		param	= {"ch_mod_max",		int32_t(roundf(value)),	false};	break;
+		case MqttCommand_t::Reset_error:{
+			if(value == 0)
+				return true;
+			type	= BoilerCommand_t::BLOR;
+		}break;
+		default:
+			return false;
+	}
+
+	return command_bus.submit_value(type, CommandSource_t::mqtt, param) != 0;
+}
+
+//Заданная температура теплоносителя ведущего котла для котлов каскада (0 - не задана)
+static std::atomic<float>	cascade_ch_temp_zad{0};
+
+static void	cascade_task(void* arg);
+
+json	cascade_json_status()
+{
+	json	j	= json::array();
+	for(size_t i = 1; i < ot_bus_count; i++)
+	{
+		if(pCascade[i])	j.push_back({{"name", ot_buses[i].name}, {"status", pCascade[i]->json_status()}});
+		else			j.push_back({{"name", ot_buses[i].name}, {"status", nullptr}});
+	}
+	return j;
+}
+
+const OT_Boiler*	ot_bus_boiler(size_t bus)
+{
+	if(bus == 0)				return pBoiler;
+	if(bus < ot_bus_count)		return pCascade[bus];
+	return nullptr;
+}
 
 void	boiler_task(void* unused)
 {
 	enum class ControlMode_t: uint8_t {ch_temp, PID_thermostat};
 	ControlMode_t	controlMode	= ControlMode_t::ch_temp;	//По умолчанию - теплоноситель
 
-	OT_Boiler	boiler(pin_ot_in, pin_ot_out, boiler_topic, boiler_OT_topic, slaveID);
+	//Котёл со снимком состояния и статистикой занимает больше десятка килобайт: в куче, а не на стеке задачи.
+	//Задача не завершается, поэтому объект не освобождается
+	OT_Boiler&	boiler	= *new OT_Boiler(ot_buses[0].pin_in, ot_buses[0].pin_out, boiler_topic, boiler_OT_topic, ot_buses[0].slaveID);
 	pBoiler	= &boiler;
 
+	//Шлюз пересылает запросы комнатного термостата через шину ведущего котла
+	if(gateway_enabled)
+	{
+		pGateway	= new OT_Gateway(pin_gateway_in, pin_gateway_out, &boiler, boiler_OT_topic + "gateway/");
+		pGateway->start(4, 1);
+	}
+
+	//Котлы каскада работают на своих каналах RMT, их обмены идут одновременно с ведущим
+	for(size_t i = 1; i < ot_bus_count; i++)
+		xTaskCreatePinnedToCore(cascade_task, ot_buses[i].name, 8192, (void*)i, 3, nullptr, 1);
+
 	//Формирование статуса управления
 	json	jsonStatus;
-	pControlStatus	= &jsonStatus;
+	bool	control_changed	= true;	//jsonStatus меняется только термостатом и командами
+
+	//Отладочные топики команд
+	const mqtt_topic_t	debug_request_topic		= mqtt_topic(SecureConfig::boiler_debug_topic, "request");
+	const mqtt_topic_t	debug_response_topic	= mqtt_topic(SecureConfig::boiler_debug_topic, "response");
 
 	//Перевод котла в режим Slave
 	boiler.read_status();
@@ -56,50 +182,37 @@ void	boiler_task(void* unused)
 	float	ch_temp_zad	= 50;
 
 	//Чтение прошлых настроек
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler_task", NVS_READONLY, &nvs_settings) == ESP_OK)
-	{
-		uint8_t	val;
-		if(nvs_get_u8(nvs_settings, "controlMode", &val) == ESP_OK){
-			switch(val)
-			{
-				case 1:	{
-					controlMode	= ControlMode_t::PID_thermostat;
-					jsonStatus["controlMode"]	= "PID_thermostat";
-				}break;
-
-				default: {
-					controlMode	= ControlMode_t::ch_temp;
-					jsonStatus["controlMode"]	= "Теплоноситель";
-					if(nvs_get_u8(nvs_settings, "ch_temp_zad", &val) == ESP_OK){
-						ch_temp_zad	= val;
-						jsonStatus["ch_temp_zad"]	= ch_temp_zad;
-					}
+	uint8_t	val;
+	if(settings_cache.get_u8("boiler_task", "controlMode", &val)){
+		switch(val)
+		{
+			case 1:	{
+				controlMode	= ControlMode_t::PID_thermostat;
+				jsonStatus["controlMode"]	= "PID_thermostat";
+			}break;
+
+			default: {
+				controlMode	= ControlMode_t::ch_temp;
+				jsonStatus["controlMode"]	= "Теплоноситель";
+				if(settings_cache.get_u8("boiler_task", "ch_temp_zad", &val)){
+					ch_temp_zad	= val;
+					jsonStatus["ch_temp_zad"]	= ch_temp_zad;
 				}
 			}
 		}
-
-		nvs_close(nvs_settings);
 	}
 
 	//Запрос статуса, чтобы не ждать 10 секунд
 	boiler.read_status();
 
-	//Запрос топиков управления котлом
-	mqtt_topic_list.push_back(boiler_command_topic + "CH");
-	mqtt_topic_list.push_back(boiler_command_topic + "DHW");
-	mqtt_topic_list.push_back(boiler_command_topic + "SummerMode");
-	mqtt_topic_list.push_back(boiler_command_topic + "ch_temp_zad");
-	mqtt_topic_list.push_back(boiler_command_topic + "ch_temp_max");
-	mqtt_topic_list.push_back(boiler_command_topic + "ch_mod_max");
-	mqtt_topic_list.push_back(boiler_command_topic + "Reset_error");
+	//Подписка на топики управления котлом
+	for(size_t i = 0; i < static_cast<size_t>(MqttCommand_t::count); i++)
+		mqtt_subscribe(boiler_command_topic + mqtt_commands[i].name, uint8_t(i), mqtt_command);
 
 	//Комнатные термостаты
 	std::vector<RoomThermostat*>	rooms;
 
 	//Время от прошлого запроса параметров котла
-	int64_t	periodical_time			= esp_timer_get_time();
-	int64_t	mqtt_periodical_time	= esp_timer_get_time();
 	int64_t	thermostat_time			= esp_timer_get_time();
 
 	/////////////////////////////////////////////////////////////////////
@@ -113,41 +226,11 @@ void	boiler_task(void* unused)
 			continue;
 		}
 
-		// //Повтор сообщений с ошибкой обмена
-		// size_t	remain_msg	= boiler.repeat_old_messages();
-		// if(remain_msg > 50)
-		// {
-		// 	//Что-то слишком много накопилось ошибочных сообщений
-		// 	toTelegram*	send	= new toTelegram;
-		// 	send->chat_id		= SecureConfig::telegram_user_id;
-		// 	send->reply_id		= 0;
-		// 	send->text			= "В очереди накопилось более 50 сообщений";
-		// 	xQueueGenericSend(to_telegram_queue, &send, 10, queueSEND_TO_BACK);
-
-		// 	boiler.clear_old_message();
-		// }
-		boiler.clear_old_message();
-
-		//Ежесекундный опрос состояния
-		boiler.read_status();
-		boiler.read_modulation();
-
-		//Периодический опрос датчиков котла
-		if(esp_timer_get_time() - periodical_time > 10*1000000)
-		{
-			periodical_time	= esp_timer_get_time();
-
-			boiler.read_flame_current();
-			boiler.read_ch_temp();
-			boiler.read_dhw_temp();
-		}
-
-		//Периодическая отправка всего состояния в MQTT
-		if(esp_timer_get_time() - mqtt_periodical_time > mqtt_period*1000000)
-		{
-			mqtt_periodical_time	= esp_timer_get_time();
-			boiler.send_all_mqtt();
-		}
+		//Один обмен по расписанию за проход: статус не реже 1 Гц, датчики по своим периодам.
+		//Свободные окна шины занимают повторы неудачных команд и обход ID, а если делать нечего, задача спит.
+		//Команда из шины команд будит задачу сразу
+		if(!boiler.run_scheduled() && !boiler.run_repeat() && !boiler.run_sweep())
+			command_bus.wait(pdMS_TO_TICKS(std::min<int64_t>(boiler.scheduled_in_us()/1000, idle_poll_ms)) + 1);
 
 		//Термостат
 		if(esp_timer_get_time() - thermostat_time > thermostat_period*1000000)
@@ -158,6 +241,7 @@ void	boiler_task(void* unused)
 				case ControlMode_t::ch_temp:
 				{
 					boiler.set_ch_temp_zad(ch_temp_zad, true);
+					cascade_ch_temp_zad	= ch_temp_zad;
 				}break;
 
 				case ControlMode_t::PID_thermostat:
@@ -177,6 +261,7 @@ void	boiler_task(void* unused)
 					//Управление теплоносителем
 					if(ch_temp_zad != 0){
 						boiler.set_ch_temp_zad(ch_temp_zad, true);
+						cascade_ch_temp_zad	= ch_temp_zad;
 						// boiler.set_ch_mod_max(ch_mod_max, true);
 					}
 				}break;
@@ -184,131 +269,79 @@ void	boiler_task(void* unused)
 				default:
 					break;
 			}
+			control_changed	= true;
 		}
 
-		//Разбор сообщений из Telegramm
-		fromTelegram_ot*	msg;
-		while(xQueueReceive(from_telegram_ot_queue, &msg, 0) == pdPASS)
+		//Команды от Telegram, TCP сервера и MQTT. Ответ уходит обработчику запроса
+		while(CommandBus::Request* cmd = command_bus.receive())
 		{
-			//Подготовка ответного сообщения
-			toTelegram*	send	= new toTelegram;
-			send->chat_id		= msg->chat_id;
-			send->reply_id		= msg->reply_id;
-
-			switch(msg->type)
+			//Значение из пула шины становится обычным параметром: дальше команда не отличается от TCP и Telegram
+			if(cmd->value.key)
 			{
-				case telegram_ot_message_t::set_boiler_data:
-				{
-					std::string	text	= msg->text.substr(strlen("/set_boiler_data"));
-					json	j	= json::parse(text, nullptr, false);
-					if(j.is_discarded())
-					{
-						send->text	= "json::parse error\n" + text;
-						xQueueGenericSend(to_telegram_queue, &send, 10, queueSEND_TO_BACK);
-						break;
-					}
-					else
-					{
-						json	resp	= boiler.set_boiler_data(j);
-						send->text		= resp.dump(4);
-
-						//Отключение термостата котла
-						controlMode		= ControlMode_t::ch_temp;
-						jsonStatus	= {
-							{"controlMode", "Теплоноситель"},
-							{"params", j}
-						};
-
-						xQueueGenericSend(to_telegram_queue, &send, 10, queueSEND_TO_BACK);
-					}
-				}break;
-
-				case telegram_ot_message_t::BLOR:
-				{
-					if(boiler.BLOR())	send->text	= "BLOR done";
-					else				send->text	= "BLOR fail";
-
-					xQueueGenericSend(to_telegram_queue, &send, 10, queueSEND_TO_BACK);
-				}break;
-
-				default:
-				{
-					//Сообщение оказалось лишним
-					delete send;
-					send	= nullptr;
-				}
+				if(cmd->value.flag)	cmd->params[cmd->value.key]	= cmd->value.number != 0;
+				else				cmd->params[cmd->value.key]	= cmd->value.number;
 			}
-
-			if(msg)	delete msg;
-		}
-
-		//Разбор сообщений от TCP сервера
-		fromTCP_to_ot*	tcp_msg	= nullptr;
-		while(xQueueReceive(from_TCP_ot_queue, &tcp_msg, 0) == pdPASS)
-		{
-			if(mqtt_client) esp_mqtt_client_publish(mqtt_client, (std::string(SecureConfig::boiler_debug_topic) + "request").c_str(), tcp_msg->params.dump().c_str(), 0, 0, 0);
-			//Подготовка ответа
-			toTCP_from_ot*	answer	= new toTCP_from_ot;
-			switch(tcp_msg->type)
+			if(mqtt_client) mqtt_publish(debug_request_topic, cmd->params.dump().c_str());
+			json	response;
+			switch(cmd->type)
 			{
-				case TCP_message_t::BLOR:{
+				case BoilerCommand_t::BLOR:{
 					bool	res	= boiler.BLOR();
-					answer->response	= {{"BLOR", (res ? "done" : "fail")}};
-					xQueueGenericSend(to_TCP_ot_queue, &answer, 10, queueSEND_TO_FRONT);
+					response	= {{"BLOR", (res ? "done" : "fail")}};
 				}break;
 
-				case TCP_message_t::set_boiler_data:{
-					answer->response	= boiler.set_boiler_data(tcp_msg->params);
-
-					//Запоминание заданной температуры
-					if(tcp_msg->params.contains("ch_temp_zad") && tcp_msg->params.at("ch_temp_zad").is_number_integer()){
-						int	ch_temp_zad	= tcp_msg->params.at("ch_temp_zad").get<int>();
-						nvs_handle_t	nvs_settings;
-						if(nvs_open("boiler_task", NVS_READONLY, &nvs_settings) == ESP_OK){
-							nvs_set_u8(nvs_settings, "ch_temp_zad", static_cast<uint8_t>(ch_temp_zad));
-							nvs_commit(nvs_settings);
-							nvs_close(nvs_settings);
-						}
+				case BoilerCommand_t::set_boiler_data:{
+					response	= boiler.set_boiler_data(cmd->params);
+
+					//Запоминание заданной температуры в тех же пределах, что и при записи в котёл.
+					//Она же остаётся уставкой термостата в режиме теплоносителя и котлов каскада
+					if(cmd->params.contains("ch_temp_zad") && cmd->params.at("ch_temp_zad").is_number_integer()){
+						ch_temp_zad	= std::clamp(cmd->params.at("ch_temp_zad").get<int>(), 0, 100);
+						cascade_ch_temp_zad	= ch_temp_zad;
+						settings_cache.set_u8("boiler_task", "ch_temp_zad", static_cast<uint8_t>(ch_temp_zad));
 					}
 
 					//Отключение термостата котла
 					controlMode			= ControlMode_t::ch_temp;
 					jsonStatus	= {
 						{"controlMode", "Теплоноситель"},
-						{"params", tcp_msg->params}
+						{"params", cmd->params}
 					};
 
-					xQueueGenericSend(to_TCP_ot_queue, &answer, 10, queueSEND_TO_FRONT);
 				}break;
 
-				case TCP_message_t::test_ot_command:{
-					answer->response	= boiler.test_ot_command(tcp_msg->params);
-					xQueueGenericSend(to_TCP_ot_queue, &answer, 10, queueSEND_TO_FRONT);
+				case BoilerCommand_t::test_ot_command:{
+					response	= boiler.test_ot_command(cmd->params);
+				}break;
+
+				case BoilerCommand_t::capability_sweep:{
+					boiler.start_sweep();
+					response	= "started";
 				}break;
 
-				case TCP_message_t::PID_thermostat:{
+				case BoilerCommand_t::PID_thermostat:{
 					//Проверка наличия всех полей
-					if(!tcp_msg->params.contains("room_name") ||
-						!tcp_msg->params.contains("radiator_name") ||
-						!tcp_msg->params.contains("room_temp_zad") ||
-						!tcp_msg->params.contains("dhw_temp_zad") ||
-						!tcp_msg->params.contains("PID") ||
-						!tcp_msg->params.contains("room_mod_max"))				answer->response	= {{"fail", "not all params present"}};
+					if(!cmd->params.contains("room_name") ||
+						!cmd->params.contains("radiator_name") ||
+						!cmd->params.contains("room_temp_zad") ||
+						!cmd->params.contains("dhw_temp_zad") ||
+						!cmd->params.contains("PID") ||
+						!cmd->params.contains("room_mod_max"))				response	= {{"fail", "not all params present"}};
 					//Проверка типов всех полей
-					else if(!tcp_msg->params.at("room_name").is_string() ||
-							!tcp_msg->params.at("radiator_name").is_string() ||
-							!tcp_msg->params.at("room_temp_zad").is_number() ||
-							!tcp_msg->params.at("dhw_temp_zad").is_number() ||
-							!tcp_msg->params.at("PID").is_object() ||
-							!tcp_msg->params.at("room_mod_max").is_number())	answer->response	= {{"fail", "params types incorrect"}};
+					else if(!cmd->params.at("room_name").is_string() ||
+							!cmd->params.at("radiator_name").is_string() ||
+							!cmd->params.at("room_temp_zad").is_number() ||
+							!cmd->params.at("dhw_temp_zad").is_number() ||
+							!cmd->params.at("PID").is_object() ||
+							!cmd->params.at("room_mod_max").is_number())	response	= {{"fail", "params types incorrect"}};
 					//Все параметры в норме
 					else{
-						std::string	room_name	= tcp_msg->params.at("room_name").get<std::string>();
-						std::string	rad_name	= tcp_msg->params.at("radiator_name").get<std::string>();
-						float	room_temp_zad	= tcp_msg->params.at("room_temp_zad").get<float>();
-						float	dhw_temp_zad	= tcp_msg->params.at("dhw_temp_zad").get<float>();
-						float	room_mod_max	= tcp_msg->params.at("room_mod_max").get<float>();
-						json	PID_params		= tcp_msg->params.at("PID");
+						std::string	room_name	= cmd->params.at("room_name").get<std::string>();
+						std::string	rad_name	= cmd->params.at("radiator_name").get<std::string>();
+						float	room_temp_zad	= cmd->params.at("room_temp_zad").get<float>();
+						float	dhw_temp_zad	= cmd->params.at("dhw_temp_zad").get<float>();
+						float	room_mod_max	= cmd->params.at("room_mod_max").get<float>();
+						json	PID_params		= cmd->params.at("PID");
 
 						//Установка заданной температуры горячей воды
 						boiler.set_dhw_temp_zad(dhw_temp_zad);
@@ -365,23 +398,17 @@ void	boiler_task(void* unused)
 								}}
 							};
 
-							nvs_handle_t	nvs_settings;
-							if(nvs_open("boiler_task", NVS_READONLY, &nvs_settings) == ESP_OK){
-								nvs_set_u8(nvs_settings, "controlMode", static_cast<uint8_t>(controlMode));
-								nvs_set_u16(nvs_settings, "room_temp_zad", uint16_t(room_temp_zad*256));
+							settings_cache.set_u8("boiler_task", "controlMode", static_cast<uint8_t>(controlMode));
+							settings_cache.set_u16("boiler_task", "room_temp_zad", uint16_t(room_temp_zad*256));
 
-								nvs_commit(nvs_settings);
-								nvs_close(nvs_settings);
-							}
-
-							answer->response	= {
+							response	= {
 								{"status", "ok"},
 								{"room_index", room_index},
 								{"rad_index", rad_index}
 							};
 						}
 						else{
-							answer->response	= {
+							response	= {
 								{"fail", "names not found"},
 								{"name", room_name},
 								{"radiator", rad_name}
@@ -389,18 +416,65 @@ void	boiler_task(void* unused)
 						}
 					}
 
-					xQueueGenericSend(to_TCP_ot_queue, &answer, 10, queueSEND_TO_FRONT);
 				}break;
 
 				default:
-					delete answer;
+					response	= {{"fail", "unknown command"}};
 			}
-			if(mqtt_client) esp_mqtt_client_publish(mqtt_client, (std::string(SecureConfig::boiler_debug_topic) + "response").c_str(), answer->response.dump().c_str(), 0, 0, 0);
+			if(mqtt_client) mqtt_publish(debug_response_topic, response.dump().c_str());
+
+			command_bus.complete(cmd, response);
+			control_changed	= true;
+		}
+
+		//Снимок состояния для TCP, Telegram и логгера после обменов этого прохода
+		boiler.publish();
+		if(control_changed){
+			control_changed	= false;
+			publish_control_status(jsonStatus);
+		}
+	}
+}
+
+//Опрос котла каскада на своей шине с заданной температурой ведущего котла
+static void	cascade_task(void* arg)
+{
+	const size_t		index	= reinterpret_cast<size_t>(arg);
+	const OT_BusConfig&	bus		= ot_buses[index];
+
+	//Как и ведущий котёл - в куче: на стеке задачи каскада OT_Boiler (~14 КБ) не помещается
+	OT_Boiler&	boiler	= *new OT_Boiler(bus.pin_in, bus.pin_out, boiler_topic + bus.name + "/", boiler_OT_topic + bus.name + "/", bus.slaveID, bus.name);
+	pCascade[index]	= &boiler;
 
-			if(tcp_msg)	delete tcp_msg;
+	//Перевод котла в режим Slave
+	boiler.read_status();
+	boiler.read_slaveConfig();
+	boiler.set_slave();
+
+	int64_t	thermostat_time	= esp_timer_get_time();
+	for(;;)
+	{
+		//Отключение обмена на время прошивки
+		if(!OT_is_enabled)
+		{
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+
+		//Один обмен по расписанию за проход: статус не реже 1 Гц, датчики по своим периодам.
+		//Свободные окна шины занимают повторы неудачных команд и обход ID, а если делать нечего, задача спит
+		//до следующего обмена по расписанию. Команд у котла каскада нет, уставку он берёт раз в thermostat_period
+		if(!boiler.run_scheduled() && !boiler.run_repeat() && !boiler.run_sweep())
+			vTaskDelay(pdMS_TO_TICKS(std::min<int64_t>(boiler.scheduled_in_us()/1000, idle_poll_ms)) + 1);
+
+		//Температура теплоносителя повторяет ведущий котёл
+		float	ch_temp_zad	= cascade_ch_temp_zad;
+		if(ch_temp_zad != 0 && esp_timer_get_time() - thermostat_time > thermostat_period*1000000)
+		{
+			thermostat_time	= esp_timer_get_time();
+			boiler.set_ch_temp_zad(ch_temp_zad, true);
 		}
 
-		//Задержка выполняется в process_OT, поэтому здеь не нужна
-		// vTaskDelay(pdMS_TO_TICKS(1000));
+		boiler.publish();
 	}
 }
@@ -2,10 +2,14 @@
 #define BOILER_TASK_H
 
 #include "ot_boiler.h"
+#include "ot_gateway.h"
 
 extern bool	OT_is_enabled;
 extern const OT_Boiler*	pBoiler;
-extern const json*		pControlStatus;
+extern OT_Gateway*		pGateway;		//nullptr, если шлюз отключён
 void	boiler_task(void* unused);
+json	control_json_status();	//Режим управления ведущим котлом (копия)
+json	cascade_json_status();	//Состояние котлов каскада на дополнительных шинах
+const OT_Boiler*	ot_bus_boiler(size_t bus);	//Котёл на шине bus (0 - ведущий), nullptr, если его нет
 
 #endif	//BOILER_TASK_H
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include <future>
+#include <memory>
+#include <chrono>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "command_bus.h"
+
+static const char*	TAG = "command_bus";
+
+CommandBus	command_bus;
+
+void	CommandBus::init(size_t depth)
+{
+	queue	= xQueueGenericCreate(depth, sizeof(Request*), queueQUEUE_TYPE_BASE);
+
+	std::lock_guard<std::mutex>	lock(pool_mutex);
+	for(size_t i = 0; i < pool_size; i++)
+	{
+		pool[i].pooled	= true;
+		pool_free[i]	= &pool[i];
+	}
+	pool_count	= pool_size;
+}
+
+uint32_t	CommandBus::enqueue(Request* request, TickType_t timeout)
+{
+	request->id			= next_id++;
+	request->submit_us	= esp_timer_get_time();
+
+	bool	queued	= queue && xQueueGenericSend(queue, &request, timeout, queueSEND_TO_BACK) == pdPASS;
+	{
+		std::lock_guard<std::mutex>	lock(stats_mutex);
+		Stats&	stat	= stats[static_cast<size_t>(request->type)];
+		if(queued)	stat.submitted++;
+		else		stat.rejected++;
+	}
+	if(!queued)
+	{
+		ESP_LOGE(TAG, "Очередь команд переполнена: %s от %s", to_string(request->type), to_string(request->source));
+		release(request);
+		return 0;
+	}
+
+	return request->id;
+}
+
+void	CommandBus::release(Request* request)
+{
+	if(!request->pooled)
+	{
+		delete request;
+		return;
+	}
+
+	//Память params и done освобождается здесь, в задаче котла, а не при следующей постановке
+	request->params	= nullptr;
+	request->done	= nullptr;
+	request->value	= Value();
+	std::lock_guard<std::mutex>	lock(pool_mutex);
+	pool_free[pool_count++]	= request;
+}
+
+uint32_t	CommandBus::submit(BoilerCommand_t type, CommandSource_t source, const json& params, Callback done)
+{
+	if(type >= BoilerCommand_t::count)
+		return 0;
+
+	Request*	request		= new Request;
+	request->type		= type;
+	request->source		= source;
+	request->params		= params;
+	request->done		= std::move(done);
+	return enqueue(request, pdMS_TO_TICKS(10));
+}
+
+uint32_t	CommandBus::submit_value(BoilerCommand_t type, CommandSource_t source, const Value& value)
+{
+	if(type >= BoilerCommand_t::count)
+		return 0;
+
+	Request*	request	= nullptr;
+	{
+		std::lock_guard<std::mutex>	lock(pool_mutex);
+		if(pool_count)
+			request	= pool_free[--pool_count];
+	}
+	if(!request)
+	{
+		std::lock_guard<std::mutex>	lock(stats_mutex);
+		stats[static_cast<size_t>(type)].rejected++;
+		ESP_LOGW(TAG, "Пул команд исчерпан: %s от %s", to_string(type), to_string(source));
+		return 0;
+	}
+
+	request->type	= type;
+	request->source	= source;
+	request->value	= value;
+	return enqueue(request, 0);
+}
+
+bool	CommandBus::call(BoilerCommand_t type, CommandSource_t source, const json& params, json* response, uint32_t timeout_ms)
+{
+	//Обещание живёт в обработчике: опоздавший ответ выполняется без висячих ссылок и просто теряется
+	std::shared_ptr<std::promise<json>>	promise	= std::make_shared<std::promise<json>>();
+	std::future<json>	future	= promise->get_future();
+	if(!submit(type, source, params, [promise](uint32_t, const json& r){promise->set_value(r);}))
+		return false;
+
+	if(future.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready)
+	{
+		std::lock_guard<std::mutex>	lock(stats_mutex);
+		stats[static_cast<size_t>(type)].timeouts++;
+		return false;
+	}
+
+	*response	= future.get();
+	return true;
+}
+
+CommandBus::Request*	CommandBus::receive()
+{
+	Request*	request	= nullptr;
+	if(!queue || xQueueReceive(queue, &request, 0) != pdPASS)
+		return nullptr;
+
+	request->start_us	= esp_timer_get_time();
+	return request;
+}
+
+bool	CommandBus::wait(TickType_t timeout)
+{
+	Request*	request;
+	return queue && xQueuePeek(queue, &request, timeout) == pdPASS;
+}
+
+void	CommandBus::complete(Request* request, const json& response)
+{
+	int64_t	now	= esp_timer_get_time();
+	{
+		std::lock_guard<std::mutex>	lock(stats_mutex);
+		Stats&	stat	= stats[static_cast<size_t>(request->type)];
+		stat.completed++;
+		stat.wait_us	+= request->start_us - request->submit_us;
+		stat.exec_us	+= now - request->start_us;
+		stat.last_us	= now - request->submit_us;
+		if(stat.last_us > stat.max_us)
+			stat.max_us	= stat.last_us;
+	}
+
+	if(request->done)
+		request->done(request->id, response);
+	release(request);
+}
+
+json	CommandBus::json_stats() const
+{
+	std::lock_guard<std::mutex>	lock(stats_mutex);
+	json	res	= json::object();
+	for(size_t i = 0; i < type_count; i++)
+	{
+		const Stats&	stat	= stats[i];
+		if(!stat.submitted && !stat.rejected)
+			continue;
+
+		res[to_string(static_cast<BoilerCommand_t>(i))]	= {
+			{"submitted", stat.submitted},
+			{"completed", stat.completed},
+			{"rejected", stat.rejected},
+			{"timeouts", stat.timeouts},
+			{"wait_ms", stat.completed ? stat.wait_us*0.001/stat.completed : 0.},
+			{"exec_ms", stat.completed ? stat.exec_us*0.001/stat.completed : 0.},
+			{"last_ms", stat.last_us*0.001},
+			{"max_ms", stat.max_us*0.001}
+		};
+	}
+	return res;
+}
+
+const char*	CommandBus::to_string(BoilerCommand_t type)
+{
+	switch(type)
+	{
+		case BoilerCommand_t::set_boiler_data:	return "set_boiler_data";
+		case BoilerCommand_t::BLOR:				return "BLOR";
+		case BoilerCommand_t::test_ot_command:	return "test_ot_command";
+		case BoilerCommand_t::PID_thermostat:	return "PID_thermostat";
+		case BoilerCommand_t::capability_sweep:	return "capability_sweep";
+		default:								return "unknown";
+	}
+}
+
+const char*	CommandBus::to_string(CommandSource_t source)
+{
+	switch(source)
+	{
+		case CommandSource_t::tcp:			return "tcp";
+		case CommandSource_t::telegram:		return "telegram";
+		case CommandSource_t::mqtt:			return "mqtt";
+		default:							return "unknown";
+	}
+}
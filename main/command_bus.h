@@ -0,0 +1,97 @@
+#ifndef COMMAND_BUS_H
+#define COMMAND_BUS_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+//Команды ведущему котлу. Выполняет их задача котла, отправляют Telegram, TCP сервер и MQTT
+enum class BoilerCommand_t: uint8_t{set_boiler_data, BLOR, test_ot_command, PID_thermostat, capability_sweep, count};
+enum class CommandSource_t: uint8_t{tcp, telegram, mqtt, count};
+
+//Шина команд с номерами запросов. У каждого запроса свой обработчик завершения,
+//поэтому ответ не может достаться другому клиенту, а несколько запросов могут ждать одновременно
+//и завершаться в любом порядке. Время ожидания и выполнения учитывается по типам команд
+class CommandBus
+{
+public:
+	//Вызывается в задаче котла: только передача ответа, без долгой работы
+	using Callback	= std::function<void(uint32_t id, const json& response)>;
+
+	//Одно значение без json: ключ - строковая константа, число или флаг. Задача котла
+	//перекладывает его в params перед выполнением, источник не выделяет память
+	struct Value
+	{
+		const char*	key		= nullptr;
+		int32_t		number	= 0;
+		bool		flag	= false;	//Значение логическое: number != 0
+	};
+
+	struct Request
+	{
+		uint32_t		id			= 0;
+		BoilerCommand_t	type		= BoilerCommand_t::count;
+		CommandSource_t	source		= CommandSource_t::count;
+		json			params;
+		Value			value;
+		Callback		done;
+		int64_t			submit_us	= 0;
+		int64_t			start_us	= 0;	//Задача котла взяла запрос
+		bool			pooled		= false;	//Из пула submit_value, возвращается в него в complete
+	};
+
+	struct Stats
+	{
+		uint32_t	submitted	= 0;
+		uint32_t	completed	= 0;
+		uint32_t	rejected	= 0;	//Очередь переполнена
+		uint32_t	timeouts	= 0;	//Синхронный вызов не дождался ответа
+		int64_t		wait_us		= 0;	//Суммарное ожидание в очереди
+		int64_t		exec_us		= 0;	//Суммарное выполнение
+		int64_t		last_us		= 0;	//Полное время последней команды
+		int64_t		max_us		= 0;
+	};
+
+private:
+	static constexpr size_t	type_count	= static_cast<size_t>(BoilerCommand_t::count);
+	QueueHandle_t			queue		= nullptr;
+	std::atomic<uint32_t>	next_id{1};
+	mutable std::mutex		stats_mutex;
+	Stats					stats[type_count];
+
+	//Запросы для submit_value выделены заранее: клиент MQTT отправляет команды без new и json
+	static constexpr size_t	pool_size	= 8;
+	Request					pool[pool_size];
+	Request*				pool_free[pool_size];
+	size_t					pool_count	= 0;
+	std::mutex				pool_mutex;
+
+	uint32_t	enqueue(Request* request, TickType_t timeout);
+	void		release(Request* request);
+
+public:
+	void	init(size_t depth);
+
+	//Постановка в очередь. Возвращает номер запроса или 0, если очередь переполнена
+	uint32_t	submit(BoilerCommand_t type, CommandSource_t source, const json& params, Callback done);
+
+	//Постановка одного значения из пула без ожидания места в очереди и без ответа. 0 - пул или очередь заняты
+	uint32_t	submit_value(BoilerCommand_t type, CommandSource_t source, const Value& value);
+
+	//Постановка и ожидание ответа. false - ответа нет за timeout_ms (он придёт позже и будет отброшен)
+	bool		call(BoilerCommand_t type, CommandSource_t source, const json& params, json* response, uint32_t timeout_ms = 5000);
+
+	//Для задачи котла: следующий запрос без ожидания или nullptr. Каждый полученный запрос - ровно один complete
+	Request*	receive();
+	//Для задачи котла: сон до прихода запроса, не дольше timeout. Запрос остаётся в очереди
+	bool		wait(TickType_t timeout);
+	void		complete(Request* request, const json& response);
+
+	json	json_stats() const;
+	static const char*	to_string(BoilerCommand_t type);
+	static const char*	to_string(CommandSource_t source);
+};
+
+extern CommandBus	command_bus;
+
+#endif	//COMMAND_BUS_H
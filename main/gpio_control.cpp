@@ -29,6 +29,7 @@ using json = nlohmann::json;
 #include "boiler_task.h"
 #include "mqtt.h"
 #include "tcp_server.h"
+#include "settings_cache.h"
 
 static const char*	TAG = "gpio_control";
 
@@ -90,18 +91,12 @@ void	gpio_control(void* unused)
 	gpio_set_level(pin_heater_2, 0);
 
 	//Чтение настроек программы термостата
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("thermostat", NVS_READONLY, &nvs_settings) == ESP_OK)
-	{
-		int16_t	val;
-		uint8_t	index;
-		if(nvs_get_i16(nvs_settings, "floor_1_temp_zad", &val) == ESP_OK)		floor_1_temp_zad		= 0.01*val;
-		if(nvs_get_i16(nvs_settings, "floor_2_temp_zad", &val) == ESP_OK)		floor_2_temp_zad		= 0.01*val;
-		if(nvs_get_i16(nvs_settings, "temp_zad_dt", &val) == ESP_OK)			temp_zad_dt				= 0.01*val;
-		if(nvs_get_u8(nvs_settings, "prog_index", &index) == ESP_OK)			prog_index				= index;
-
-		nvs_close(nvs_settings);
-	}
+	int16_t	val;
+	uint8_t	index;
+	if(settings_cache.get_i16("thermostat", "floor_1_temp_zad", &val))	floor_1_temp_zad		= 0.01*val;
+	if(settings_cache.get_i16("thermostat", "floor_2_temp_zad", &val))	floor_2_temp_zad		= 0.01*val;
+	if(settings_cache.get_i16("thermostat", "temp_zad_dt", &val))		temp_zad_dt				= 0.01*val;
+	if(settings_cache.get_u8("thermostat", "prog_index", &index))		prog_index				= index;
 
 	/////////////////////////////////////////////////////////////////////
 	//  Главный цикл
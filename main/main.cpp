@@ -21,15 +21,20 @@ static const char*	TAG = "main";
 #include "boiler_task.h"
 #include "mqtt.h"
 #include "tcp_server.h"
+#include "settings_cache.h"
+#include "command_bus.h"
+#include "telemetry.h"
+#include "mqtt_outbox.h"
 
 void	wifi_init_sta(const char* ssid, const char* pass);
 QueueHandle_t	from_telegram_gpio_queue	= nullptr;
-QueueHandle_t	from_telegram_ot_queue		= nullptr;
 QueueHandle_t	to_telegram_queue			= nullptr;
-QueueHandle_t	from_mqtt_queue				= nullptr;
 
-QueueHandle_t	from_TCP_ot_queue			= nullptr;
-QueueHandle_t	to_TCP_ot_queue				= nullptr;
+//Телеметрия: отдельные топики для простых потребителей и/или один кадр со всем состоянием котла и датчиков.
+//Значения по умолчанию: сохранённые командой telemetry настройки важнее
+constexpr	Telemetry::Mode			telemetry_mode			= Telemetry::Mode::topics;
+constexpr	Telemetry::FrameFormat	telemetry_frame_format	= Telemetry::FrameFormat::json;
+constexpr	uint32_t				telemetry_frame_period	= 10000;	//мс
 
 extern "C" void	app_main()
 {
@@ -56,6 +61,9 @@ extern "C" void	app_main()
 	if(ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)	{ESP_ERROR_CHECK(nvs_flash_erase()); ret = nvs_flash_init();}
 	ESP_ERROR_CHECK(ret);
 
+	//Отложенная запись настроек
+	settings_cache.start(1, 0);
+
 	//Выставка начального состояния термоголовок
 	init_thermoHeads();
 
@@ -82,6 +90,9 @@ extern "C" void	app_main()
 	if(ret != ESP_OK)	ESP_LOGE(TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(ret));
 	else 				ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
 
+	//Накопление телеметрии без связи с брокером
+	mqtt_outbox.init();
+
 	//Включение WiFi
 	wifi_init_sta(SecureConfig::wifi_ssid, SecureConfig::wifi_password);
 
@@ -109,14 +120,14 @@ extern "C" void	app_main()
 
 	//Запуск клиента MQTT
 	mqtt_init(SecureConfig::mqtt_broker);
+	telemetry.frame_group(SecureConfig::boiler_topic, "boiler");
+	telemetry.frame_group(SecureConfig::thermo_topic, "thermo");
+	telemetry.restore_mode(telemetry_mode, mqtt_topic(SecureConfig::boiler_topic, "frame"), telemetry_frame_period, telemetry_frame_format);
 
 	//Очереди обмена сообщениями
 	from_telegram_gpio_queue	= xQueueGenericCreate(20, sizeof(fromTelegram*), queueQUEUE_TYPE_BASE);
-	from_telegram_ot_queue		= xQueueGenericCreate(20, sizeof(fromTelegram_ot*), queueQUEUE_TYPE_BASE);
 	to_telegram_queue			= xQueueGenericCreate(20, sizeof(toTelegram*), queueQUEUE_TYPE_BASE);
-	from_mqtt_queue				= xQueueGenericCreate(20, sizeof(fromMQTT*), queueQUEUE_TYPE_BASE);
-	from_TCP_ot_queue			= xQueueGenericCreate(20, sizeof(fromTCP_to_ot*), queueQUEUE_TYPE_BASE);
-	to_TCP_ot_queue				= xQueueGenericCreate(20, sizeof(toTCP_from_ot*), queueQUEUE_TYPE_BASE);
+	command_bus.init(20);
 
 	//Запуск задач
 	xTaskCreatePinnedToCore(telegram,		"telegram",			8192, nullptr, 1, nullptr, 0);	//0.1 Гц
@@ -125,4 +136,5 @@ extern "C" void	app_main()
 	xTaskCreatePinnedToCore(thermo,			"thermo",			4096, nullptr, 1, nullptr, 1);	//0.1 Гц
 	xTaskCreatePinnedToCore(logger,			"logger",			8192, nullptr, 1, nullptr, 1);	//Раз в 30 секунд
 	xTaskCreatePinnedToCore(boiler_task,	"boiler_task",		16384, nullptr, 3, nullptr, 1);	//1 Гц
+	telemetry.start(1, 0);																	//2 Гц
 }
@@ -1,12 +1,19 @@
 #include <cstdio>
 #include <cmath>
 #include <cstring>
+#include <cstdlib>
+#include <strings.h>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include "esp_log.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "sdkconfig.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
 #include "mqtt.h"
 
 static const char*	TAG = "mqtt_task";
@@ -14,7 +21,30 @@ static const char*	TAG = "mqtt_task";
 //Глобальные переменные
 esp_mqtt_client_handle_t	mqtt_client	= nullptr;
 std::string					mqtt_uri;
-std::vector<std::string>	mqtt_topic_list;	//Список запрашиваемых топиков
+
+//Реестр топиков: строки не перемещаются и не освобождаются, поэтому читаются без блокировки
+static constexpr size_t		max_topics	= 128;
+static const char*			topics[max_topics];
+static std::atomic<size_t>	topics_count{0};
+static std::mutex			topics_mutex;
+
+//Подписки на команды. Как и реестр топиков, только дополняются и читаются обработчиком событий без блокировки
+struct Subscription
+{
+	mqtt_topic_t			topic;
+	uint8_t					command;
+	mqtt_command_handler_t	handler;
+};
+static constexpr size_t		max_subscriptions	= 16;
+static Subscription			subscriptions[max_subscriptions];
+static std::atomic<size_t>	subscriptions_count{0};
+static std::mutex			subscriptions_mutex;
+
+//Счётчики принятых команд
+static std::atomic<uint32_t>	commands_received{0};
+static std::atomic<uint32_t>	commands_unknown{0};	//Топик без подписки
+static std::atomic<uint32_t>	commands_bad{0};		//Значение не разобрано или пришло частями
+static std::atomic<uint32_t>	commands_rejected{0};	//Отклонено обработчиком
 
 static void log_error_if_nonzero(const char *message, int error_code)
 {
@@ -47,6 +77,11 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
 			//Передача клиента в глобальную видимость
 			mqtt_client	= client;
+
+			//Подписка на топики команд (сессия брокера могла не сохраниться)
+			size_t	count	= subscriptions_count.load(std::memory_order_acquire);
+			for(size_t i = 0; i < count; i++)
+				esp_mqtt_client_subscribe(client, mqtt_topic_name(subscriptions[i].topic), 1);
 		}break;
 
 		case MQTT_EVENT_DISCONNECTED:
@@ -77,11 +112,31 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
 		case MQTT_EVENT_DATA:
 		{
-			ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-			printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-			printf("DATA=%.*s\r\n", event->data_len, event->data);
+			//Команда разбирается на месте и передаётся обработчику подписки
+			commands_received++;
 
+			const Subscription*	sub		= nullptr;
+			size_t				count	= subscriptions_count.load(std::memory_order_acquire);
+			for(size_t i = 0; i < count && event->topic; i++)
+			{
+				const char*	name	= mqtt_topic_name(subscriptions[i].topic);
+				if(strlen(name) == size_t(event->topic_len) && memcmp(name, event->topic, event->topic_len) == 0){
+					sub	= &subscriptions[i];
+					break;
+				}
+			}
 
+			float	value;
+			if(!sub){
+				commands_unknown++;
+				ESP_LOGW(TAG, "Сообщение без подписки: %.*s", event->topic_len, event->topic);
+			}
+			else if(event->current_data_offset || event->data_len != event->total_data_len || !mqtt_parse_value(event->data, event->data_len, &value)){
+				commands_bad++;
+				ESP_LOGW(TAG, "Неверное значение команды %.*s: %.*s", event->topic_len, event->topic, event->data_len, event->data);
+			}
+			else if(!sub->handler(sub->command, value))
+				commands_rejected++;
 		}break;
 
 		case MQTT_EVENT_ERROR:
@@ -103,6 +158,118 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 	}
 }
 
+mqtt_topic_t	mqtt_topic(const std::string& prefix, const char* name)
+{
+	std::string	full	= prefix + name;
+	std::lock_guard<std::mutex>	lock(topics_mutex);
+	size_t	count	= topics_count.load(std::memory_order_relaxed);
+	for(size_t i = 0; i < count; i++)
+		if(full == topics[i])
+			return mqtt_topic_t(i);
+
+	if(count >= max_topics)
+	{
+		ESP_LOGE(TAG, "Реестр топиков заполнен, %s не зарегистрирован", full.c_str());
+		return mqtt_no_topic;
+	}
+
+	char*	str	= new char[full.length() + 1];
+	memcpy(str, full.c_str(), full.length() + 1);
+	topics[count]	= str;
+	topics_count.store(count + 1, std::memory_order_release);
+	return mqtt_topic_t(count);
+}
+
+const char*	mqtt_topic_name(mqtt_topic_t topic)
+{
+	return topic < topics_count.load(std::memory_order_acquire) ? topics[topic] : nullptr;
+}
+
+size_t	mqtt_topic_count()
+{
+	return topics_count.load(std::memory_order_acquire);
+}
+
+int	mqtt_publish(mqtt_topic_t topic, const char* data, int len, int qos, int retain)
+{
+	esp_mqtt_client_handle_t	client	= mqtt_client;
+	const char*					name	= mqtt_topic_name(topic);
+	if(!client || !name)
+		return -1;
+
+	return esp_mqtt_client_publish(client, name, data, len, qos, retain);
+}
+
+bool	mqtt_subscribe(const std::string& topic, uint8_t command, mqtt_command_handler_t handler)
+{
+	mqtt_topic_t	handle	= mqtt_topic(topic);
+	if(handle == mqtt_no_topic)
+		return false;
+
+	{
+		std::lock_guard<std::mutex>	lock(subscriptions_mutex);
+		size_t	count	= subscriptions_count.load(std::memory_order_relaxed);
+		if(count >= max_subscriptions)
+		{
+			ESP_LOGE(TAG, "Таблица подписок заполнена, %s не добавлен", topic.c_str());
+			return false;
+		}
+		subscriptions[count]	= {handle, command, handler};
+		subscriptions_count.store(count + 1, std::memory_order_release);
+	}
+
+	//Без блокировки таблицы: клиент сам может ждать обработчика событий
+	esp_mqtt_client_handle_t	client	= mqtt_client;
+	if(client)
+		esp_mqtt_client_subscribe(client, topic.c_str(), 1);
+	return true;
+}
+
+bool	mqtt_parse_value(const char* data, int len, float* value)
+{
+	//Пробелы и кавычки по краям не мешают
+	while(len > 0 && (*data == ' ' || *data == '"' || *data == '\r' || *data == '\n')){
+		data++;
+		len--;
+	}
+	while(len > 0 && (data[len-1] == ' ' || data[len-1] == '"' || data[len-1] == '\r' || data[len-1] == '\n'))
+		len--;
+
+	char	buf[16];
+	if(len <= 0 || len >= int(sizeof(buf)))
+		return false;
+	memcpy(buf, data, len);
+	buf[len]	= 0;
+
+	if(!strcasecmp(buf, "on") || !strcasecmp(buf, "true")){
+		*value	= 1;
+		return true;
+	}
+	if(!strcasecmp(buf, "off") || !strcasecmp(buf, "false")){
+		*value	= 0;
+		return true;
+	}
+
+	char*	end;
+	float	v	= strtof(buf, &end);
+	if(end == buf || *end || !std::isfinite(v))
+		return false;
+
+	*value	= v;
+	return true;
+}
+
+json	mqtt_json_stats()
+{
+	return json{
+		{"subscriptions", subscriptions_count.load()},
+		{"received", commands_received.load()},
+		{"unknown", commands_unknown.load()},
+		{"bad", commands_bad.load()},
+		{"rejected", commands_rejected.load()}
+	};
+}
+
 void	mqtt_init(const char* uri)
 {
 	//Создание клиента MQTT
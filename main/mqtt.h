@@ -1,18 +1,36 @@
 #ifndef MQTT_H
 #define MQTT_H
 #include <mqtt_client.h>
+#include "json.hpp"
+using json = nlohmann::json;
 
 extern esp_mqtt_client_handle_t	mqtt_client;
-extern QueueHandle_t			from_mqtt_queue;
-extern std::vector<std::string>	mqtt_topic_list;	//Список запрашиваемых топиков
-
-struct	fromMQTT
-{
-	std::string		topic;
-	std::string		text;
-};
 
 void	mqtt_init(const char* uri);
 
+//Обработчик команды из подписанного топика. Вызывается в задаче клиента MQTT с кодом, заданным при подписке,
+//и уже разобранным значением (число; on/true - 1, off/false - 0). false - команда отклонена
+using mqtt_command_handler_t	= bool(*)(uint8_t command, float value);
+
+//Подписка на топик команд: сразу, если клиент подключён, и заново при каждом подключении
+bool	mqtt_subscribe(const std::string& topic, uint8_t command, mqtt_command_handler_t handler);
+
+//Разбор значения команды. Полезная нагрузка не завершается нулём
+bool	mqtt_parse_value(const char* data, int len, float* value);
+
+//Счётчики принятых команд
+json	mqtt_json_stats();
+
+//Реестр полных топиков. Строка топика собирается один раз при регистрации (обычно в конструкторе или при
+//запуске задачи), публикации идут по дескриптору и не выделяют память. Одинаковые топики получают один дескриптор
+using mqtt_topic_t	= uint16_t;
+constexpr mqtt_topic_t	mqtt_no_topic	= 0xffff;
+mqtt_topic_t	mqtt_topic(const std::string& prefix, const char* name = "");
+const char*		mqtt_topic_name(mqtt_topic_t topic);
+size_t			mqtt_topic_count();
+
+//Публикация, если клиент подключён. -1 - клиента нет или топик не зарегистрирован
+int		mqtt_publish(mqtt_topic_t topic, const char* data, int len = 0, int qos = 0, int retain = 0);
+
 
 #endif  //MQTT_H
\ No newline at end of file
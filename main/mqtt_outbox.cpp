@@ -0,0 +1,351 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/time.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "mqtt.h"
+#include "mqtt_outbox.h"
+
+static const char*	TAG = "mqtt_outbox";
+
+MqttOutbox	mqtt_outbox;
+
+void	MqttOutbox::init()
+{
+	std::lock_guard<std::mutex>	io_lock(io_mutex);
+	std::lock_guard<std::mutex>	lock(mutex);
+	unlink(file_name);
+	unlink(frames_name);
+	file_head	= 0;
+	file_count	= 0;
+	frame_head	= 0;
+	frame_count	= 0;
+}
+
+void	MqttOutbox::store(uint16_t topic, const char* text)
+{
+	timeval	tv;
+	gettimeofday(&tv, nullptr);
+
+	Record	rec;
+	rec.time_ms	= int64_t(tv.tv_sec)*1000 + tv.tv_usec/1000;
+	rec.topic	= topic;
+	snprintf(rec.text, sizeof(rec.text), "%s", text);
+
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		if(ram_count < ram_capacity){
+			ram[(ram_head + ram_count) % ram_capacity]	= rec;
+			ram_count++;
+			stat.stored++;
+			return;
+		}
+	}
+
+	//Кольцо RAM заполнено раньше, чем poll перенёс его в SPIFFS: перенос здесь. Вытеснение - только если файл недоступен
+	std::lock_guard<std::mutex>	io_lock(io_mutex);
+	bool	spilled	= spill();
+	std::lock_guard<std::mutex>	lock(mutex);
+	if(!spilled && ram_count == ram_capacity){
+		ram_head	= (ram_head + 1) % ram_capacity;
+		ram_count--;
+		stat.evicted++;
+	}
+	if(ram_count < ram_capacity){
+		ram[(ram_head + ram_count) % ram_capacity]	= rec;
+		ram_count++;
+		stat.stored++;
+	}
+	else
+		stat.evicted++;
+}
+
+bool	MqttOutbox::store_frame(uint16_t topic, const uint8_t* data, size_t size)
+{
+	if(size > frame_slot - frame_header){
+		ESP_LOGE(TAG, "Кадр %d байт не помещается в ячейку", int(size));
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.dropped++;
+		return false;
+	}
+
+	std::lock_guard<std::mutex>	io_lock(io_mutex);
+	frame_io[0]	= uint8_t(size);
+	frame_io[1]	= uint8_t(size >> 8);
+	frame_io[2]	= uint8_t(topic);
+	frame_io[3]	= uint8_t(topic >> 8);
+	memcpy(frame_io + frame_header, data, size);
+
+	FILE*	file	= fopen(frames_name, "r+b");
+	if(!file)
+		file	= fopen(frames_name, "w+b");
+	if(!file){
+		ESP_LOGE(TAG, "Не удалось открыть %s", frames_name);
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.file_errors++;
+		return false;
+	}
+
+	size_t	head	= frame_head;
+	size_t	count	= frame_count;
+	bool	evicted	= count == frame_capacity;
+	if(evicted){
+		head	= (head + 1) % frame_capacity;
+		count--;
+	}
+	size_t	pos		= (head + count) % frame_capacity;
+	bool	written	= fseek(file, long(pos*frame_slot), SEEK_SET) == 0 && fwrite(frame_io, frame_header + size, 1, file) == 1;
+	fclose(file);
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	frame_head	= head;
+	frame_count	= count + (written ? 1 : 0);
+	if(evicted)	stat.evicted++;
+	if(written)	stat.frames++;
+	else		stat.file_errors++;
+	return written;
+}
+
+bool	MqttOutbox::spill()
+{
+	//Самые старые записи RAM копируются под mutex и остаются в кольце до окончания записи в файл
+	size_t	n;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		n	= std::min(spill_chunk, ram_count);
+		for(size_t i = 0; i < n; i++)
+			io[i]	= ram[(ram_head + i) % ram_capacity];
+	}
+	if(!n)
+		return true;
+
+	FILE*	file	= fopen(file_name, "r+b");
+	if(!file)
+		file	= fopen(file_name, "w+b");
+	if(!file){
+		ESP_LOGE(TAG, "Не удалось открыть %s", file_name);
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.file_errors++;
+		return false;
+	}
+
+	//Дописывание за хвостом кольца в файле. Переполненное кольцо теряет самые старые записи
+	size_t	head	= file_head;
+	size_t	count	= file_count;
+	size_t	evicted	= 0;
+	size_t	written	= 0;
+	for(; written < n; written++)
+	{
+		if(count == file_capacity){
+			head	= (head + 1) % file_capacity;
+			count--;
+			evicted++;
+		}
+
+		size_t	pos	= (head + count) % file_capacity;
+		if(fseek(file, long(pos*sizeof(Record)), SEEK_SET) != 0 || fwrite(&io[written], sizeof(Record), 1, file) != 1)
+			break;
+		count++;
+	}
+	fclose(file);
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	file_head		= head;
+	file_count		= count;
+	ram_head		= (ram_head + written) % ram_capacity;
+	ram_count		-= written;
+	stat.spilled	+= written;
+	stat.evicted	+= evicted;
+	if(written < n)
+		stat.file_errors++;
+
+	return written == n;
+}
+
+bool	MqttOutbox::publish(const Record& rec)
+{
+	esp_mqtt_client_handle_t	client	= mqtt_client;
+	if(!client)
+		return false;
+
+	char		topic[160];
+	const char*	name	= mqtt_topic_name(rec.topic);
+	if(!name || snprintf(topic, sizeof(topic), "%s/history", name) >= int(sizeof(topic))){
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.dropped++;
+		return true;
+	}
+
+	char	payload[64];
+	snprintf(payload, sizeof(payload), "{\"t\":%lld,\"v\":%s}", (long long)rec.time_ms, rec.text);
+	if(esp_mqtt_client_publish(client, topic, payload, 0, 0, 0) < 0)
+		return false;
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	stat.replayed++;
+	return true;
+}
+
+size_t	MqttOutbox::replay_file(size_t max_records)
+{
+	size_t	n	= std::min({max_records, file_count, file_capacity - file_head, spill_chunk});
+	if(!n)
+		return 0;
+
+	FILE*	file	= fopen(file_name, "rb");
+	size_t	got		= 0;
+	if(file){
+		if(fseek(file, long(file_head*sizeof(Record)), SEEK_SET) == 0)
+			got	= fread(io, sizeof(Record), n, file);
+		fclose(file);
+	}
+	if(got < n){
+		//Сегмент не читается: накопленное в нём уже не восстановить
+		ESP_LOGE(TAG, "Не удалось прочитать %s, отброшено %d записей", file_name, int(file_count));
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.file_errors++;
+		stat.dropped	+= file_count;
+		file_head	= 0;
+		file_count	= 0;
+		return 0;
+	}
+
+	size_t	sent	= 0;
+	while(sent < got && publish(io[sent]))
+		sent++;
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	file_head	= (file_head + sent) % file_capacity;
+	file_count	-= sent;
+	if(!file_count)
+		file_head	= 0;
+
+	return sent;
+}
+
+size_t	MqttOutbox::replay_ram(size_t max_records)
+{
+	//Порция копируется под mutex, отправляется без него. Голову кольца двигает только владелец io_mutex
+	size_t	n;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		n	= std::min({max_records, ram_count, spill_chunk});
+		for(size_t i = 0; i < n; i++)
+			io[i]	= ram[(ram_head + i) % ram_capacity];
+	}
+
+	size_t	sent	= 0;
+	while(sent < n && publish(io[sent]))
+		sent++;
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	ram_head	= (ram_head + sent) % ram_capacity;
+	ram_count	-= sent;
+	return sent;
+}
+
+bool	MqttOutbox::replay_frame()
+{
+	esp_mqtt_client_handle_t	client	= mqtt_client;
+	if(!frame_count || !client)
+		return false;
+
+	FILE*	file	= fopen(frames_name, "rb");
+	size_t	size	= 0;
+	bool	read	= false;
+	if(file){
+		if(fseek(file, long(frame_head*frame_slot), SEEK_SET) == 0 && fread(frame_io, frame_header, 1, file) == 1){
+			size	= frame_io[0] | (size_t(frame_io[1]) << 8);
+			read	= size <= frame_slot - frame_header && fread(frame_io + frame_header, 1, size, file) == size;
+		}
+		fclose(file);
+	}
+	if(!read){
+		ESP_LOGE(TAG, "Не удалось прочитать %s, отброшено %d кадров", frames_name, int(frame_count));
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.file_errors++;
+		stat.dropped	+= frame_count;
+		frame_head	= 0;
+		frame_count	= 0;
+		return false;
+	}
+
+	//Кадр несёт свои seq и t, поэтому отправляется без обёртки
+	char		topic[160];
+	const char*	name	= mqtt_topic_name(frame_io[2] | (uint16_t(frame_io[3]) << 8));
+	bool		valid	= name && snprintf(topic, sizeof(topic), "%s/history", name) < int(sizeof(topic));
+	if(valid && esp_mqtt_client_publish(client, topic, reinterpret_cast<const char*>(frame_io + frame_header), size, 0, 0) < 0)
+		return false;
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	frame_head	= (frame_head + 1) % frame_capacity;
+	frame_count--;
+	if(!frame_count)
+		frame_head	= 0;
+	if(valid)	stat.frames_replayed++;
+	else		stat.dropped++;
+	return true;
+}
+
+void	MqttOutbox::poll(size_t max_replay)
+{
+	std::lock_guard<std::mutex>	io_lock(io_mutex);
+	bool	full;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		full	= ram_count > ram_capacity - spill_chunk;
+	}
+	if(full)
+		spill();
+
+	//Сначала файл: в нём записи старше, чем в RAM. file_count меняется только под io_mutex
+	while(max_replay)
+	{
+		size_t	sent;
+		if(file_count)
+			sent	= replay_file(max_replay);
+		else{
+			bool	empty;
+			{
+				std::lock_guard<std::mutex>	lock(mutex);
+				empty	= !ram_count;
+			}
+			sent	= empty ? 0 : replay_ram(max_replay);
+		}
+		if(!sent)
+			break;
+		max_replay	-= sent;
+	}
+
+	//Кадры - после значений и не больше одного за проход: они в десятки раз длиннее записи
+	if(max_replay)
+		replay_frame();
+}
+
+size_t	MqttOutbox::size() const
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	return ram_count + file_count + frame_count;
+}
+
+json	MqttOutbox::json_stats() const
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	return json{
+		{"ram", ram_count},
+		{"file", file_count},
+		{"frames", frame_count},
+		{"stored", stat.stored},
+		{"spilled", stat.spilled},
+		{"replayed", stat.replayed},
+		{"evicted", stat.evicted},
+		{"dropped", stat.dropped},
+		{"file_errors", stat.file_errors},
+		{"frames_stored", stat.frames},
+		{"frames_replayed", stat.frames_replayed}
+	};
+}
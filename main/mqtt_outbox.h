@@ -0,0 +1,85 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <mutex>
+
+//Накопление телеметрии без связи с брокером.
+//Значения с отметкой времени UTC складываются в кольцо в RAM, при его заполнении самые старые переносятся
+//в кольцевой сегмент SPIFFS. После подключения записи отправляются по порядку времени с ограничением
+//числа за проход в топик "<топик>/history" как {"t": мс UTC, "v": значение}, чтобы не подменять текущее значение.
+//При заполнении обоих колец вытесняются самые старые записи.
+//Файл и публикация - без блокировки кольца RAM: порция записей копируется под mutex, а пишется, читается
+//и отправляется только под io_mutex, поэтому store из задач котла и датчиков не ждёт SPIFFS и брокер.
+//Кадры телеметрии (JSON или CBOR) без связи пишутся сразу в свой кольцевой файл из ячеек постоянного размера
+//и после подключения уходят как есть в "<топик кадра>/history" после записей значений.
+//Дескрипторы топиков действительны только до перезагрузки, поэтому сегменты SPIFFS очищаются в init
+class MqttOutbox
+{
+public:
+	struct Stats
+	{
+		uint32_t	stored		= 0;	//Принято значений без связи
+		uint32_t	spilled		= 0;	//Перенесено из RAM в SPIFFS
+		uint32_t	replayed	= 0;	//Отправлено после подключения
+		uint32_t	evicted		= 0;	//Вытеснено самых старых при заполнении
+		uint32_t	dropped		= 0;	//Отброшено при отправке (неизвестный топик, сбой чтения SPIFFS)
+		uint32_t	file_errors	= 0;	//Сбои чтения и записи SPIFFS
+		uint32_t	frames		= 0;	//Принято кадров без связи
+		uint32_t	frames_replayed	= 0;
+	};
+
+private:
+	struct Record
+	{
+		int64_t		time_ms;	//Время UTC
+		uint16_t	topic;		//mqtt_topic_t
+		char		text[22];
+	};
+	static constexpr size_t		ram_capacity	= 128;
+	static constexpr size_t		file_capacity	= 2048;	//64 кБ
+	static constexpr size_t		spill_chunk		= 32;	//Перенос в SPIFFS, когда в RAM осталось меньше места
+	static constexpr const char*	file_name	= "/spiffs/mqtt_outbox.bin";
+	static constexpr size_t		frame_slot		= 1536;	//Заголовок (длина, топик) и кадр
+	static constexpr size_t		frame_header	= 4;
+	static constexpr size_t		frame_capacity	= 48;	//72 кБ
+	static constexpr const char*	frames_name	= "/spiffs/mqtt_frames.bin";
+
+	Record				ram[ram_capacity];
+	size_t				ram_head	= 0;
+	size_t				ram_count	= 0;
+	size_t				file_head	= 0;	//Меняются под обоими mutex, читаются под любым
+	size_t				file_count	= 0;
+	Stats				stat;
+	mutable std::mutex	mutex;			//Кольцо RAM, счётчики
+	std::mutex			io_mutex;		//Файлы, голова кольца RAM и буферы io. Берётся раньше mutex
+	Record				io[spill_chunk];
+	size_t				frame_head	= 0;	//Как file_head
+	size_t				frame_count	= 0;
+	uint8_t				frame_io[frame_slot];
+
+	//Под io_mutex, без mutex
+	bool	spill();
+	size_t	replay_file(size_t max_records);
+	size_t	replay_ram(size_t max_records);
+	bool	replay_frame();
+	bool	publish(const Record& rec);	//false - нет связи, запись остаётся
+
+public:
+	void	init();
+
+	//При заполненном кольце RAM сначала переносит его начало в SPIFFS: вызывать без своих блокировок
+	void	store(uint16_t topic, const char* text);
+
+	//Кадр целиком в файл кадров, при заполнении вытесняется самый старый. false - кадр больше ячейки или сбой SPIFFS
+	bool	store_frame(uint16_t topic, const uint8_t* data, size_t size);
+
+	//Перенос из RAM в SPIFFS и отправка не больше max_replay записей (0 - только перенос)
+	void	poll(size_t max_replay);
+
+	size_t	size() const;
+	json	json_stats() const;
+};
+
+extern MqttOutbox	mqtt_outbox;
+
+#endif	//MQTT_OUTBOX_H
@@ -1,9 +1,12 @@
 #include <string>
 #include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <memory>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_timer.h"
-#include "nvs_flash.h"
 #include "nvs.h"
 #include "sdkconfig.h"
 #include "driver/gpio.h"
@@ -12,11 +15,13 @@ using json = nlohmann::json;
 
 #include "secure_config.h"
 #include "ot_boiler.h"
+#include "settings_cache.h"
 #include "driver/rmt_tx.h"
 #include "driver/rmt_rx.h"
 #include "rmt_opentherm.h"
 #include "telegram.h"
 #include "mqtt.h"
+#include "telemetry.h"
 
 static const char*	TAG = "ot_boiler";
 
@@ -53,128 +58,122 @@ constexpr	uint32_t	bit_29	= 0x20000000;
 constexpr	uint32_t	bit_30	= 0x40000000;
 constexpr	uint32_t	bit_31	= 0x80000000;
 
-OT_Boiler::OT_Boiler(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic, const std::string& OT_topic, const int slave_ID)
+OT_Boiler::OT_Boiler(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic, const std::string& OT_topic, const int slave_ID, const std::string& nvs_name)
 {
 	boiler_topic	= topic;
 	boiler_OT_topic	= OT_topic;
 	slaveID			= slave_ID;
+	nvs_namespace	= nvs_name;
 	ot_boiler_state.faultFlags.all	= 0;
+	repeats	= OT_Repeats(esp_timer_get_time());
+
+	//Телеметрия: флаги и коды - по изменению, уставки - по изменению на градус
+	using Rule	= Telemetry::Rule;
+	for(size_t i = 0; i < data_count; i++)
+		data_state[i].metric	= telemetry.add(mqtt_topic(boiler_topic, data_table[i].topic), Rule{data_table[i].deadband, 0, 3600000, data_table[i].precision});
+	metrics.fault				= telemetry.add(mqtt_topic(boiler_topic, "fault"), Rule{0.5f, 0, 3600000, 0});
+	metrics.centralHeating		= telemetry.add(mqtt_topic(boiler_topic, "centralHeating"), Rule{0.5f, 0, 3600000, 0});
+	metrics.dhw					= telemetry.add(mqtt_topic(boiler_topic, "dhw"), Rule{0.5f, 0, 3600000, 0});
+	metrics.flame				= telemetry.add(mqtt_topic(boiler_topic, "flame"), Rule{0.5f, 0, 3600000, 0});
+	metrics.OEMfaultCode		= telemetry.add(mqtt_topic(boiler_topic, "OEMfaultCode"), Rule{0.5f, 0, 3600000, 0});
+	metrics.faultFlags			= telemetry.add(mqtt_topic(boiler_topic, "faultFlags"), Rule{0.5f, 0, 3600000, 0});
+	metrics.diagCode			= telemetry.add(mqtt_topic(boiler_topic, "diagCode"), Rule{0.5f, 0, 3600000, 0});
+	metrics.ch_temp_zad			= telemetry.add(mqtt_topic(boiler_topic, "ch_temp_zad"), Rule{0.5f, 0, 3600000, 0});
+	metrics.dhw_temp_zad		= telemetry.add(mqtt_topic(boiler_topic, "dhw_temp_zad"), Rule{0.5f, 0, 3600000, 0});
+	metrics.ch_temp_max			= telemetry.add(mqtt_topic(boiler_topic, "ch_temp_max"), Rule{0.5f, 0, 3600000, 0});
+	metrics.ch_mod_max			= telemetry.add(mqtt_topic(boiler_topic, "ch_mod_max"), Rule{0.5f, 0, 3600000, 0});
+	metrics.control_CH			= telemetry.add(mqtt_topic(boiler_topic, "control/CH"), Rule{0.5f, 0, 3600000, 0});
+	metrics.control_DHW			= telemetry.add(mqtt_topic(boiler_topic, "control/DHW"), Rule{0.5f, 0, 3600000, 0});
+	metrics.control_SummerMode	= telemetry.add(mqtt_topic(boiler_topic, "control/SummerMode"), Rule{0.5f, 0, 3600000, 0});
+	topics.BLOR					= mqtt_topic(boiler_topic, "BLOR");
+	topics.fails				= mqtt_topic(boiler_OT_topic, "fails");
+
+	//Расписание опроса: индекс обмена - status_job, затем строки data_table по порядку
+	scheduler	= OT_Scheduler(esp_timer_get_time());
+	scheduler.add(0, status_period_ms, 0);
+	for(size_t i = 0; i < data_count; i++)
+		scheduler.add(data_table[i].id, data_table[i].period_ms, data_table[i].priority, 0, data_table[i].max_period_ms);
 
 	//Настройка шины Opentherm
 	rmt_ot	= new RMT_Opentherm(pin_in, pin_out, boiler_OT_topic + "RMT");
 
 	//Чтение прошлых настроек
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READONLY, &nvs_settings) == ESP_OK)
-	{
-		uint8_t	val;
-		if(nvs_get_u8(nvs_settings, "CH", &val) == ESP_OK)				ot_boiler_data.CH			= (val != 0);
-		if(nvs_get_u8(nvs_settings, "DHW", &val) == ESP_OK)				ot_boiler_data.DHW			= (val != 0);
-		if(nvs_get_u8(nvs_settings, "SummerMode", &val) == ESP_OK)		ot_boiler_data.SummerMode	= (val != 0);
-		if(nvs_get_u8(nvs_settings, "ch_temp_zad", &val) == ESP_OK)		ot_boiler_data.ch_temp_zad	= val;
-		if(nvs_get_u8(nvs_settings, "ch_temp_max", &val) == ESP_OK)		ot_boiler_data.ch_temp_max	= val;
-		if(nvs_get_u8(nvs_settings, "ch_mod_max", &val) == ESP_OK)		ot_boiler_data.ch_mod_max	= val;
-		nvs_close(nvs_settings);
-	}
+	const char*	ns	= nvs_namespace.c_str();
+	uint8_t		val;
+	if(settings_cache.get_u8(ns, "CH", &val))				ot_boiler_data.CH			= (val != 0);
+	if(settings_cache.get_u8(ns, "DHW", &val))				ot_boiler_data.DHW			= (val != 0);
+	if(settings_cache.get_u8(ns, "SummerMode", &val))		ot_boiler_data.SummerMode	= (val != 0);
+	if(settings_cache.get_u8(ns, "ch_temp_zad", &val))		ot_boiler_data.ch_temp_zad	= val;
+	if(settings_cache.get_u8(ns, "ch_temp_max", &val))		ot_boiler_data.ch_temp_max	= val;
+	if(settings_cache.get_u8(ns, "ch_mod_max", &val))		ot_boiler_data.ch_mod_max	= val;
+
+	//Карта поддерживаемых ID. Если её нет, обход начнётся в свободные окна шины
+	load_capabilities();
 }
 
-bool	OT_Boiler::check_parity(uint32_t frame)
+OT_Status	OT_Boiler::relay(const uint32_t request, uint32_t* response)
 {
-	//Проверка нечетности
-	uint8_t	p = 0;
-	while(frame > 0)
-	{
-		if(frame & 1)	p++;
-		frame	= frame >> 1;
-	}
+	RMT_Opentherm::Result	result	= rmt_ot->processOT(request, response);
+
+	//Окно собственного обмена открывается окончанием пересылки
+	gateway_relay_us.store(esp_timer_get_time());
+	gateway_slot.store(true);
 
-	return (p & 1);
+	if(result == RMT_Opentherm::Result::receive_timeout)	return OT_Status::timeout;
+	if(result != RMT_Opentherm::Result::sucsess)			return OT_Status::rx_invalid;
+	return OT_Status::sucsess;
 }
 
-OT_Boiler::OT_Response	OT_Boiler::processOT(const Command cmd, const uint8_t id, const uint16_t data, bool data_invalid_expected /* = false */)
+bool	OT_Boiler::gateway_active() const
 {
-	uint8_t	msg_type;
-	switch(cmd)
-	{
-		case Command::write:	msg_type = static_cast<uint8_t>(MsgType::WRITE_DATA);	break;
-		case Command::invalid:	msg_type = static_cast<uint8_t>(MsgType::INVALID_DATA);	break;
-		default:				msg_type = static_cast<uint8_t>(MsgType::READ_DATA);	break;
-	}
+	int64_t	relayed	= gateway_relay_us.load();
+	return relayed && esp_timer_get_time() - relayed < gateway_hold_us;
+}
+
+bool	OT_Boiler::gateway_ch_setpoint(uint16_t* data) const
+{
+	uint16_t	setpoint	= gateway_setpoint.load();
+	if(setpoint == 0xffff)
+		return false;
+
+	*data	= setpoint;
+	return true;
+}
+
+bool	OT_Boiler::own_exchange_allowed() const
+{
+	if(!gateway_active())
+		return true;
+
+	//Окно занимает первый обмен после пересылки, следующие ждут следующего кадра термостата
+	return gateway_slot.load() && esp_timer_get_time() - gateway_relay_us.load() < gateway_slot_us;
+}
+
+OT_Response	OT_Boiler::processOT(const Command cmd, const uint8_t id, const uint16_t data, bool data_invalid_expected /* = false */)
+{
+	//Обмен и проверки ответа вынесены в ot_codec, чтобы их можно было гонять с симулятором на хосте
+	OT_Response		out			= ot_exchange(*rmt_ot, cmd, id, data, data_invalid_expected, failsCounter);
+	record(out);
+
+	const RMT_Opentherm::BusStats&	bus	= rmt_ot->stats();
+	//Время ответа - только если кадр пришёл: после сбоя приёма last_response_us остаётся от прошлого обмена
+	id_stats.record(id, out.status, bus.last_received ? bus.last_response_us : -1, bus.last_gap_us);
+	snapshot_dirty	= true;
 
-	//Формирование запроса
 	OT_Message_t	request;
-	request.all				= 0;
-	request.bit.msg_type	= msg_type;
-	request.bit.id			= id;
-	request.bit.spare		= 0;
-	request.bit.data		= data;
-	request.bit.parity		= check_parity(request.all);
-
-	//Отправка команды
 	OT_Message_t	response;
-	std::vector<rmt_symbol_word_t>	received_symbols;
-	RMT_Opentherm::Result	response_status	= rmt_ot->processOT(request.all, &response.all, received_symbols);
-
-	OT_Response	out;
-	out.data		= 0;
-	out.response	= response.all;
-	out.status 		= OT_Status::sucsess;
-
-	if(response_status == RMT_Opentherm::Result::sucsess){
-		//Проверка четности
-		if(check_parity(response.all))			{failsCounter.parityFail++;								out.status	= OT_Status::parityFail;}
-		else{
-			//Проверка на ACK
-			switch(static_cast<MsgType>(response.bit.msg_type)){
-				case MsgType::READ_ACK:			{if(cmd == Command::write)	{failsCounter.ACK_fail++;	out.status	= OT_Status::ACK_fail;}}	break;	//READ_ACK
-				case MsgType::WRITE_ACK:		{if(cmd == Command::read) 	{failsCounter.ACK_fail++;	out.status	= OT_Status::ACK_fail;}}	break;	//WRITE_ACK
-				case MsgType::DATA_INVALID:		{if(!data_invalid_expected) {failsCounter.dataInvalid++;out.status	= OT_Status::dataInvalid;}}	break;	//DATA_INVALID
-				case MsgType::UNKNOWN_DATAID:	{failsCounter.unknownID++;								out.status	= OT_Status::unknownID;}	break;	//UNKNOWN_DATAID
-				default:						{failsCounter.msgType_unknown++;						out.status	= OT_Status::msgType_unknown;}
-			}
+	request.all		= out.request;
+	response.all	= out.response;
 
-			//Проверка на SPARE
-			if(out.status == OT_Status::sucsess && response.bit.spare != 0)
-												{failsCounter.SPARE_fail++;								out.status	= OT_Status::SPARE_fail;}
-
-			if(out.status == OT_Status::sucsess){
-				//Проверка на ID
-				if(response.bit.id != id)		{failsCounter.responseID_fail++;						out.status	= OT_Status::responseID_fail;}
-				else{
-					//И только в этом случае все проверки на корректность ответа котла пройдены!
-					out.data	= response.bit.data;
-
-					//Сброс счетчика ошибок связи
-					if(error_counter >= 60)
-						sendNotification("Восстановление связи по цифровой шине");
-					error_counter	= 0;
-
-					// //Отладочная печать
-					// std::ostringstream	ss;
-					// ss << "request id: " << int(id) << std::endl;
-					// ss << "request: 0x" << std::hex << request.all << std::dec << std::endl;
-					// ss << "response: 0x" << std::hex << out.data << std::dec << std::endl;
-					// ss << "num_symbols: " << received_symbols.size() << std::endl;
-					// for(const rmt_symbol_word_t& word : received_symbols)
-					// {
-					// 	ss << "(" << word.level0 << ": " << word.duration0 << "; ";
-					// 	ss << word.level1 << ": " << word.duration1 << ")" << std::endl;
-					// }
-
-					// if(mqtt_client){
-					// 	ss << std::endl;
-					// 	esp_mqtt_client_publish(mqtt_client, (boiler_OT_topic + "log_info").c_str(), ss.str().c_str(), 0, 0, 0);
-					// }
-				}
-			}
+	if(out.status == OT_Status::sucsess){
+		data_store.update(id, out.data, uint32_t(esp_timer_get_time()/1000));
+
+		//Сброс счетчика ошибок связи
+		if(error_counter >= 60){
+			sendNotification("Восстановление связи по цифровой шине");
+			capabilities.reprobe();
 		}
-	}else if(response_status == RMT_Opentherm::Result::receive_timeout){
-		failsCounter.timeout++;
-		out.status	= OT_Status::timeout;
-	}
-	else{
-		failsCounter.rx_invalid++;
-		out.status	= OT_Status::rx_invalid;
+		error_counter	= 0;
 	}
 
 	if(out.status != OT_Status::sucsess && out.status != OT_Status::timeout){
@@ -209,108 +208,145 @@ OT_Boiler::OT_Response	OT_Boiler::processOT(const Command cmd, const uint8_t id,
 				{"id", uint8_t(response.bit.id)},
 				{"data", uint16_t(response.bit.data)}
 			}},
-			{"status", OT_Status_to_string(out.status)}
+			{"status", ot_status_to_string(out.status)}
 		};
 
-		char	buf[512];
-		for(const rmt_symbol_word_t& word : received_symbols){
-			sprintf(buf, "(%d: %d; %d: %d)", word.level0, word.duration0, word.level1, word.duration1);
-			fails["symbols"].push_back(buf);
-		}
+		//Символы печатаются только для публикации, без MQTT они остаются в самописце
+		if(mqtt_client){
+			const rmt_symbol_word_t*	received_symbols;
+			size_t	num_symbols	= rmt_ot->captured_symbols(&received_symbols);
+			char	buf[64];
+			for(size_t i = 0; i < num_symbols; i++){
+				const rmt_symbol_word_t&	word	= received_symbols[i];
+				sprintf(buf, "(%d: %d; %d: %d)", word.level0, word.duration0, word.level1, word.duration1);
+				fails["symbols"].push_back(buf);
+			}
 
-		if(mqtt_client)
-			esp_mqtt_client_publish(mqtt_client, (boiler_OT_topic + "fails").c_str(), fails.dump().c_str(), 0, 0, 0);
+			mqtt_publish(topics.fails, fails.dump().c_str());
+		}
 
 		error_counter++;
 		if(error_counter > 61)	error_counter	= 61;
-		if(error_counter == 60)
+		if(error_counter == 60){
+			save_flight_recorder();
 			sendNotification(std::string("Потеря связи по цифровой шине\n") + fails.dump(4));
+		}
 	}
 
 	return out;
 }
 
-size_t	OT_Boiler::repeat_old_messages()
+void	OT_Boiler::record(const OT_Response& out)
 {
-	//Повтор прошлых неудачных обменов.
-	//Если и повтор будет с ошибкой, то сообщение опять встанет в конец очереди
-	size_t	repeat_size	= repeat_queue.size();
-	for(size_t i = 0; i < repeat_size; i++)
-	{
-		RepeatQueue_t	item	= repeat_queue.front();
-		repeat_queue.pop();
-		size_t	size_before		= repeat_queue.size();
+	const rmt_symbol_word_t*	symbols;
+	size_t		num_symbols	= rmt_ot->captured_symbols(&symbols);
+	uint16_t	wait_ms		= 0;
+
+	//Служебный символ финализации хранит время ожидания ответа
+	if(num_symbols && symbols[num_symbols-1].duration1 == 8888){
+		num_symbols--;
+		wait_ms	= symbols[num_symbols].duration0;
+	}
 
-		if(item.counter < 5)
-		{
-			switch(item.msg)
-			{
-				case RepeatType::set_slave:				set_slave();										break;
-				case RepeatType::read_slaveConfig:		read_slaveConfig();									break;
-				case RepeatType::read_status:			read_status();										break;
-				case RepeatType::read_faultCode:		read_faultCode();									break;
-				case RepeatType::read_diagCode:			read_diagCode();									break;
-				case RepeatType::read_ch_temp:			read_ch_temp();										break;
-				case RepeatType::read_dhw_temp:			read_dhw_temp();									break;
-				case RepeatType::read_modulation:		read_modulation();									break;
-				case RepeatType::set_ch_temp_zad:		set_ch_temp_zad(ot_boiler_data.ch_temp_zad);		break;
-				case RepeatType::set_dhw_temp_zad:		set_dhw_temp_zad(ot_boiler_data.dhw_temp_zad);		break;
-				case RepeatType::set_ch_temp_max:		set_ch_temp_max(ot_boiler_data.ch_temp_max);		break;
-				case RepeatType::set_ch_mod_max:		set_ch_mod_max(ot_boiler_data.ch_mod_max);			break;
-				case RepeatType::BLOR:					BLOR();												break;
-
-				default:
-					break;
-			}
-		}
-		else
-		{
-			std::string	msg("5 раз подряд не удалось выполнить команду:\n");
-			switch (item.msg) {
-				case OT_Boiler::RepeatType::set_slave:				msg += "set_slave";				break;
-				case OT_Boiler::RepeatType::read_slaveConfig:		msg += "read_slaveConfig";		break;
-				case OT_Boiler::RepeatType::read_status:			msg += "read_status";			break;
-				case OT_Boiler::RepeatType::read_faultCode:			msg += "read_faultCode";		break;
-				case OT_Boiler::RepeatType::read_diagCode:			msg += "read_diagCode";			break;
-				case OT_Boiler::RepeatType::read_ch_temp:			msg += "read_ch_temp";			break;
-				case OT_Boiler::RepeatType::read_dhw_temp:			msg += "read_dhw_temp";			break;
-				case OT_Boiler::RepeatType::read_modulation:		msg += "read_modulation";		break;
-				case OT_Boiler::RepeatType::set_ch_temp_zad:		msg += "set_ch_temp_zad";		break;
-				case OT_Boiler::RepeatType::set_dhw_temp_zad:		msg += "set_dhw_temp_zad";		break;
-				case OT_Boiler::RepeatType::set_ch_temp_max:		msg += "set_ch_temp_max";		break;
-				case OT_Boiler::RepeatType::set_ch_mod_max:			msg += "set_ch_mod_max";		break;
-				case OT_Boiler::RepeatType::BLOR:					msg += "BLOR";					break;
-			}
-			sendNotification(msg);
-		}
+	std::lock_guard<std::mutex>	lock(recorder_mutex);
+	recorder.record(uint32_t(esp_timer_get_time()/1000), out.request, out.response, static_cast<uint8_t>(out.status), wait_ms, symbols, num_symbols);
+}
 
-		//Проверка, что сообщение вернулось в конец очереди
-		if(repeat_queue.size() > size_before)
-		{
-			//Надо увеличить счетчик повторений.
-			repeat_queue.back().counter	= item.counter++;
-		}
+std::vector<uint8_t>	OT_Boiler::flight_recorder() const
+{
+	std::lock_guard<std::mutex>	lock(recorder_mutex);
+	std::vector<uint8_t>	blob(recorder.serialized_size());
+	blob.resize(recorder.serialize(blob.data(), blob.size(), uint32_t(esp_timer_get_time()/1000)));
+	return blob;
+}
+
+std::string	OT_Boiler::flight_recorder_file() const
+{
+	return "/spiffs/ot_" + nvs_namespace + ".bin";
+}
+
+bool	OT_Boiler::save_flight_recorder() const
+{
+	std::vector<uint8_t>	blob	= flight_recorder();
+	FILE*	file	= fopen(flight_recorder_file().c_str(), "wb");
+	if(!file){
+		ESP_LOGE(TAG, "Не удалось открыть %s", flight_recorder_file().c_str());
+		return false;
 	}
 
-	return repeat_queue.size();
+	bool	ok	= fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+	fclose(file);
+	ESP_LOGI(TAG, "Самописец сохранён в %s: %d байт", flight_recorder_file().c_str(), int(blob.size()));
+	return ok;
 }
 
-void	OT_Boiler::repeat(RepeatType msg)
+void	OT_Boiler::repeat(RepeatType msg, bool ok)
 {
-	repeat_queue.push(RepeatQueue_t(msg, 0));
+	if(repeats.report(static_cast<size_t>(msg), ok, esp_timer_get_time()) == OT_Repeats::Result::given_up)
+		sendNotification(std::string("5 раз подряд не удалось выполнить команду:\n") + repeat_to_string(msg));
 }
 
-void	OT_Boiler::clear_old_message()
+bool	OT_Boiler::run_repeat()
 {
-	while(!repeat_queue.empty())
-		repeat_queue.pop();
+	if(!own_exchange_allowed())
+		return false;
+
+	int	type	= repeats.begin(esp_timer_get_time());
+	if(type < 0)
+		return false;
+	gateway_slot.store(false);
+
+	switch(static_cast<RepeatType>(type))
+	{
+		case RepeatType::set_slave:				set_slave();										break;
+		case RepeatType::read_slaveConfig:		read_slaveConfig();									break;
+		case RepeatType::read_status:			read_status();										break;
+		case RepeatType::read_faultCode:		read_faultCode();									break;
+		case RepeatType::read_diagCode:			read_diagCode();									break;
+		case RepeatType::set_ch_temp_zad:		set_ch_temp_zad(ot_boiler_data.ch_temp_zad);		break;
+		case RepeatType::set_dhw_temp_zad:		set_dhw_temp_zad(ot_boiler_data.dhw_temp_zad);		break;
+		case RepeatType::set_ch_temp_max:		set_ch_temp_max(ot_boiler_data.ch_temp_max);		break;
+		case RepeatType::set_ch_mod_max:		set_ch_mod_max(ot_boiler_data.ch_mod_max);			break;
+		case RepeatType::BLOR:					BLOR();												break;
+
+		default:
+			break;
+	}
+
+	//Повтор, который не сообщил результат, считается неудачным и не выполняется бесконечно
+	if(repeats.end(esp_timer_get_time()) == OT_Repeats::Result::given_up)
+		sendNotification(std::string("5 раз подряд не удалось выполнить команду:\n") + repeat_to_string(static_cast<RepeatType>(type)));
+
+	return true;
+}
+
+size_t	OT_Boiler::repeats_pending() const
+{
+	return repeats.pending();
+}
+
+const char*	OT_Boiler::repeat_to_string(RepeatType msg)
+{
+	switch(msg)
+	{
+		case RepeatType::set_slave:				return "set_slave";
+		case RepeatType::read_slaveConfig:		return "read_slaveConfig";
+		case RepeatType::read_status:			return "read_status";
+		case RepeatType::read_faultCode:		return "read_faultCode";
+		case RepeatType::read_diagCode:			return "read_diagCode";
+		case RepeatType::set_ch_temp_zad:		return "set_ch_temp_zad";
+		case RepeatType::set_dhw_temp_zad:		return "set_dhw_temp_zad";
+		case RepeatType::set_ch_temp_max:		return "set_ch_temp_max";
+		case RepeatType::set_ch_mod_max:		return "set_ch_mod_max";
+		case RepeatType::BLOR:					return "BLOR";
+		default:								return "none";
+	}
 }
 
 void	OT_Boiler::set_slave()
 {
 	OT_Response	slave	= processOT(Command::write, 2, slaveID);
-	if(slave.status	!= OT_Status::sucsess)
-		repeat(RepeatType::set_slave);
+	repeat(RepeatType::set_slave, slave.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::read_slaveConfig()
@@ -318,19 +354,21 @@ void	OT_Boiler::read_slaveConfig()
 	OT_Response	slaveConfig	= processOT(Command::read, 3, 0);
 	if(slaveConfig.status == OT_Status::sucsess)
 	{
+		//Флаги конфигурации в старшем байте, MemberID в младшем
+		OT_Value	config	= ot_value(3, slaveConfig.data);
 		std::ostringstream	ss;
 		ss << "Параметры котла:" << std::endl;
-		ss << "DHW present: " << (!(slaveConfig.data & bit_0) ? "dhw not present" : "dhw is present ") << std::endl;
-		ss << "Control type: " << (!(slaveConfig.data & bit_1) ? "modulating" : "on/off") << std::endl;
-		ss << "Cooling: " << (!(slaveConfig.data & bit_2) ? "not supported" : "supported") << std::endl;
-		ss << "DHW config: " << (!(slaveConfig.data & bit_3) ? "instantaneous or not-specified" : "storage tank") << std::endl;
-		ss << "Master low-off&pump control function: " << (!(slaveConfig.data & bit_4) ? "allowed" : "not allowed") << std::endl;
-		ss << "CH2 present: " << (!(slaveConfig.data & bit_4) ? "CH2 not present" : "CH2 present") << std::endl;
+		ss << "DHW present: " << (!config.hb_flag(OT_SlaveConfig::dhw_present) ? "dhw not present" : "dhw is present ") << std::endl;
+		ss << "Control type: " << (!config.hb_flag(OT_SlaveConfig::on_off_control) ? "modulating" : "on/off") << std::endl;
+		ss << "Cooling: " << (!config.hb_flag(OT_SlaveConfig::cooling) ? "not supported" : "supported") << std::endl;
+		ss << "DHW config: " << (!config.hb_flag(OT_SlaveConfig::dhw_storage) ? "instantaneous or not-specified" : "storage tank") << std::endl;
+		ss << "Master low-off&pump control function: " << (!config.hb_flag(OT_SlaveConfig::low_off_pump_not_allowed) ? "allowed" : "not allowed") << std::endl;
+		ss << "CH2 present: " << (!config.hb_flag(OT_SlaveConfig::ch2_present) ? "CH2 not present" : "CH2 present") << std::endl;
+		ss << "MemberID: " << int(config.lb()) << std::endl;
 
 		ESP_LOGI(TAG, "slaveConfig: %s", ss.str().c_str());
 	}
-	else
-		repeat(RepeatType::read_slaveConfig);
+	repeat(RepeatType::read_slaveConfig, slaveConfig.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::read_status()
@@ -345,34 +383,24 @@ void	OT_Boiler::read_status()
 	if(out.status == OT_Status::sucsess)
 	{
 		//Разбор статуса котла
-		bool	fault			= out.data & bit_0;
-		bool	centralHeating	= out.data & bit_1;
-		bool	dhw				= out.data & bit_2;
-		bool	flame			= out.data & bit_3;
-
-		if(fault != ot_boiler_state.fault)
-		{
-			ot_boiler_state.fault	= fault;
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "fault").c_str(), fault ? "1" : "0", 0, 0, 0);
-		}
-
-		if(centralHeating != ot_boiler_state.centralHeating)
-		{
-			ot_boiler_state.centralHeating	= centralHeating;
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "centralHeating").c_str(), centralHeating ? "1" : "0", 0, 0, 0);
-		}
-
-		if(dhw != ot_boiler_state.dhw)
-		{
-			ot_boiler_state.dhw	= dhw;
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw").c_str(), dhw ? "1" : "0", 0, 0, 0);
-		}
+		OT_Value	status			= ot_value(0, out.data);
+		bool	fault			= status.lb_flag(OT_SlaveStatus::fault);
+		bool	centralHeating	= status.lb_flag(OT_SlaveStatus::ch_active);
+		bool	dhw				= status.lb_flag(OT_SlaveStatus::dhw_active);
+		bool	flame			= status.lb_flag(OT_SlaveStatus::flame);
 
+		//Розжиг и погасание меняют температуры и модуляцию быстрее всего
 		if(flame != ot_boiler_state.flame)
-		{
-			ot_boiler_state.flame	= flame;
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "flame").c_str(), flame ? "1" : "0", 0, 0, 0);
-		}
+			scheduler.boost();
+
+		ot_boiler_state.fault			= fault;
+		ot_boiler_state.centralHeating	= centralHeating;
+		ot_boiler_state.dhw				= dhw;
+		ot_boiler_state.flame			= flame;
+		telemetry.update(metrics.fault, fault);
+		telemetry.update(metrics.centralHeating, centralHeating);
+		telemetry.update(metrics.dhw, dhw);
+		telemetry.update(metrics.flame, flame);
 
 		//Однократное уведомление в телеграмм при первом появлении ошибки
 		if(ot_boiler_state.fault)
@@ -418,27 +446,16 @@ void	OT_Boiler::read_faultCode()
 	OT_Response	faultCode	= processOT(Command::read, 5, 0);
 	if(faultCode.status	== OT_Status::sucsess)
 	{
-		uint8_t	OEMfaultCode	= faultCode.data & 0xff;
-		uint8_t	faultFlags		= (faultCode.data >> 8);
-
-		if(OEMfaultCode != ot_boiler_state.OEMfaultCode)
-		{
-			ot_boiler_state.OEMfaultCode	= OEMfaultCode;
-			char	value[16];
-			sprintf(value, "%d", OEMfaultCode);
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "OEMfaultCode").c_str(), value, 0, 0, 0);
-		}
-
-		if(faultFlags != ot_boiler_state.faultFlags.all)
-		{
-			ot_boiler_state.faultFlags.all	= faultFlags;
-			char	value[16];
-			sprintf(value, "%d", faultFlags);
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "faultFlags").c_str(), value, 0, 0, 0);
-		}
+		OT_Value	asf			= ot_value(5, faultCode.data);
+		uint8_t	OEMfaultCode	= asf.lb();
+		uint8_t	faultFlags		= asf.hb();
+
+		ot_boiler_state.OEMfaultCode	= OEMfaultCode;
+		ot_boiler_state.faultFlags.all	= faultFlags;
+		telemetry.update(metrics.OEMfaultCode, float(OEMfaultCode));
+		telemetry.update(metrics.faultFlags, float(faultFlags));
 	}
-	else
-		repeat(RepeatType::read_faultCode);
+	repeat(RepeatType::read_faultCode, faultCode.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::read_diagCode()
@@ -447,104 +464,77 @@ void	OT_Boiler::read_diagCode()
 	OT_Response	diagCode	= processOT(Command::read, 115, 0);
 	if(diagCode.status	== OT_Status::sucsess)
 	{
-		if(diagCode.data != ot_boiler_state.diagCode)
-		{
-			ot_boiler_state.diagCode	= diagCode.data;
-			char	value[16];
-			sprintf(value, "%d", diagCode.data);
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "diagCode").c_str(), value, 0, 0, 0);
-		}
+		ot_boiler_state.diagCode	= diagCode.data;
+		telemetry.update(metrics.diagCode, float(diagCode.data));
 	}
-	else
-		repeat(RepeatType::read_diagCode);
+	repeat(RepeatType::read_diagCode, diagCode.status == OT_Status::sucsess);
 }
 
-void	OT_Boiler::read_ch_temp()
+//Параметры, которые опрашиваются одним общим кодом. Новый параметр - новая строка таблицы
+const OT_Boiler::DataDesc	OT_Boiler::data_table[OT_Boiler::data_count]	= {
+	//id	топик				знаков	зона	период	стоит	шаг		приор.
+	{17,	"modulation",		2,		0,		1000,	8000,	1.f,	1},
+	{25,	"ch_temp",			1,		0,		2000,	30000,	0.2f,	2},
+	{26,	"dhw_temp",			1,		0,		2000,	60000,	0.2f,	3},
+	{36,	"flame_current",	2,		0,		5000,	60000,	0.1f,	4},
+	// {28,	"return_temp",		1,		0.1,	10000,	60000,	0.2f,	3},	//Температура обратки, если котёл её поддерживает
+	// {18,	"ch_pressure",		2,		0.05,	60000,	60000,	0.f,	5},	//Давление теплоносителя
+};
+
+//Число из хранилища значений, 0 - значения от котла ещё не было
+static float	stored_number(const OT_DataStore& store, uint8_t id)
 {
-	//Опрос температуры теплоносителя
-	OT_Response	resp	= processOT(Command::read, 25, 0);
-	if(resp.status == OT_Status::sucsess)
-	{
-		float	ch_temp	= resp.get_float();
-		if(ch_temp != ot_boiler_state.ch_temp)
-		{
-			ot_boiler_state.ch_temp	= ch_temp;
-			if(mqtt_client)
-			{
-				char	value[16];
-				sprintf(value, "%.1f", ch_temp);
-				esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp").c_str(), value, 0, 0, 0);
-			}
-		}
-	}
+	OT_Value	value;
+	return store.get(id, &value) ? value.number() : 0.f;
 }
 
-void	OT_Boiler::read_dhw_temp()
+bool	OT_Boiler::poll_data(size_t index)
 {
-	//Опрос температуры теплоносителя
-	OT_Response	resp	= processOT(Command::read, 26, 0);
-	if(resp.status == OT_Status::sucsess)
-	{
-		float	dhw_temp	= resp.get_float();
-		if(dhw_temp != ot_boiler_state.dhw_temp)
-		{
-			ot_boiler_state.dhw_temp	= dhw_temp;
-			if(mqtt_client)
-			{
-				char	value[16];
-				sprintf(value, "%.1f", dhw_temp);
-				esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw_temp").c_str(), value, 0, 0, 0);
-			}
-		}
-	}
-}
+	const DataDesc&	desc	= data_table[index];
+	DataState&		state	= data_state[index];
 
-float	OT_Boiler::read_modulation()
-{
-	//Опрос модуляции горелки
-	OT_Response	resp	= processOT(Command::read, 17, 0);
-	if(resp.status == OT_Status::sucsess)
-	{
-		float	modulation	= resp.get_float();
-		if(modulation != ot_boiler_state.modulation)
-		{
-			ot_boiler_state.modulation	= modulation;
-			if(mqtt_client)
-			{
-				char	value[16];
-				sprintf(value, "%.2f", modulation);
-				esp_mqtt_client_publish(mqtt_client, (boiler_topic + "modulation").c_str(), value, 0, 0, 0);
-			}
-		}
+	OT_Response	resp	= processOT(Command::read, desc.id, 0);
+	if(resp.status != OT_Status::sucsess)
+		return false;
 
-		return modulation;
-	}
+	//processOT уже положил значение в data_store, разбор по типу из спецификации делается при чтении.
+	//Пары байтов сравниваются по сырому значению
+	float	value	= stored_number(data_store, desc.id);
+
+	//Быстро меняющееся значение опрашивается чаще
+	state.changing	= state.has_last && fabsf(value - state.last) >= desc.step;
+	state.last		= value;
+	state.has_last	= true;
 
-	return 0;
+	telemetry.update(state.metric, value);
+	return true;
 }
 
-float	OT_Boiler::read_flame_current()
+bool	OT_Boiler::run_scheduled()
 {
-	//Опрос тока ионизации
-	OT_Response	resp	= processOT(Command::read, 36, 0);
-	if(resp.status == OT_Status::sucsess)
-	{
-		float	flame_current	= resp.get_float();
-		if(flame_current != ot_boiler_state.modulation)
-		{
-			ot_boiler_state.flame_current	= flame_current;
-			if(mqtt_client)
-			{
-				char	value[16];
-				sprintf(value, "%.2f", flame_current);
-				esp_mqtt_client_publish(mqtt_client, (boiler_topic + "flame_current").c_str(), value, 0, 0, 0);
-			}
-		}
-
-		return flame_current;
-	}
+	if(!own_exchange_allowed())
+		return false;
+
+	int64_t	start	= esp_timer_get_time();
+	int		job		= scheduler.next(start);
+	if(job < 0)
+		return false;
+	gateway_slot.store(false);
+
+	bool	polled	= false;
+	if(job == status_job)	read_status();
+	else					polled	= poll_data(job - 1);
+
+	//Период подстраивается только по принятому значению, ошибка обмена его не меняет
+	scheduler.complete(job, start, esp_timer_get_time());
+	if(polled)
+		scheduler.adapt(job, data_state[job - 1].changing);
+	return true;
+}
 
-	return 0;
+int64_t	OT_Boiler::scheduled_in_us() const
+{
+	return scheduler.idle_for_us(esp_timer_get_time());
 }
 
 void	OT_Boiler::set_ch_temp_zad(float ch_temp_zad, bool data_invalid_expected /* = false */)
@@ -553,28 +543,23 @@ void	OT_Boiler::set_ch_temp_zad(float ch_temp_zad, bool data_invalid_expected /*
 	if(ch_temp_zad < 0.)	ch_temp_zad	= 0;
 	if(ch_temp_zad > 100.)	ch_temp_zad	= 100.;
 	ot_boiler_data.ch_temp_zad	= ch_temp_zad;
+	gateway_setpoint.store(uint16_t(ot_boiler_data.ch_temp_zad*256.f));
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "ch_temp_zad", ot_boiler_data.ch_temp_zad);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "ch_temp_zad", ot_boiler_data.ch_temp_zad);
+
+	//При работающем шлюзе ID 1 пишет только термостат: уставка уйдёт в котёл подменой в его запросе
+	if(gateway_active()){
+		telemetry.update(metrics.ch_temp_zad, ch_temp_zad);
+		repeat(RepeatType::set_ch_temp_zad, true);
+		return;
 	}
 
 	//Выполнение запроса
 	OT_Response	resp	= processOT(Command::write, 1, uint16_t(ot_boiler_data.ch_temp_zad*256.f), data_invalid_expected);
 	if(resp.status == OT_Status::sucsess)
-	{
-		if(mqtt_client)
-		{
-			char	value[16];
-			sprintf(value, "%.0f", ch_temp_zad);
-			esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp_zad").c_str(), value, 0, 0, 0);
-		}
-	}
-	else
-		repeat(RepeatType::set_ch_temp_zad);
+		telemetry.update(metrics.ch_temp_zad, ch_temp_zad);
+	repeat(RepeatType::set_ch_temp_zad, resp.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::set_dhw_temp_zad(float dhw_temp_zad, bool data_invalid_expected /* = false */)
@@ -585,27 +570,14 @@ void	OT_Boiler::set_dhw_temp_zad(float dhw_temp_zad, bool data_invalid_expected
 	ot_boiler_data.dhw_temp_zad	= dhw_temp_zad;
 	ot_boiler_data.DHW			= dhw_temp_zad > 0;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "dhw_temp_zad", ot_boiler_data.dhw_temp_zad);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "dhw_temp_zad", ot_boiler_data.dhw_temp_zad);
 
 	//Выполнение запроса
 	OT_Response	resp	= processOT(Command::write, 56, uint16_t(ot_boiler_data.dhw_temp_zad*256.f), data_invalid_expected);
 	if(resp.status == OT_Status::sucsess)
-	{
-		if(mqtt_client)
-		{
-			char	value[16];
-			sprintf(value, "%.0f", dhw_temp_zad);
-			esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw_temp_zad").c_str(), value, 0, 0, 0);
-		}
-	}
-	else
-		repeat(RepeatType::set_dhw_temp_zad);
+		telemetry.update(metrics.dhw_temp_zad, dhw_temp_zad);
+	repeat(RepeatType::set_dhw_temp_zad, resp.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::set_ch_temp_max(float ch_temp_max)
@@ -615,27 +587,14 @@ void	OT_Boiler::set_ch_temp_max(float ch_temp_max)
 	if(ch_temp_max > 127.)	ch_temp_max	= 127.;
 	ot_boiler_data.ch_temp_max	= ch_temp_max;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "ch_temp_max", ot_boiler_data.ch_temp_max);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "ch_temp_max", ot_boiler_data.ch_temp_max);
 
 	//Выполнение запроса
 	OT_Response	resp	= processOT(Command::write, 57, uint16_t(ot_boiler_data.ch_temp_max*256.f));
 	if(resp.status == OT_Status::sucsess)
-	{
-		if(mqtt_client)
-		{
-			char	value[16];
-			sprintf(value, "%.0f", ch_temp_max);
-			esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp_max").c_str(), value, 0, 0, 0);
-		}
-	}
-	else
-		repeat(RepeatType::set_ch_temp_max);
+		telemetry.update(metrics.ch_temp_max, ch_temp_max);
+	repeat(RepeatType::set_ch_temp_max, resp.status == OT_Status::sucsess);
 }
 
 void	OT_Boiler::set_ch_mod_max(float ch_mod_max, bool data_invalid_expected /* = false */)
@@ -645,27 +604,14 @@ void	OT_Boiler::set_ch_mod_max(float ch_mod_max, bool data_invalid_expected /* =
 	if(ch_mod_max > 100.)	ch_mod_max	= 100.;
 	ot_boiler_data.ch_mod_max	= ch_mod_max;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "ch_mod_max", ot_boiler_data.ch_mod_max);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "ch_mod_max", ot_boiler_data.ch_mod_max);
 
 	//Выполнение запроса
 	OT_Response	resp	= processOT(Command::write, 14, uint16_t(ot_boiler_data.ch_mod_max*256.f), data_invalid_expected);
 	if(resp.status == OT_Status::sucsess)
-	{
-		if(mqtt_client)
-		{
-			char	value[16];
-			sprintf(value, "%.0f", ch_mod_max);
-			esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_mod_max").c_str(), value, 0, 0, 0);
-		}
-	}
-	else
-		repeat(RepeatType::set_ch_mod_max);
+		telemetry.update(metrics.ch_mod_max, ch_mod_max);
+	repeat(RepeatType::set_ch_mod_max, resp.status == OT_Status::sucsess);
 }
 
 bool	OT_Boiler::BLOR()
@@ -674,31 +620,25 @@ bool	OT_Boiler::BLOR()
 	OT_Response	resp	= processOT(Command::write, 4, 1);	//Boiler Lock-out Reset request
 	resp	= processOT(Command::write, 4, 10);				//Request to reset service request flag
 	resp	= processOT(Command::write, 4, 0);				//Back to Normal oparation mode
-	if(resp.status == OT_Status::sucsess)
-	{
-		if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (boiler_topic + "BLOR").c_str(), (resp.data > 128 ? "done" : "failed"), 0, 0, 0);
-		return resp.data > 128;
-	}
-	else
-		repeat(RepeatType::BLOR);
 
-	return false;
+	//Результат учитывается в обоих случаях: удачный повтор должен освободить слот
+	bool	ok		= resp.status == OT_Status::sucsess;
+	bool	done	= ok && resp.data > 128;
+	if(ok && mqtt_client)
+		mqtt_publish(topics.BLOR, (done ? "done" : "failed"));
+	repeat(RepeatType::BLOR, ok);
+
+	return done;
 }
 
 void	OT_Boiler::set_CH(bool CH)
 {
 	ot_boiler_data.CH	= CH;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "CH", ot_boiler_data.CH);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "CH", ot_boiler_data.CH);
 
-	if(mqtt_client)
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "control/CH").c_str(), ot_boiler_data.CH ? "1" : "0", 0, 0, 0);
+	telemetry.update(metrics.control_CH, ot_boiler_data.CH);
 
 	//Установка вместе с модуляцией
 	read_status();
@@ -709,16 +649,10 @@ void	OT_Boiler::set_DHW(bool DHW)
 {
 	ot_boiler_data.DHW	= DHW;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "DHW", ot_boiler_data.DHW);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "DHW", ot_boiler_data.DHW);
 
-	if(mqtt_client)
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "control/DHW").c_str(), ot_boiler_data.DHW ? "1" : "0", 0, 0, 0);
+	telemetry.update(metrics.control_DHW, ot_boiler_data.DHW);
 
 	read_status();
 }
@@ -727,16 +661,10 @@ void	OT_Boiler::set_SummerMode(bool SummerMode)
 {
 	ot_boiler_data.SummerMode	= SummerMode;
 
-	//Запоминание
-	nvs_handle_t	nvs_settings;
-	if(nvs_open("boiler", NVS_READWRITE, &nvs_settings) == ESP_OK){
-		nvs_set_u8(nvs_settings, "SummerMode", ot_boiler_data.SummerMode);
-		nvs_commit(nvs_settings);
-		nvs_close(nvs_settings);
-	}
+	//Запоминание (запись в NVS отложена)
+	settings_cache.set_u8(nvs_namespace.c_str(), "SummerMode", ot_boiler_data.SummerMode);
 
-	if(mqtt_client)
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "control/SummerMode").c_str(), ot_boiler_data.SummerMode ? "1" : "0", 0, 0, 0);
+	telemetry.update(metrics.control_SummerMode, ot_boiler_data.SummerMode);
 
 	read_status();
 }
@@ -752,6 +680,12 @@ void	OT_Boiler::sendNotification(const std::string& text)
 
 void	OT_Boiler::print_status(std::ostringstream& ss) const
 {
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	read_snapshot(*s);
+	const ot_boiler_state_t&	ot_boiler_state	= s->state;
+	const ot_boiler_data_t&		ot_boiler_data	= s->data;
+	const OT_FailsCounter&		failsCounter	= s->fails;
+
 	if(ot_boiler_state.fault)
 	{
 		ss << "*ОШИБКА* " << std::endl;
@@ -767,10 +701,10 @@ void	OT_Boiler::print_status(std::ostringstream& ss) const
 	ss << "*Отопление* " << (ot_boiler_state.centralHeating ? "вкл" : "откл") << std::endl;
 	ss << "*ГВС* " << (ot_boiler_state.dhw ? "вкл" : "откл") << std::endl;
 	if(ot_boiler_state.flame)
-		ss << "*Горелка* " << "🔥" << ot_boiler_state.modulation << "%" << std::endl;
+		ss << "*Горелка* " << "🔥" << stored_number(s->data_store, 17) << "%" << std::endl;
 	else
 		ss << "*Горелка* откл" << std::endl;
-	ss << "*Теплоноситель*  " << ot_boiler_state.ch_temp << " ℃" << std::endl;
+	ss << "*Теплоноситель*  " << stored_number(s->data_store, 25) << " ℃" << std::endl;
 	ss << "*Заданная*  " << ot_boiler_data.ch_temp_zad << " ℃" << std::endl;
 
 	ss << "*failsCounter*" << std::endl;
@@ -790,19 +724,25 @@ void	OT_Boiler::print_status(std::ostringstream& ss) const
 
 json	OT_Boiler::json_status() const
 {
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	uint32_t	generation	= read_snapshot(*s);
+	const ot_boiler_state_t&	ot_boiler_state	= s->state;
+	const ot_boiler_data_t&		ot_boiler_data	= s->data;
+	const OT_FailsCounter&		failsCounter	= s->fails;
 	return json{
+		{"generation", generation},
 		{"centralHeating", ot_boiler_state.centralHeating},
 		{"dhw",  ot_boiler_state.dhw},
 		{"flame",  ot_boiler_state.flame},
-		{"flame_current",  ot_boiler_state.flame_current},
+		{"flame_current",  stored_number(s->data_store, 36)},
 		{"fault",  ot_boiler_state.fault},
 		{"faultFlags",  ot_boiler_state.faultFlags.all},
 		{"faultCode",  ot_boiler_state.OEMfaultCode},
 		{"diagCode",  ot_boiler_state.diagCode},
-		{"ch_temp",  ot_boiler_state.ch_temp},
-		{"dhw_temp",  ot_boiler_state.dhw_temp},
+		{"ch_temp",  stored_number(s->data_store, 25)},
+		{"dhw_temp",  stored_number(s->data_store, 26)},
 		{"dhw_temp_zad", ot_boiler_data.dhw_temp_zad},
-		{"modulation",  ot_boiler_state.modulation},
+		{"modulation",  stored_number(s->data_store, 17)},
 		{"ch_temp_zad", ot_boiler_data.ch_temp_zad},
 		{"ch_temp_max", ot_boiler_data.ch_temp_max},
 		{"ch_mod_max", ot_boiler_data.ch_mod_max},
@@ -818,10 +758,303 @@ json	OT_Boiler::json_status() const
 			{"SPARE_fail", failsCounter.SPARE_fail},
 			{"responseID_fail", failsCounter.responseID_fail},
 			{"uptime", uint64_t(esp_timer_get_time()*0.000001)}
+		}},
+		{"bus", json_bus_stats(*s)},
+		{"scheduler", json_scheduler(*s)},
+		{"capabilities", json_capabilities(s->capabilities)},
+		{"ids", json_id_stats(s->id_stats)},
+		{"data", json_data_store(s->data_store)},
+		{"repeat", {
+			{"pending", s->repeats_pending},
+			{"queued", s->repeat.queued},
+			{"coalesced", s->repeat.coalesced},
+			{"retried", s->repeat.retried},
+			{"succeeded", s->repeat.succeeded},
+			{"given_up", s->repeat.given_up},
+			{"unreported", s->repeat.unreported},
+			{"budget", s->repeat_budget}
+		}}
+	};
+}
+
+void	OT_Boiler::load_capabilities()
+{
+	uint8_t			blob[OT_Capabilities::blob_size];
+	size_t			size	= sizeof(blob);
+	bool			loaded	= false;
+	nvs_handle_t	nvs_settings;
+	if(nvs_open(nvs_namespace.c_str(), NVS_READONLY, &nvs_settings) == ESP_OK)
+	{
+		loaded	= nvs_get_blob(nvs_settings, "capabilities", blob, &size) == ESP_OK && capabilities.parse(blob, size);
+		nvs_close(nvs_settings);
+	}
+
+	if(loaded && capabilities.is_complete()){
+		ESP_LOGI(TAG, "%s: карта ID загружена, поддерживается %d", nvs_namespace.c_str(),
+			int(capabilities.count(OT_Support::supported) + capabilities.count(OT_Support::read_only)));
+		apply_capabilities();
+
+		//ID без ответа проверяются заново: при обходе котёл мог быть выключен
+		if(capabilities.reprobe())
+			ESP_LOGI(TAG, "%s: повторная проверка %d ID без ответа", nvs_namespace.c_str(), int(capabilities.count(OT_Support::no_response)));
+	}
+	else
+		capabilities.start();
+}
+
+void	OT_Boiler::save_capabilities() const
+{
+	//Карта уходит в кэш настроек: nvs_commit в задаче settings, а не в цикле обмена с котлом
+	uint8_t		blob[OT_Capabilities::blob_size];
+	size_t		size	= capabilities.serialize(blob, sizeof(blob));
+	settings_cache.set_blob(nvs_namespace.c_str(), "capabilities", blob, size);
+}
+
+void	OT_Boiler::apply_capabilities()
+{
+	int64_t	now	= esp_timer_get_time();
+	for(size_t i = 0; i < data_count; i++)
+		scheduler.set_enabled(i + 1, !capabilities.is_unsupported(data_table[i].id), now);
+}
+
+void	OT_Boiler::start_sweep()
+{
+	capabilities.start();
+	apply_capabilities();
+}
+
+bool	OT_Boiler::run_sweep()
+{
+	if(!own_exchange_allowed())
+		return false;
+
+	int	id	= capabilities.next_probe();
+	if(id < 0)
+		return false;
+	gateway_slot.store(false);
+
+	//Обмен напрямую через кодек: ответ UNKNOWN_DATAID здесь - результат, а не ошибка связи
+	OT_Response	out	= ot_exchange(*rmt_ot, Command::read, uint8_t(id), 0, false, sweep_fails);
+	record(out);
+	snapshot_dirty	= true;
+	bool	retry	= capabilities.reprobing();
+	capabilities.probe_result(uint8_t(id), out.status);
+
+	if(capabilities.next_probe() < 0)
+	{
+		save_capabilities();
+		apply_capabilities();
+
+		if(retry){
+			ESP_LOGI(TAG, "%s: повторная проверка завершена, ответили %d, нет ответа %d", nvs_namespace.c_str(),
+				int(capabilities.reprobe_recovered()), int(capabilities.count(OT_Support::no_response)));
+			return true;
+		}
+
+		std::ostringstream	ss;
+		ss << "Обход ID котла " << nvs_namespace << " завершён" << std::endl;
+		ss << "Поддерживается: " << capabilities.count(OT_Support::supported) + capabilities.count(OT_Support::read_only) << std::endl;
+		ss << "Нет данных: " << capabilities.count(OT_Support::data_invalid) << std::endl;
+		ss << "Неизвестно котлу: " << capabilities.count(OT_Support::unknown) << std::endl;
+		ss << "Нет ответа: " << capabilities.count(OT_Support::no_response);
+		ESP_LOGI(TAG, "%s", ss.str().c_str());
+		sendNotification(ss.str());
+	}
+
+	return true;
+}
+
+json	OT_Boiler::json_capabilities() const
+{
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	read_snapshot(*s);
+	return json_capabilities(s->capabilities);
+}
+
+json	OT_Boiler::json_data_store(const OT_DataStore& store)
+{
+	//Ключ - имя ID по спецификации, пары байтов - массивом [старший, младший]
+	json	res	= json::object();
+	for(size_t i = 0; i < store.size(); i++)
+	{
+		const OT_DataIdDesc*	desc	= ot_data_desc(store.id(i));
+		std::string		name	= desc ? desc->name : "id" + std::to_string(store.id(i));
+		OT_Value		value	= store.value(i);
+		switch(value.type)
+		{
+			case OT_DataType::f8_8:		res[name]	= value.f8_8();							break;
+			case OT_DataType::u16:		res[name]	= value.raw;							break;
+			case OT_DataType::s16:		res[name]	= value.s16();							break;
+			case OT_DataType::s8_s8:	res[name]	= {value.hb_s8(), value.lb_s8()};		break;
+			default:					res[name]	= {value.hb(), value.lb()};				break;
+		}
+	}
+	return res;
+}
+
+json	OT_Boiler::json_id_stats() const
+{
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	read_snapshot(*s);
+	return json_id_stats(s->id_stats);
+}
+
+json	OT_Boiler::json_id_stats(const OT_IdStats& stats)
+{
+	auto	json_entry	= [](const OT_IdStats::Entry& e){
+		json	statuses	= json::object();
+		for(size_t i = 0; i < OT_IdStats::status_count; i++)
+			if(e.status[i])
+				statuses[ot_status_to_string(static_cast<OT_Status>(i))]	= e.status[i];
+
+		json	res	= {
+			{"attempts", e.attempts},
+			{"status", statuses}
+		};
+		if(e.responses)
+			res["response_ms"]	= {
+				{"min", e.response_min_ms},
+				{"avg", double(e.response_sum_ms)/e.responses},
+				{"max", e.response_max_ms},
+				{"histogram", e.histogram}
+			};
+		return res;
+	};
+
+	json	ids	= json::object();
+	for(size_t i = 0; i < stats.size(); i++)
+		ids[std::to_string(stats.entry(i).id)]	= json_entry(stats.entry(i));
+	if(stats.overflow().attempts)
+		ids["other"]	= json_entry(stats.overflow());
+
+	const OT_IdStats::Gap&	gap	= stats.gap();
+	return json{
+		{"response_bounds_ms", OT_IdStats::response_bounds_ms},
+		{"ids", ids},
+		{"gap_ms", {
+			{"count", gap.count},
+			{"min", gap.count ? gap.min_us*0.001 : 0.},
+			{"avg", gap.count ? gap.sum_us*0.001/gap.count : 0.},
+			{"max", gap.max_us*0.001},
+			{"bounds", OT_IdStats::gap_bounds_ms},
+			{"histogram", gap.histogram}
 		}}
 	};
 }
 
+json	OT_Boiler::json_capabilities(const OT_Capabilities& capabilities)
+{
+	json	res	= {
+		{"complete", capabilities.is_complete()},
+		{"sweeping", capabilities.sweeping()},
+		{"reprobing", capabilities.reprobing()},
+		{"progress", capabilities.progress()}
+	};
+
+	//Списки ID по классам, кроме неизвестных котлу (их большинство) и неопрошенных
+	const OT_Support	listed[]	= {OT_Support::supported, OT_Support::read_only, OT_Support::data_invalid, OT_Support::no_response};
+	for(OT_Support support : listed)
+		res[OT_Capabilities::to_string(support)]	= json::array();
+	for(size_t id = 0; id < OT_Capabilities::id_count; id++)
+	{
+		OT_Support	support	= capabilities.get(uint8_t(id));
+		if(support != OT_Support::unknown && support != OT_Support::untested)
+			res[OT_Capabilities::to_string(support)].push_back(id);
+	}
+	res["unknown"]	= capabilities.count(OT_Support::unknown);
+
+	return res;
+}
+
+json	OT_Boiler::json_scheduler(const Snapshot& s)
+{
+	const OT_Scheduler&	scheduler	= s.scheduler;
+	int64_t	now		= esp_timer_get_time();
+	json	jobs	= json::array();
+	for(size_t i = 0; i < scheduler.size(); i++)
+	{
+		const OT_Scheduler::Job&	job	= scheduler.job(i);
+		jobs.push_back({
+			{"id", job.id},
+			{"enabled", job.enabled},
+			{"period_ms", job.period_ms},
+			{"max_period_ms", job.max_period_ms},
+			{"runs", job.runs},
+			{"misses", job.misses},
+			{"max_late_ms", job.max_late_us*0.001}
+		});
+	}
+
+	const OT_Scheduler::Stats&	stats	= scheduler.stats();
+	return json{
+		{"runs", stats.runs},
+		{"deadline_misses", stats.misses},
+		{"utilization", scheduler.utilization(now)},
+		{"demand", scheduler.demand()},
+		{"exchange_ms", stats.cost_us*0.001},
+		{"jobs", jobs}
+	};
+}
+
+json	OT_Boiler::json_bus_stats(const Snapshot& s)
+{
+	double	elapsed	= (esp_timer_get_time() - s.bus_start_time)*0.000001;
+	return json{
+		{"frames", s.bus_frames},
+		{"timeouts", s.bus_timeouts},
+		{"frames_per_s", elapsed > 0 ? s.bus_frames/elapsed : 0.},
+		{"utilization", elapsed > 0 ? s.bus_busy_us*0.000001/elapsed : 0.},
+		{"idle_wait_s", s.bus_idle_wait_us*0.000001},
+		{"last_response_ms", s.bus_last_response_us*0.001},
+		{"clock", {
+			{"half_bit_us", s.clock_half_bit_q4/16.},
+			{"asymmetry_us", s.clock_asymmetry_q4/16.},
+			{"updates", s.clock_updates}
+		}}
+	};
+}
+
+void	OT_Boiler::publish()
+{
+	if(!snapshot_dirty)
+		return;
+	snapshot_dirty	= false;
+
+	//Снимок собирается в буфере-члене, а не в локальной переменной: он занимает несколько килобайт.
+	//Сам OT_Boiler создаётся в куче (boiler_task), поэтому буфер не расходует стек задачи котла
+	Snapshot*	s	= &snapshot_staging;
+	s->state			= ot_boiler_state;
+	s->data				= ot_boiler_data;
+	s->fails			= failsCounter;
+	s->error_counter	= error_counter;
+	s->repeat			= repeats.stats();
+	s->repeats_pending	= repeats.pending();
+	s->repeat_budget	= repeats.budget_left();
+	s->scheduler		= scheduler;
+	s->capabilities		= capabilities;
+	s->id_stats			= id_stats;
+	s->data_store		= data_store;
+
+	const RMT_Opentherm::BusStats&	stats	= rmt_ot->stats();
+	const OT_Decoder::Clock&		clock	= rmt_ot->clock();
+	s->bus_frames			= stats.frames;
+	s->bus_timeouts			= stats.timeouts;
+	s->bus_busy_us			= stats.busy_us;
+	s->bus_idle_wait_us		= stats.idle_wait_us;
+	s->bus_last_response_us	= stats.last_response_us;
+	s->bus_start_time		= stats.start_time;
+	s->clock_half_bit_q4	= clock.half_bit_q4;
+	s->clock_asymmetry_q4	= clock.asymmetry_q4;
+	s->clock_updates		= clock.updates;
+
+	snapshot.write(*s);
+}
+
+int64_t	OT_Boiler::bus_ready_in_us() const
+{
+	return rmt_ot->bus_ready_in_us();
+}
+
 void	OT_Boiler::log_head(std::ostringstream& ss) const
 {
 	ss << "CH; DHW; flame; ch_temp; dhw_temp; modulation; ch_temp_zad; dhw_temp_zad";
@@ -829,19 +1062,25 @@ void	OT_Boiler::log_head(std::ostringstream& ss) const
 
 void	OT_Boiler::log_data(std::ostringstream& ss) const
 {
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	read_snapshot(*s);
+	const ot_boiler_state_t&	ot_boiler_state	= s->state;
+	const ot_boiler_data_t&		ot_boiler_data	= s->data;
 	ss << (ot_boiler_state.centralHeating ? "1" : "0") << "; ";
 	ss << (ot_boiler_state.dhw ? "1" : "0") << "; ";
 	ss << (ot_boiler_state.flame ? "1" : "0") << "; ";
-	ss << ot_boiler_state.ch_temp << "; ";
-	ss << ot_boiler_state.dhw_temp << "; ";
-	ss << ot_boiler_state.modulation << "; ";
+	ss << stored_number(s->data_store, 25) << "; ";
+	ss << stored_number(s->data_store, 26) << "; ";
+	ss << stored_number(s->data_store, 17) << "; ";
 	ss << ot_boiler_data.ch_temp_zad << "; ";
 	ss << ot_boiler_data.dhw_temp_zad << "; ";
 }
 
 bool	OT_Boiler::openTherm_is_correct() const
 {
-	return error_counter < 5;
+	std::unique_ptr<Snapshot>	s(new Snapshot);
+	read_snapshot(*s);
+	return s->error_counter < 5;
 }
 
 json	OT_Boiler::set_boiler_data(const json& j)
@@ -892,41 +1131,6 @@ json	OT_Boiler::set_boiler_data(const json& j)
 	return res;
 }
 
-void	OT_Boiler::send_all_mqtt()
-{
-	if(mqtt_client)
-	{
-		char	value[16];
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "fault").c_str(), ot_boiler_state.fault ? "1" : "0", 0, 0, 0);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "centralHeating").c_str(), ot_boiler_state.centralHeating ? "1" : "0", 0, 0, 0);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw").c_str(), ot_boiler_state.dhw ? "1" : "0", 0, 0, 0);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "flame").c_str(), ot_boiler_state.flame ? "1" : "0", 0, 0, 0);
-
-		sprintf(value, "%d", int(ot_boiler_state.OEMfaultCode));
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "OEMfaultCode").c_str(), value, 0, 0, 0);
-		sprintf(value, "%d", ot_boiler_state.faultFlags.all);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "faultFlags").c_str(), value, 0, 0, 0);
-		sprintf(value, "%d", int(ot_boiler_state.diagCode));
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "diagCode").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_state.ch_temp);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_state.dhw_temp);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw_temp").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.2f", ot_boiler_state.modulation);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "modulation").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.2f", ot_boiler_state.flame_current);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "flame_current").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_data.ch_temp_zad);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp_zad").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_data.dhw_temp_zad);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "dhw_temp_zad").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_data.ch_temp_max);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_temp_max").c_str(), value, 0, 0, 0);
-		sprintf(value, "%.0f", ot_boiler_data.ch_mod_max);
-		esp_mqtt_client_publish(mqtt_client, (boiler_topic + "ch_mod_max").c_str(), value, 0, 0, 0);
-	}
-}
-
 json	OT_Boiler::test_ot_command(json ot_data)
 {
 	json	res;
@@ -951,7 +1155,7 @@ json	OT_Boiler::test_ot_command(json ot_data)
 		OT_Message_t	response;
 		response.all	= out.response;
 		res	= {
-			{"status", OT_Status_to_string(out.status)},
+			{"status", ot_status_to_string(out.status)},
 			{"data", out.data},
 			{"response", {
 				{"all", response.all},
@@ -967,25 +1171,6 @@ json	OT_Boiler::test_ot_command(json ot_data)
 	return res;
 }
 
-std::string	OT_Boiler::OT_Status_to_string(const OT_Boiler::OT_Status& status)
-{
-	switch(status)
-	{
-		case OT_Status::sucsess:			return "sucsess";
-		case OT_Status::notInited:			return "notInited";
-		case OT_Status::timeout:			return "timeout";
-		case OT_Status::rx_invalid:			return "rx_invalid";
-		case OT_Status::parityFail:			return "parityFail";
-		case OT_Status::unknownID:			return "unknownID";
-		case OT_Status::dataInvalid:		return "dataInvalid";
-		case OT_Status::ACK_fail:			return "ACK_fail";
-		case OT_Status::msgType_unknown:	return "msgType_unknown";
-		case OT_Status::SPARE_fail:			return "SPARE_fail";
-		case OT_Status::responseID_fail:	return "responseID_fail";
-		default:							return "wrong_status";
-	}
-}
-
 bool	OT_Boiler::is_CH_on()
 {
 	return ot_boiler_data.CH;
@@ -2,7 +2,18 @@
 #define OT_BOILER_H
 
 #include <string>
-#include <queue>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "ot_protocol.h"
+#include "ot_exchange.h"
+#include "ot_recorder.h"
+#include "ot_scheduler.h"
+#include "ot_repeat.h"
+#include "ot_capability.h"
+#include "ot_seqlock.h"
+#include "ot_id_stats.h"
+#include "ot_data.h"
 class RMT_Opentherm;
 
 class OT_Boiler
@@ -10,32 +21,7 @@ class OT_Boiler
 private:
 	RMT_Opentherm*	rmt_ot	= nullptr;
 
-	//Формат сообщения OpenTherm
-	union OT_Message_t
-	{
-		struct {
-			uint16_t	data		:16;	//Data value
-			uint8_t		id			:8;		//Data ID
-			uint8_t		spare		:4;		//SPARE
-			uint8_t		msg_type	:3;		//Message type
-			uint8_t		parity		:1;		//Бит четности
-		}bit;
-		uint32_t	all	= 0;
-	};
-
-	enum class MsgType: uint8_t{
-		//Master to slave
-		READ_DATA 		= 0b000,
-		WRITE_DATA 		= 0b001,
-		INVALID_DATA	= 0b010,
-		reserved		= 0b011,
-
-		//Slave to master
-		READ_ACK		= 0b100,
-		WRITE_ACK		= 0b101,
-		DATA_INVALID	= 0b110,
-		UNKNOWN_DATAID	= 0b111
-	};
+	using MsgType	= OT_MsgType;
 
 	//Состояние котла
 	struct ot_boiler_state_t
@@ -59,10 +45,7 @@ private:
 		FaultFlags_t	faultFlags;		//Флаги ошибки
 		uint8_t		OEMfaultCode = 0;	//Код ошибки
 		uint32_t	diagCode	= 0;	//OEM диагностический код
-		float		ch_temp;			//Температура отопления
-		float		dhw_temp;			//Температура горячей воды
-		float		modulation;			//Модуляция горелки, %
-		float		flame_current;		//Ток ионизации
+		//Температуры, модуляция и ток ионизации - только в data_store
 	}ot_boiler_state;
 
 	//Заданные параметры котла
@@ -83,58 +66,140 @@ private:
 
 	std::string	boiler_topic;
 	std::string	boiler_OT_topic;
+	std::string	nvs_namespace;			//Раздел NVS с настройками котла, свой для каждой шины
 	int		slaveID	= 4;				//Код для перевода котла в slave
 
-	struct FailsCounter
+	//Дескрипторы топиков MQTT (mqtt_topic_t), собираются один раз в конструкторе
+	//Телеметрия состояния (публикуется по правилам Telemetry)
+	struct Metrics
 	{
-		uint32_t	notInited		= 0;
-		uint32_t	timeout			= 0;
-		uint32_t	rx_invalid		= 0;
-		uint32_t	parityFail		= 0;
-		uint32_t	unknownID		= 0;
-		uint32_t	dataInvalid		= 0;
-		uint32_t	ACK_fail		= 0;
-		uint32_t	msgType_unknown	= 0;
-		uint32_t	SPARE_fail		= 0;
-		uint32_t	responseID_fail	= 0;
-	}failsCounter;
-
-	bool	check_parity(uint32_t	word);
-	void	sendNotification(const std::string& text);
+		uint16_t	fault, centralHeating, dhw, flame, OEMfaultCode, faultFlags, diagCode;
+		uint16_t	ch_temp_zad, dhw_temp_zad, ch_temp_max, ch_mod_max;
+		uint16_t	control_CH, control_DHW, control_SummerMode;
+	}metrics;
 
-	//Основная функция обмена с котлом
-	enum class OT_Status: uint8_t{sucsess, notInited, timeout, rx_invalid, parityFail, unknownID, dataInvalid, ACK_fail, msgType_unknown, SPARE_fail, responseID_fail};
-	struct	OT_Response
+	//События (публикуются сразу и без повторов)
+	struct Topics
 	{
-		OT_Status	status;
-		uint16_t	data;
-		uint32_t	response;
+		uint16_t	BLOR, fails;
+	}topics;
 
-		float	get_float()	{return (data & 32768) ? -(65536 - data)/256.f : data/256.f;}
-	};
-	enum class Command: uint8_t {read, write, invalid};
+	OT_FailsCounter	failsCounter;
+	OT_IdStats		id_stats;			//Исходы и время ответа по каждому ID, кроме обхода
+	OT_DataStore	data_store;			//Последние принятые значения по ID
+
+	//Самописец последних обменов с исходными символами приёма. Выгружается из других задач
+	static constexpr size_t	recorder_capacity	= 64;
+	OT_Recorder			recorder{recorder_capacity};
+	mutable std::mutex	recorder_mutex;
+	void	record(const OT_Response& out);
+
+	void	sendNotification(const std::string& text);
 
+	//Основная функция обмена с котлом
+	using Command	= OT_Command;
 	OT_Response	processOT(const Command cmd, const uint8_t id, const uint16_t data, bool invalid_data_expected = false);
 
-	std::string	OT_Status_to_string(const OT_Status& status);
+	//Повтор неудачных обменов (OT_Repeats): слот на каждый тип команды
+	enum class RepeatType: uint8_t{set_slave, read_slaveConfig, read_status, read_faultCode, read_diagCode,
+		set_ch_temp_zad, set_dhw_temp_zad, set_ch_temp_max, set_ch_mod_max, BLOR, none};
+	static_assert(static_cast<size_t>(RepeatType::none) <= OT_Repeats::max_types, "OT_Repeats slots");
+	OT_Repeats	repeats;
+
+	void	repeat(RepeatType msg, bool ok);	//Учёт результата обмена, который надо повторить при ошибке
+	static const char*	repeat_to_string(RepeatType msg);
 
-	//Очередь сообщений, которые необходимо повторить
-	enum class RepeatType: uint8_t{set_slave, read_slaveConfig, read_status, read_faultCode, read_diagCode, read_ch_temp, read_dhw_temp, read_modulation,
-		set_ch_temp_zad, set_dhw_temp_zad, set_ch_temp_max, set_ch_mod_max, BLOR};
-	struct RepeatQueue_t
+	//Параметры котла, которые опрашиваются и публикуются по таблице data_table
+	struct DataDesc
 	{
-		RepeatType	msg;
-		uint8_t		counter;
+		uint8_t			id;			//Тип поля данных берётся из спецификации (ot_data_type)
+		const char*		topic;		//Подтопик boiler_topic
+		uint8_t			precision;	//Знаков после запятой при публикации числа
+		float			deadband;	//Изменение, меньше которого значение не публикуется
+		uint16_t		period_ms;		//Период опроса, пока значение меняется
+		uint16_t		max_period_ms;	//Период опроса стоящего значения (равен period_ms - без подстройки)
+		float			step;			//Изменение между опросами, при котором значение считается меняющимся
+		uint8_t			priority;		//Приоритет в планировщике (0 - самый важный)
 	};
-	std::queue<RepeatQueue_t>	repeat_queue;
-
-	void	repeat(RepeatType	msg);
+	struct DataState
+	{
+		uint16_t	metric;				//Метрика Telemetry, собирается в конструкторе
+		float		last		= 0;	//Значение прошлого опроса
+		bool		has_last	= false;
+		bool		changing	= false;	//Итог прошлого опроса для подстройки периода
+	};
+	static constexpr size_t	data_count	= 4;
+	static const DataDesc	data_table[data_count];
+	DataState				data_state[data_count];
+
+	bool	poll_data(size_t index);	//Чтение, разбор и публикация при изменении
+
+	//Расписание опроса: статус (ID 0) не реже 1 Гц по спецификации, затем строки data_table
+	static constexpr uint32_t	status_period_ms	= 1000;
+	static constexpr size_t		status_job			= 0;
+	OT_Scheduler	scheduler;
+
+	//Карта поддерживаемых ID: однократный обход в свободные окна шины, результат хранится в NVS.
+	//Обмены обхода не учитываются в failsCounter и не публикуются в fails: UNKNOWN_DATAID здесь ожидаем
+	OT_Capabilities	capabilities;
+	OT_FailsCounter	sweep_fails;
+	void	load_capabilities();
+	void	save_capabilities() const;
+	void	apply_capabilities();		//Отключение в расписании опроса ID, которые котёл не поддерживает
+
+	//Шлюз комнатного термостата на этой шине (OT_Gateway). Пока кадры термостата идут, шина принадлежит ему:
+	//собственный опрос, повторы и обход - только в окне сразу после пересылки, один обмен на кадр термостата,
+	//а уставка теплоносителя (ID 1) не пишется в котёл, а подставляется шлюзом в запись ID 1 термостата
+	static constexpr int64_t	gateway_hold_us		= 5000000;	//Шлюз активен, пока кадры термостата идут чаще
+	static constexpr int64_t	gateway_slot_us		= 100000;	//Окно собственного обмена: термостат ждёт не меньше 100 мс
+	std::atomic<int64_t>		gateway_relay_us{0};			//Окончание последней пересылки
+	std::atomic<bool>			gateway_slot{false};			//Окно после пересылки ещё не занято
+	std::atomic<uint16_t>		gateway_setpoint{0xffff};		//Уставка ID 1 в f8.8 для шлюза, 0xffff - не задана
+	bool	own_exchange_allowed() const;	//Задача котла: можно ли сейчас занять шину своим обменом (занятие - gateway_slot = false)
+
+	//Согласованная копия состояния для задач TCP, Telegram и логгера. Они работают на другом ядре,
+	//поэтому читают только снимок, который задача котла публикует после обменов, и не ждут шину
+	struct Snapshot
+	{
+		ot_boiler_state_t	state;
+		ot_boiler_data_t	data;
+		OT_FailsCounter		fails;
+		int					error_counter;
+		OT_Repeats::Stats	repeat;
+		uint8_t				repeats_pending;
+		float				repeat_budget;
+		OT_Scheduler		scheduler;
+		OT_Capabilities		capabilities;
+		OT_IdStats			id_stats;
+		OT_DataStore		data_store;
+		uint32_t			bus_frames;
+		uint32_t			bus_timeouts;
+		int64_t				bus_busy_us;
+		int64_t				bus_idle_wait_us;
+		int64_t				bus_last_response_us;
+		int64_t				bus_start_time;
+		int32_t				clock_half_bit_q4;
+		int32_t				clock_asymmetry_q4;
+		uint32_t			clock_updates;
+	};
+	OT_Seqlock<Snapshot>	snapshot;
+	Snapshot				snapshot_staging;	//Сборка снимка в publish, только задача котла. С живыми объектами и снимком
+												//котёл занимает ~14 КБ, поэтому создаётся в куче, а не на стеке задачи
+	bool					snapshot_dirty	= true;
+	uint32_t	read_snapshot(Snapshot& s) const	{return snapshot.read(&s);}
+	static json	json_scheduler(const Snapshot& s);
+	static json	json_bus_stats(const Snapshot& s);
+	static json	json_capabilities(const OT_Capabilities& capabilities);
+	static json	json_id_stats(const OT_IdStats& stats);
+	static json	json_data_store(const OT_DataStore& store);
 
 public:
-	OT_Boiler(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic, const std::string& OT_topic, const int slaveID);
+	OT_Boiler(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic, const std::string& OT_topic, const int slaveID, const std::string& nvs_name = "boiler");
 
-	size_t	repeat_old_messages();	//Возвращает остаток очереди
-	void	clear_old_message();
+	bool	run_repeat();				//Один повтор в свободное окно шины. false - повторять нечего
+	bool	run_sweep();				//Один запрос обхода ID в свободное окно шины. false - обход не идёт
+	void	start_sweep();				//Повторный обход (например, после замены платы котла)
+	size_t	repeats_pending() const;
 
 	//Функции обмена конкретными параметрами
 	void	set_slave();
@@ -142,10 +207,8 @@ public:
 	void	read_status();
 	void	read_faultCode();
 	void	read_diagCode();
-	void	read_ch_temp();
-	void	read_dhw_temp();
-	float	read_modulation();
-	float	read_flame_current();
+	bool	run_scheduled();			//Один обмен по расписанию. false - ни один обмен ещё не вышел
+	int64_t	scheduled_in_us() const;	//Время до ближайшего обмена по расписанию
 	void	set_ch_temp_zad(float ch_temp_zad, bool data_invalid_expected = false);
 	void	set_dhw_temp_zad(float dhw_temp_zad, bool data_invalid_expected = false);
 	void	set_ch_temp_max(float ch_temp_max);
@@ -155,12 +218,30 @@ public:
 	void	set_SummerMode(bool SummerMode);
 	bool	BLOR();
 
+	//Пересылка кадра шлюза без разбора: sucsess, timeout или rx_invalid. Ошибки считает шлюз,
+	//failsCounter принадлежит задаче котла
+	OT_Status	relay(const uint32_t request, uint32_t* response);
+	bool		gateway_active() const;
+	bool		gateway_ch_setpoint(uint16_t* data) const;	//Уставка ID 1, которую шлюз подставляет термостату
+
 	//Функция тестирования обмена
 	json	test_ot_command(json params);
 
-	//Константный доступ из других задач
+	//Снимок состояния для других задач, если с прошлого раза были обмены. Вызывается задачей котла
+	void	publish();
+
+	//Константный доступ из других задач: только через снимок
+	uint32_t	generation() const	{return snapshot.generation();}
 	void	print_status(std::ostringstream& ss) const;
 	json	json_status() const;
+	json	json_capabilities() const;
+	json	json_id_stats() const;
+	int64_t	bus_ready_in_us() const;	//Время до окончания обязательной паузы шины
+
+	//Двоичная выгрузка самописца (формат OT_Recorder) и её сохранение в SPIFFS
+	std::vector<uint8_t>	flight_recorder() const;
+	std::string				flight_recorder_file() const;
+	bool					save_flight_recorder() const;
 
 	void	log_head(std::ostringstream& ss) const;
 	void	log_data(std::ostringstream& ss) const;
@@ -168,7 +249,6 @@ public:
 	json	set_boiler_data(const json& j);
 	bool	openTherm_is_correct() const;
 
-	void	send_all_mqtt();
 	bool	is_CH_on();
 };
 
@@ -0,0 +1,264 @@
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/rmt_tx.h"
+#include "driver/rmt_rx.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "ot_gateway.h"
+#include "ot_boiler.h"
+#include "rmt_opentherm.h"
+#include "boiler_task.h"
+
+static const char*	TAG = "ot_gateway";
+
+//Бит чётности после подмены данных: общее число единиц в кадре чётное
+static void	set_parity(OT_Message_t& msg)
+{
+	msg.bit.parity	= 0;
+	msg.bit.parity	= OT_Decoder::parity_ok(msg.all) ? 0 : 1;
+}
+
+OT_Gateway::OT_Gateway(const gpio_num_t pin_in, const gpio_num_t pin_out, OT_Boiler* boiler, const std::string& topic)
+{
+	this->boiler	= boiler;
+	this->topic		= topic;
+
+	//Шина термостата: тот же приём и кодирование, что и у котла, но в роли ведомого
+	thermostat	= new RMT_Opentherm(pin_in, pin_out, topic + "RMT");
+}
+
+void	OT_Gateway::start(UBaseType_t priority, BaseType_t core)
+{
+	xTaskCreatePinnedToCore(task, "ot_gateway", 4096, this, priority, nullptr, core);
+}
+
+void	OT_Gateway::task(void* arg)
+{
+	OT_Gateway*	gateway	= static_cast<OT_Gateway*>(arg);
+	ESP_LOGI(TAG, "started");
+	for(;;)
+	{
+		//Отключение обмена на время прошивки
+		if(!OT_is_enabled)
+		{
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+
+		gateway->relay_once();
+	}
+}
+
+void	OT_Gateway::relay_once()
+{
+	//Термостат опрашивает котёл примерно раз в секунду
+	OT_Message_t			request;
+	RMT_Opentherm::Result	result	= thermostat->receive_request(&request.all, pdMS_TO_TICKS(1000));
+	if(result == RMT_Opentherm::Result::receive_timeout)
+		return;
+	if(result != RMT_Opentherm::Result::sucsess || !OT_Decoder::parity_ok(request.all))
+	{
+		stats.request_fail++;
+		return;
+	}
+	int64_t	request_time	= thermostat->last_receive_time();
+
+	//Подмена данных записи. Уставку теплоносителя ESP32 задаёт через шлюз: при работающем термостате
+	//OT_Boiler не пишет ID 1 сам, поэтому у котла один источник уставки. Явная подмена по команде важнее
+	uint16_t	original	= request.bit.data;
+	uint16_t	data		= 0;
+	bool		is_write	= static_cast<OT_MsgType>(request.bit.msg_type) == OT_MsgType::WRITE_DATA;
+	bool		rewritten	= is_write && (find_override(request.bit.id, &data) || (request.bit.id == 1 && boiler->gateway_ch_setpoint(&data)));
+	if(rewritten)
+	{
+		request.bit.data	= data;
+		set_parity(request);
+	}
+
+	//Пересылка котлу. Пока шлюз активен, собственные обмены boiler_task идут только в окне после пересылки,
+	//поэтому мьютекс шины занят не дольше одного такого обмена
+	OT_Message_t	response;
+	OT_Status		status	= boiler->relay(request.all, &response.all);
+	if(status != OT_Status::sucsess)
+	{
+		if(status == OT_Status::timeout)	stats.boiler_timeout++;
+		else								stats.boiler_invalid++;
+		return;
+	}
+
+	//Термостат получает подтверждение своего значения
+	if(rewritten && static_cast<OT_MsgType>(response.bit.msg_type) == OT_MsgType::WRITE_ACK)
+	{
+		response.bit.data	= original;
+		set_parity(response);
+	}
+
+	//Опоздавший ответ термостат уже не ждёт, он повторит запрос
+	int64_t	latency	= esp_timer_get_time() - request_time;
+	if(latency > response_window_us)
+	{
+		stats.late++;
+		ESP_LOGW(TAG, "late response for id %d: %d ms", int(request.bit.id), int(latency/1000));
+		return;
+	}
+
+	if(thermostat->send_response(response.all) != RMT_Opentherm::Result::sucsess)
+		return;
+
+	stats.relayed++;
+	if(rewritten)	stats.rewritten++;
+	stats.latency_last	= latency;
+	stats.latency_sum	+= latency;
+	if(latency > stats.latency_max)
+		stats.latency_max	= latency;
+}
+
+bool	OT_Gateway::find_override(uint8_t id, uint16_t* data) const
+{
+	bool	found	= false;
+	portENTER_CRITICAL(&overrides_lock);
+	for(const Override& item : overrides)
+	{
+		if(item.active && item.id == id)
+		{
+			*data	= item.data;
+			found	= true;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&overrides_lock);
+
+	return found;
+}
+
+void	OT_Gateway::set_override(uint8_t id, uint16_t data)
+{
+	portENTER_CRITICAL(&overrides_lock);
+	Override*	slot	= nullptr;
+	for(Override& item : overrides)
+	{
+		if(item.active && item.id == id)	{slot = &item; break;}
+		if(!item.active && !slot)			slot = &item;
+	}
+	if(slot)
+	{
+		slot->id		= id;
+		slot->data		= data;
+		slot->active	= true;
+	}
+	portEXIT_CRITICAL(&overrides_lock);
+}
+
+void	OT_Gateway::clear_override(uint8_t id)
+{
+	portENTER_CRITICAL(&overrides_lock);
+	for(Override& item : overrides)
+		if(item.active && item.id == id)
+			item.active	= false;
+	portEXIT_CRITICAL(&overrides_lock);
+}
+
+//Число в поле данных по типу ID. false - вне диапазона типа или тип - пара байтов
+static bool	encode_value(uint8_t id, double value, uint16_t* data)
+{
+	switch(ot_data_type(id))
+	{
+		case OT_DataType::f8_8:{
+			long	raw	= lround(value*256.);
+			if(raw < INT16_MIN || raw > INT16_MAX)	return false;
+			*data	= uint16_t(int16_t(raw));
+		}break;
+
+		case OT_DataType::s16:{
+			long	raw	= lround(value);
+			if(raw < INT16_MIN || raw > INT16_MAX)	return false;
+			*data	= uint16_t(int16_t(raw));
+		}break;
+
+		case OT_DataType::u16:{
+			long	raw	= lround(value);
+			if(raw < 0 || raw > UINT16_MAX)	return false;
+			*data	= uint16_t(raw);
+		}break;
+
+		default:
+			return false;
+	}
+	return true;
+}
+
+//ID ведущего по спецификации - 0..127, OEM-диапазон шлюз не подменяет
+static bool	valid_id(const json& j)
+{
+	return j.is_number_integer() && j.get<int64_t>() >= 0 && j.get<int64_t>() <= 127;
+}
+
+json	OT_Gateway::command(const json& params)
+{
+	if(params.contains("override") && params.at("override").is_object())
+	{
+		const json&	item	= params.at("override");
+		if(!item.contains("id") || !valid_id(item.at("id")))
+			return {{"fail", "override.id not integer 0..127"}};
+
+		uint8_t		id		= item.at("id").get<uint8_t>();
+		uint16_t	data	= 0;
+		if(item.contains("value") && item.at("value").is_number()){
+			if(!encode_value(id, item.at("value").get<double>(), &data))
+				return {{"fail", "override.value out of range or id is not a number type, use data"}};
+		}
+		else if(item.contains("data") && item.at("data").is_number_integer()){
+			int64_t	raw	= item.at("data").get<int64_t>();
+			if(raw < 0 || raw > UINT16_MAX)
+				return {{"fail", "override.data not 0..65535"}};
+			data	= uint16_t(raw);
+		}
+		else	return {{"fail", "override needs value or data"}};
+
+		set_override(id, data);
+	}
+
+	if(params.contains("clear")){
+		if(!valid_id(params.at("clear")))
+			return {{"fail", "clear not integer 0..127"}};
+		clear_override(params.at("clear").get<uint8_t>());
+	}
+
+	return json_status();
+}
+
+json	OT_Gateway::json_status() const
+{
+	json	list	= json::array();
+	portENTER_CRITICAL(&overrides_lock);
+	Override	copy[max_overrides];
+	for(size_t i = 0; i < max_overrides; i++)
+		copy[i]	= overrides[i];
+	portEXIT_CRITICAL(&overrides_lock);
+	for(const Override& item : copy)
+		if(item.active)
+			list.push_back({{"id", item.id}, {"data", item.data}, {"value", ot_value(item.id, item.data).number()}});
+
+	return json{
+		{"relayed", stats.relayed},
+		{"rewritten", stats.rewritten},
+		{"late", stats.late},
+		{"boiler_timeout", stats.boiler_timeout},
+		{"boiler_invalid", stats.boiler_invalid},
+		{"request_fail", stats.request_fail},
+		{"latency_ms", {
+			{"last", stats.latency_last*0.001},
+			{"avg", stats.relayed ? stats.latency_sum*0.001/stats.relayed : 0.},
+			{"max", stats.latency_max*0.001}
+		}},
+		{"overrides", list}
+	};
+}
@@ -0,0 +1,68 @@
+#ifndef OT_GATEWAY_H
+#define OT_GATEWAY_H
+
+#include <string>
+#include "ot_protocol.h"
+class RMT_Opentherm;
+class OT_Boiler;
+
+//Шлюз между комнатным термостатом и котлом.
+//Со стороны термостата ESP32 работает ведомым, запросы пересылаются котлу через его шину.
+//Данные в запросах записи можно подменять (например, уставку теплоносителя ID 1).
+//Пока термостат шлёт кадры, шина отдана ему: опрос котла занимает только окно после пересылки (OT_Boiler)
+class OT_Gateway
+{
+private:
+	RMT_Opentherm*	thermostat	= nullptr;	//Шина комнатного термостата
+	OT_Boiler*		boiler		= nullptr;	//Котёл, которому пересылаются запросы
+	std::string		topic;
+
+	//Ответ должен начаться не позднее 800 мс после окончания запроса термостата
+	static constexpr int64_t	response_window_us	= 800000;
+
+	//Подмена данных в запросах записи
+	struct Override
+	{
+		uint8_t		id		= 0;
+		uint16_t	data	= 0;
+		bool		active	= false;
+	};
+	static constexpr size_t	max_overrides	= 8;
+	Override				overrides[max_overrides];
+	mutable portMUX_TYPE	overrides_lock	= portMUX_INITIALIZER_UNLOCKED;
+
+	bool	find_override(uint8_t id, uint16_t* data) const;
+
+	//Статистика пересылки
+	struct Stats
+	{
+		uint32_t	relayed			= 0;	//Ответов отправлено термостату
+		uint32_t	rewritten		= 0;	//Из них с подменой данных
+		uint32_t	late			= 0;	//Ответ котла пришёл после окна ответа термостату
+		uint32_t	boiler_timeout	= 0;	//Котёл не ответил (failsCounter котла это не учитывает)
+		uint32_t	boiler_invalid	= 0;	//Ответ котла не разобран
+		uint32_t	request_fail	= 0;	//Запрос термостата не разобран
+		int64_t		latency_sum		= 0;	//От конца запроса термостата до начала ответа ему, мкс
+		int64_t		latency_max		= 0;
+		int64_t		latency_last	= 0;
+	}stats;
+
+	static void	task(void* arg);
+	void	relay_once();
+
+public:
+	OT_Gateway(const gpio_num_t pin_in, const gpio_num_t pin_out, OT_Boiler* boiler, const std::string& topic);
+
+	//Запуск задачи пересылки. Приоритет выше опроса котла, чтобы ответ уложился в окно термостата
+	void	start(UBaseType_t priority, BaseType_t core);
+
+	void	set_override(uint8_t id, uint16_t data);
+	void	clear_override(uint8_t id);
+
+	//Команда TCP: {"override": {"id": 1, "value": 45.5}} или {"override": {"id": 1, "data": 11520}}, {"clear": 1}.
+	//ID 0..127; value кодируется по типу ID из спецификации (f8.8, u16, s16), для пар байтов - только data
+	json	command(const json& params);
+	json	json_status() const;
+};
+
+#endif	//OT_GATEWAY_H
@@ -1,22 +1,25 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/rmt_tx.h"
 #include "driver/rmt_rx.h"
+#include "soc/soc_caps.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include <sstream>
-#include <vector>
+
 #include "mqtt.h"
+#include "ot_decoder.h"
+#include "ot_encoder.h"
 #include "rmt_opentherm.h"
 
 static const char*	TAG = "rmt_opentherm";
-static bool rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t* edata, void* user_data);
 static size_t encoder_callback(const void* data, size_t data_size, size_t symbols_written, size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg);
 
 RMT_Opentherm::RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic)
 {
-	log_topic	= topic;
+	topic_debug	= mqtt_topic(topic, "/debug");
+	topic_log	= mqtt_topic(topic, "/log");
 
 	//Настройка канала приема
 	ESP_LOGI(TAG, "create RMT RX channel");
@@ -43,14 +46,12 @@ RMT_Opentherm::RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out,
 
 	ESP_ERROR_CHECK(rmt_new_rx_channel(&rx_channel_cfg, &rx_channel));
 
-	//Создание очереди ожидания приема
+	//Разбор ответа выполняется в прерывании завершения приема
 	ESP_LOGI(TAG, "register RX done callback");
-	receive_queue	= xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
-	assert(receive_queue);
 	rmt_rx_event_callbacks_t cbs = {
-		.on_recv_done = rmt_rx_done_callback,
+		.on_recv_done = rx_done_isr,
 	};
-	ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_channel, &cbs, receive_queue));
+	ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_channel, &cbs, this));
 
 	//Настройка канала передачи
 	ESP_LOGI(TAG, "create RMT TX channel");
@@ -58,7 +59,7 @@ RMT_Opentherm::RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out,
 		.gpio_num			= pin_out,
 		.clk_src			= RMT_CLK_SRC_DEFAULT,
 		.resolution_hz		= 1000000,
-		.mem_block_symbols	= 64, // amount of RMT symbols that the channel can store at a time
+		.mem_block_symbols	= SOC_RMT_MEM_WORDS_PER_CHANNEL,	//Минимальный блок: кадр не обязан помещаться целиком
 		.trans_queue_depth	= 4,  // number of transactions that allowed to pending in the background, this example won't queue multiple transactions, so queue depth > 1 is sufficient
 		.intr_priority		= 0,
 		.flags	= {
@@ -84,13 +85,14 @@ RMT_Opentherm::RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out,
 	const rmt_simple_encoder_config_t	simple_encoder_cfg = {
 		.callback 		= encoder_callback,
 		.arg			= nullptr,
-		.min_chunk_size	= 64
+		.min_chunk_size	= 1	//Энкодер пишет любую часть кадра
 	};
 	ESP_ERROR_CHECK(rmt_new_simple_encoder(&simple_encoder_cfg, &tx_encoder));
 
 	//Включение канала передачи
 	ESP_LOGI(TAG, "enable RMT TX and RX channels");
 	ESP_ERROR_CHECK(rmt_enable(tx_channel));
+	ESP_ERROR_CHECK(rmt_enable(rx_channel));
 
 	//Выставка высокого уровня на линии путем отправки одного импульса
 	rmt_copy_encoder_config_t	copy_config	= {};
@@ -100,300 +102,262 @@ RMT_Opentherm::RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out,
 	rmt_transmit(tx_channel, copy_encoder, &pullup_symbol, sizeof(pullup_symbol), &transmit_config);
 	rmt_del_encoder(copy_encoder);
 
+	//Таймер сроков обмена
+	const esp_timer_create_args_t	timer_args	= {
+		.callback			= deadline_callback,
+		.arg				= this,
+		.dispatch_method	= ESP_TIMER_TASK,
+		.name				= "ot_deadline",
+		.skip_unhandled_events	= true
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&timer_args, &deadline_timer));
+	bus_mutex	= xSemaphoreCreateMutex();
+
 	//Нужно секунду подождать, чтобы первый обмен не завершился ошибкой
-	//vTaskDelay будет выполнен в processOT, поэтому сдвиг на 950 мс
-	time_last_receive	= esp_timer_get_time() + 950000;
+	//Пауза min_idle_us будет выдержана в processOT, поэтому сдвиг меньше секунды
+	time_last_receive		= esp_timer_get_time() + 1000000 - min_idle_us;
+	bus_stats.start_time	= esp_timer_get_time();
 }
 
-RMT_Opentherm::Result	RMT_Opentherm::processOT(const uint32_t request, uint32_t* response, std::vector<rmt_symbol_word_t>& received_symbols)
+RMT_Opentherm::Result	RMT_Opentherm::processOT(const uint32_t request, uint32_t* response)
 {
 	Result	out;
+	xSemaphoreTake(bus_mutex, portMAX_DELAY);
+	capture_count	= 0;
+	clock_bursts	= 0;
+	*response		= 0;
+	bus_stats.last_received	= false;
+
+	//Сброс уведомлений, оставшихся от прерванного прошлого обмена
+	waiting_task	= xTaskGetCurrentTaskHandle();
+	xTaskNotifyWait(0, notify_rx_done | notify_deadline, nullptr, 0);
 
-	//Ожидание не менее 150 мс после последнего приема
-	int64_t	dt	= (esp_timer_get_time() - time_last_receive)/1000;
-	if(dt < 150)
-		vTaskDelay(pdMS_TO_TICKS(150 - dt));
+	//Обязательная пауза после последнего приёма
+	wait_until(time_last_receive + min_idle_us);
+	bus_stats.last_gap_us	= esp_timer_get_time() - time_last_receive;
 
 	//Передача команды
 	ESP_ERROR_CHECK(rmt_transmit(tx_channel, tx_encoder, &request, sizeof(request), &transmit_config));
 
-	//Приём
-	int64_t	receive_time	= esp_timer_get_time();
-	for(;;)
+	//Приём. Тактовые импульсы отсеиваются и разбор выполняется в прерывании
+	int64_t		receive_time	= esp_timer_get_time();
+	esp_err_t	receive_state	= rmt_receive(rx_channel, rx_symbols_buf, sizeof(rx_symbols_buf), &receive_config);
+	if(receive_state == ESP_OK)
 	{
-		rmt_enable(rx_channel);
-		esp_err_t	receive_state	= rmt_receive(rx_channel, rx_symbols_buf, sizeof(rx_symbols_buf), &receive_config);
-		if(receive_state == ESP_OK)
+		//Ожидание ответа до конца окна ответа ведомого
+		esp_timer_start_once(deadline_timer, frame_time_us + response_window_us);
+		uint32_t	notify	= 0;
+		while(!(notify & (notify_rx_done | notify_deadline)))
 		{
-			//Ожидание сигнала о завершении приема
-			rmt_rx_done_event_data_t rx_data;
-			if(xQueueReceive(receive_queue, &rx_data, pdMS_TO_TICKS(800)) == pdPASS)
-			{
-				//Накопление в ожидании таймаута
-				for(int i = 0; i < rx_data.num_symbols; i++)
-					received_symbols.push_back(rx_data.received_symbols[i]);
-
-				//Фильтрация начальных тактовых импульсов
-				if(rx_data.received_symbols[0].duration0 < 30 ||
-					rx_data.received_symbols[0].duration1 < 30){
-					rmt_disable(rx_channel);
-					continue;
-				}
+			uint32_t	bits	= 0;
+			if(xTaskNotifyWait(0, notify_rx_done | notify_deadline, &bits, pdMS_TO_TICKS(2000)) != pdPASS)
+				break;
+			notify	|= bits;
+		}
+		esp_timer_stop(deadline_timer);
 
-				//Финализация
-				received_symbols.push_back({
-					.duration0	= uint16_t(0.001*(esp_timer_get_time() - receive_time)),
-					.level0		= 0,
-					.duration1	= 8888,
-					.level1		= 1
-				});
-
-				// rmt_disable(rx_channel);
-				// continue;
-
-				time_last_receive	= esp_timer_get_time();
-
-				//Проверка, что пришли все 34 бита и все начинаются с 1
-				bool	strange_duration		= false;
-				bool	all_bits_starts_from_1	= true;
-				uint16_t	shift	= 0;	//Сдвиг длительности следующего сигнала
-
-				//Дополнительная проверка на первый импульс, короче нормального
-				if(rx_data.num_symbols > 0 && (rx_data.received_symbols[0].duration0 < 550))
-					rx_data.received_symbols[0].duration0	= 550;
-
-				for(int i = 0; i < rx_data.num_symbols; i++)
-				{
-					//Проверка на начальный уровень
-					if(rx_data.received_symbols[i].level0 == 0){
-						all_bits_starts_from_1	= true;
-						break;
+		bus_stats.frames++;
+		if(notify & notify_rx_done)
+		{
+			time_last_receive	= rx_result.time;
+			capture_finalize(receive_time);
+
+			bus_stats.last_response_us	= rx_result.time - receive_time;
+			bus_stats.busy_us			+= bus_stats.last_response_us;
+			bus_stats.last_received		= true;
+
+			if(rx_result.status != OT_Decoder::Status::ok){
+				//Отладочная печать только при ошибке разбора
+				if(mqtt_client){
+					std::ostringstream	ss;
+					ss << "request: 0x" << std::hex << request << std::dec << std::endl;
+					for(size_t i = 0; i < capture_count; i++)
+					{
+						ss << "(" << capture_buf[i].level0 << ": " << capture_buf[i].duration0 << "; ";
+						ss << capture_buf[i].level1 << ": " << capture_buf[i].duration1 << ")" << std::endl;
 					}
+					ss << OT_Decoder::to_string(rx_result.status) << std::endl;
+					mqtt_publish(topic_debug, ss.str().c_str());
+				}
 
-					//Проверка на короткий импульс
-					if(rx_data.received_symbols[i].duration0 < 150 || rx_data.received_symbols[i].duration1 < 150){
-						if(i < rx_data.num_symbols-1){
-							strange_duration	= true;
-							break;
-						}
-					}
+				out	= Result::fail;
+			}
+			else{
+				*response	= rx_result.frame;
+				out	= Result::sucsess;
+			}
+		}
+		else
+		{
+			//Окно ответа ведомого истекло
+			ESP_LOGW(TAG, "timeout");
+			out	= Result::receive_timeout;
+			time_last_receive	= esp_timer_get_time();
 
-					//Коррекция первого имульса при искаженном предыдущем
-					rx_data.received_symbols[i].duration0	+= shift;
-					shift	= 0;
-
-					//Проверка длительности первого импульса с коррекцией второго
-					uint16_t	len		= rx_data.received_symbols[i].duration0;
-					uint16_t	base1	= 550;
-					uint16_t	base2	= 1060;
-					uint16_t	delta	= 30;
-					if(len < base2-2*delta){
-						if(!(len > base1-delta && len < base1+delta)){
-							//Получено не 550, а 800 или около того
-							rx_data.received_symbols[i].duration0	= base1;
-							rx_data.received_symbols[i].duration1	+= (len - base1);
-						}
-					}
-					else if(!(len > (base2-delta) && len < (base2+delta))){
-						//Получено не 1060, а 1300 или около того
-						rx_data.received_symbols[i].duration0	= base2;
-						rx_data.received_symbols[i].duration1	+= (len - base2);
-					}
+			bus_stats.timeouts++;
+			bus_stats.last_response_us	= time_last_receive - receive_time;
+			bus_stats.busy_us			+= bus_stats.last_response_us;
 
-					//Проверка длительности второго импульса
-					len	= rx_data.received_symbols[i].duration1;
-					base1	= 470;
-					base2	= 984;
-					if(len < base2-2*delta){
-						if(!(len > base1-delta && len < base1+delta)){
-							shift	= len - base1;
-							rx_data.received_symbols[i].duration1	= base1;
-						}
-					}
-					else if(!(len > base2-delta && len < base2+delta)){
-						shift	= len - base2;
-						rx_data.received_symbols[i].duration1	= base2;
-					}
-				}
+			//Отмена незавершённого приёма
+			rmt_disable(rx_channel);
+			rmt_enable(rx_channel);
 
-				//Отладочная печать
-				std::ostringstream	ss;
-				ss << "request: 0x" << std::hex << request << std::dec << std::endl;
-				for(size_t i = 0; i < rx_data.num_symbols; i++)
-				{
-					ss << "(" << rx_data.received_symbols[i].level0 << ": " << rx_data.received_symbols[i].duration0 << "; ";
-					ss << rx_data.received_symbols[i].level1 << ": " << rx_data.received_symbols[i].duration1 << ")" << std::endl;
-				}
+			//Финализация
+			capture_finalize(receive_time);
+		}
+	}
+	else
+		out	= receive_error(receive_state);
 
-				if(mqtt_client && !all_bits_starts_from_1){
-					ss << "Обнаружен level0 = 0" << std::endl;
-					esp_mqtt_client_publish(mqtt_client, (log_topic + "/debug").c_str(), ss.str().c_str(), 0, 0, 0);
-				}
+	xSemaphoreGive(bus_mutex);
+	return out;
+}
 
-				if(mqtt_client && strange_duration){
-					ss << "strange_duration" << std::endl;
-					esp_mqtt_client_publish(mqtt_client, (log_topic + "/debug").c_str(), ss.str().c_str(), 0, 0, 0);
-				}
+RMT_Opentherm::Result	RMT_Opentherm::receive_error(esp_err_t receive_state)
+{
+	if(receive_state == ESP_ERR_INVALID_STATE){
+		ESP_LOGW(TAG, "receive_invalid_state");
+		if(mqtt_client)	mqtt_publish(topic_log, "receive_invalid_state");
+		return Result::receive_invalid_state;
+	}
+	else if(receive_state == ESP_ERR_INVALID_ARG){
+		ESP_LOGW(TAG, "receive_invalid_arg");
+		if(mqtt_client)	mqtt_publish(topic_log, "receive_invalid_arg");
+		return Result::receive_invalid_arg;
+	}
+	else if(receive_state == ESP_FAIL){
+		ESP_LOGW(TAG, "receive_fail");
+		if(mqtt_client)	mqtt_publish(topic_log, "receive_fail");
+		return Result::receive_fail;
+	}
 
-				if(!all_bits_starts_from_1 || strange_duration){
-					*response	= 0;
-					out	= Result::fail;
-					break;
-				}
+	return Result::fail;
+}
 
-				// if(mqtt_client){
-				// 	ss << std::endl;
-				// 	esp_mqtt_client_publish(mqtt_client, (log_topic + "/info").c_str(), ss.str().c_str(), 0, 0, 0);
-				// }
+RMT_Opentherm::Result	RMT_Opentherm::receive_request(uint32_t* request, TickType_t timeout)
+{
+	capture_count	= 0;
+	clock_bursts	= 0;
+	*request		= 0;
 
-				// ESP_LOGI(TAG, "%s", ss.str().c_str());
+	waiting_task	= xTaskGetCurrentTaskHandle();
+	xTaskNotifyWait(0, notify_rx_done | notify_deadline, nullptr, 0);
 
-				//Разбор ответа
-				uint32_t	resp		= 0;
-				size_t		bits_count	= 0;
-				uint8_t		slot_index	= 1;
-				for(int i = 0; i < rx_data.num_symbols; i++)
-				{
-					const rmt_symbol_word_t&	item	= rx_data.received_symbols[i];
+	//Запрос ведущего разбирается в том же прерывании, что и ответ котла
+	int64_t		receive_time	= esp_timer_get_time();
+	esp_err_t	receive_state	= rmt_receive(rx_channel, rx_symbols_buf, sizeof(rx_symbols_buf), &receive_config);
+	if(receive_state != ESP_OK)
+		return receive_error(receive_state);
 
-					if(item.duration0 < 30)			slot_index	+= 0;
-					else if(item.duration0 < 700)	slot_index	+= 1;
-					else							slot_index	+= 2;
+	uint32_t	notify	= 0;
+	if(xTaskNotifyWait(0, notify_rx_done, &notify, timeout) != pdPASS || !(notify & notify_rx_done))
+	{
+		//Отмена незавершённого приёма
+		rmt_disable(rx_channel);
+		rmt_enable(rx_channel);
+		return Result::receive_timeout;
+	}
 
-					if(slot_index >= 2)
-					{
-						bits_count++;
-						if(bits_count != 1)	resp	= (resp << 1) | (item.level0? 1 : 0);
-						if(bits_count > 32) break;
-						slot_index	-= 2;
-					}
+	time_last_receive	= rx_result.time;
+	capture_finalize(receive_time);
+	if(rx_result.status != OT_Decoder::Status::ok)
+		return Result::fail;
 
-					if(item.duration1 < 30)			slot_index	+= 0;
-					else if(item.duration1 < 700)	slot_index	+= 1;
-					else							slot_index	+= 2;
+	*request	= rx_result.frame;
+	return Result::sucsess;
+}
 
-					if(slot_index >= 2)
-					{
-						bits_count++;
-						if(bits_count != 1)	resp	= (resp << 1) | (item.level1? 1 : 0);
-						if(bits_count > 32) break;
-						slot_index	-= 2;
-					}
-				}
+RMT_Opentherm::Result	RMT_Opentherm::send_response(const uint32_t response)
+{
+	//Кадр ответа живёт в объекте, а возврат происходит после окончания передачи
+	tx_frame	= response;
+	if(rmt_transmit(tx_channel, tx_encoder, &tx_frame, sizeof(tx_frame), &transmit_config) != ESP_OK)
+		return Result::fail;
+	if(rmt_tx_wait_all_done(tx_channel, pdMS_TO_TICKS(2*frame_time_us/1000)) != ESP_OK)
+		return Result::fail;
+
+	return Result::sucsess;
+}
 
-				*response	= resp;
-				out	= Result::sucsess;
-				break;
-			}
-			else
-			{
-				//Через 0.8 секунды ответ не пришел
-				ESP_LOGW(TAG, "timeout");
-				// if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (log_topic + "/log").c_str(), "timeout", 0, 0, 0);
-				out	= Result::receive_timeout;
-				time_last_receive	= esp_timer_get_time();
-
-				//Финализация
-				received_symbols.push_back({
-					.duration0	= uint16_t(0.001*(esp_timer_get_time() - receive_time)),
-					.level0		= 0,
-					.duration1	= 8888,
-					.level1		= 1
-				});
+void	RMT_Opentherm::wait_until(int64_t deadline)
+{
+	int64_t	remaining	= deadline - esp_timer_get_time();
+	if(remaining <= 0)
+		return;
+
+	//Точное ожидание по esp_timer вместо округления до тиков FreeRTOS
+	bus_stats.idle_wait_us	+= remaining;
+	esp_timer_start_once(deadline_timer, remaining);
+	xTaskNotifyWait(0, notify_deadline, nullptr, pdMS_TO_TICKS(remaining/1000) + 2);
+	esp_timer_stop(deadline_timer);
+}
 
-				break;
-			}
-		}
-		else if(receive_state == ESP_ERR_INVALID_STATE){
-			ESP_LOGW(TAG, "receive_invalid_state");
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (log_topic + "/log").c_str(), "receive_invalid_state", 0, 0, 0);
-			out	= Result::receive_invalid_state;
-			break;
-		}
-		else if(receive_state == ESP_ERR_INVALID_ARG){
-			ESP_LOGW(TAG, "receive_invalid_arg");
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (log_topic + "/log").c_str(), "receive_invalid_arg", 0, 0, 0);
-			out	= Result::receive_invalid_arg;
-			break;
-		}
-		else if(receive_state == ESP_FAIL){
-			ESP_LOGW(TAG, "receive_fail");
-			if(mqtt_client)	esp_mqtt_client_publish(mqtt_client, (log_topic + "/log").c_str(), "receive_fail", 0, 0, 0);
-			out	= Result::receive_fail;
-			break;
-		}
-		else{
-			out	= Result::fail;
-			break;
-		}
-	}
+void	RMT_Opentherm::deadline_callback(void* arg)
+{
+	RMT_Opentherm*	ot	= static_cast<RMT_Opentherm*>(arg);
+	xTaskNotify(ot->waiting_task, notify_deadline, eSetBits);
+}
 
-	//Отладочная печать
-	// std::ostringstream	ss;
-	// ss << "request: 0x" << std::hex << request << std::dec << std::endl;
-	// ss << "num_symbols: " << received_symbols.size() << std::endl;
-	// // ss << "receive_count: " << receive_count << std::endl;
-	// for(const rmt_symbol_word_t& word : received_symbols)
-	// {
-	// 	ss << "(" << word.level0 << ": " << word.duration0 << "; ";
-	// 	ss << word.level1 << ": " << word.duration1 << ")" << std::endl;
-	// }
-
-	// if(mqtt_client){
-	// 	ss << std::endl;
-	// 	esp_mqtt_client_publish(mqtt_client, (log_topic + "/info").c_str(), ss.str().c_str(), 0, 0, 0);
-	// }
-
-	rmt_disable(rx_channel);
-	return out;
+int64_t	RMT_Opentherm::bus_ready_in_us() const
+{
+	int64_t	remaining	= time_last_receive + min_idle_us - esp_timer_get_time();
+	return remaining > 0 ? remaining : 0;
 }
 
-static bool rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t* edata, void* user_data)
+void IRAM_ATTR	RMT_Opentherm::capture(const rmt_symbol_word_t* symbols, size_t num_symbols)
 {
-	BaseType_t		high_task_wakeup	= pdFALSE;
-	QueueHandle_t	receive_queue		= static_cast<QueueHandle_t>(user_data);
+	//Лишние символы отбрасываются, последний слот резервируется под финализацию
+	for(size_t i = 0; i < num_symbols && capture_count < capture_size - 1; i++)
+		capture_buf[capture_count++]	= symbols[i];
+}
 
-	// send the received RMT symbols to the parser task
-	xQueueSendFromISR(receive_queue, edata, &high_task_wakeup);
-	return high_task_wakeup == pdTRUE;
+void	RMT_Opentherm::capture_finalize(int64_t receive_time)
+{
+	//Служебный символ: время ожидания ответа в мс
+	capture_buf[capture_count++]	= {
+		.duration0	= uint16_t(0.001*(esp_timer_get_time() - receive_time)),
+		.level0		= 0,
+		.duration1	= 8888,
+		.level1		= 1
+	};
 }
 
-//Кодирование отправки
-static const rmt_symbol_word_t	opentherm_bit0	= {
-	.duration0	= 500,
-	.level0		= 1,
-	.duration1	= 500,
-	.level1		= 0
-};
-
-static const rmt_symbol_word_t	opentherm_bit1	= {
-	.duration0	= 500,
-	.level0		= 0,
-	.duration1	= 500,
-	.level1		= 1
-};
+size_t	RMT_Opentherm::captured_symbols(const rmt_symbol_word_t** symbols) const
+{
+	*symbols	= capture_buf;
+	return capture_count;
+}
 
-static size_t encoder_callback(const void* data, size_t data_size, size_t symbols_written, size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg)
+bool IRAM_ATTR	RMT_Opentherm::rx_done_isr(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t* edata, void* user_data)
 {
-	if(symbols_free < 34)
-		return 0;
+	RMT_Opentherm*	ot	= static_cast<RMT_Opentherm*>(user_data);
 
-	//Стартовый бит
-	symbols[0]	= opentherm_bit1;
+	//Накопление для отладки до разбора, который меняет символы на месте
+	ot->capture(edata->received_symbols, edata->num_symbols);
 
-	//request
-	const uint32_t	request	= *static_cast<const uint32_t*>(data);
-	size_t	index	= 1;
-	for(uint32_t bitmask = 0x80000000; bitmask != 0; bitmask >>= 1)
+	//Начальные тактовые импульсы: приём перезапускается прямо из прерывания
+	if(OT_Decoder::is_clock_burst(edata->received_symbols, edata->num_symbols) && ot->clock_bursts < max_clock_bursts)
 	{
-		if(request & bitmask)	symbols[index++]	= opentherm_bit1;
-		else					symbols[index++]	= opentherm_bit0;
+		ot->clock_bursts++;
+		if(rmt_receive(channel, ot->rx_symbols_buf, sizeof(ot->rx_symbols_buf), &ot->receive_config) == ESP_OK)
+			return false;
 	}
 
-	//Стоповый бит
-	symbols[33]	= opentherm_bit1;
+	//Разбор занимает время, линейное по числу символов, которое ограничено буфером приёма
+	ot->rx_result.time		= esp_timer_get_time();
+	ot->rx_result.status	= OT_Decoder::decode(edata->received_symbols, edata->num_symbols, &ot->rx_result.frame, &ot->rx_clock);
+
+	BaseType_t	high_task_wakeup	= pdFALSE;
+	xTaskNotifyFromISR(ot->waiting_task, notify_rx_done, eSetBits, &high_task_wakeup);
+	return high_task_wakeup == pdTRUE;
+}
+
+//Кодирование отправки. Кадр пишется кусками в любое свободное окно памяти канала
+static size_t encoder_callback(const void* data, size_t data_size, size_t symbols_written, size_t symbols_free, rmt_symbol_word_t* symbols, bool* done, void* arg)
+{
+	const uint32_t	request	= *static_cast<const uint32_t*>(data);
+	size_t	count	= OT_Encoder::encode(request, symbols_written, symbols, symbols_free);
 
-	//Завершение передачи
-	*done	= true;
-	return	34;
+	*done	= (symbols_written + count == OT_Encoder::frame_symbols);
+	return	count;
 }
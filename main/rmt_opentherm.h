@@ -1,24 +1,97 @@
 #ifndef RMT_OPENTHERM_H
 #define RMT_OPENTHERM_H
 
-class RMT_Opentherm
+#include "ot_decoder.h"
+#include "ot_exchange.h"
+
+//Шина OpenTherm на паре каналов RMT. Result наследуется от OT_Transport
+class RMT_Opentherm: public OT_Transport
 {
 private:
-	std::string				log_topic;
+	uint16_t				topic_debug;	//Дескрипторы топиков (mqtt_topic_t)
+	uint16_t				topic_log;
 	rmt_channel_handle_t	rx_channel	= nullptr;
 	rmt_channel_handle_t	tx_channel	= nullptr;
 	rmt_encoder_handle_t	tx_encoder	= nullptr;
 	rmt_receive_config_t	receive_config;
 	rmt_transmit_config_t 	transmit_config;
 	rmt_symbol_word_t		rx_symbols_buf[128];
-	QueueHandle_t			receive_queue;
+	uint32_t				tx_frame	= 0;	//Отправляемый ответ. Передача читает его после возврата из rmt_transmit
+	SemaphoreHandle_t		bus_mutex	= nullptr;	//Обмены ведущего из разных задач (опрос и шлюз) идут по очереди
 	int64_t					time_last_receive;	//Момент завершения приёма, после которого надо выждать не менее 100 мс до следующей отправки
 
+	//Временные параметры шины по спецификации OpenTherm
+	static constexpr int64_t	frame_time_us		= 34000;	//Передача 34 бит по 1 мс
+	static constexpr int64_t	min_idle_us			= 100000;	//Пауза после ответа ведомого до следующего запроса
+	static constexpr int64_t	response_window_us	= 800000;	//Ведомый отвечает не позднее 800 мс после запроса
+
+	//Таймер сроков: окончание обязательной паузы и окна ответа ведомого
+	esp_timer_handle_t		deadline_timer	= nullptr;
+	static void	deadline_callback(void* arg);
+	void	wait_until(int64_t deadline);
+
+	//Все символы последнего обмена, включая тактовые импульсы и финализацию. Память выделена один раз
+	static constexpr size_t	capture_size	= 128;
+	rmt_symbol_word_t		capture_buf[capture_size];
+	size_t					capture_count	= 0;
+
+	void	capture(const rmt_symbol_word_t* symbols, size_t num_symbols);
+	void	capture_finalize(int64_t receive_time);
+
+	//Результат разбора, подготовленный в прерывании завершения приёма
+	struct RxResult
+	{
+		uint32_t			frame	= 0;
+		OT_Decoder::Status	status	= OT_Decoder::Status::no_symbols;
+		int64_t				time	= 0;	//Момент завершения приёма, мкс
+	};
+	RxResult				rx_result;
+	OT_Decoder::Clock		rx_clock;	//Оценка тактовой частоты котла, уточняется в прерывании
+	TaskHandle_t			waiting_task	= nullptr;
+	uint8_t					clock_bursts	= 0;
+	static constexpr uint8_t	max_clock_bursts	= 4;	//Ограничение перезапусков приёма из прерывания
+	static constexpr uint32_t	notify_rx_done		= 1 << 0;
+	static constexpr uint32_t	notify_deadline		= 1 << 1;
+
+	static bool	rx_done_isr(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t* edata, void* user_data);
+	Result	receive_error(esp_err_t receive_state);
+
 public:
 	explicit RMT_Opentherm(const gpio_num_t pin_in, const gpio_num_t pin_out, const std::string& topic);
 
-	enum class Result: uint8_t{sucsess, receive_timeout, receive_invalid_state, receive_invalid_arg, receive_fail, fail};
-	Result	processOT(const uint32_t request, uint32_t* response, std::vector<rmt_symbol_word_t>& received_symbols);
+	//Ведущий (котёл на шине): запрос и ожидание ответа в окне ведомого
+	Result	processOT(const uint32_t request, uint32_t* response) override;
+
+	//Ведомый (комнатный термостат на шине в режиме шлюза): приём запроса и отправка ответа на него
+	Result	receive_request(uint32_t* request, TickType_t timeout);
+	Result	send_response(const uint32_t response);
+	int64_t	last_receive_time() const	{return time_last_receive;}
+
+	//Символы последнего обмена для отладки. Действительны до следующего processOT
+	size_t	captured_symbols(const rmt_symbol_word_t** symbols) const;
+
+	//Сколько мкс осталось до момента, когда шина свободна для следующего запроса
+	int64_t	bus_ready_in_us() const;
+
+	//Статистика загрузки шины
+	struct BusStats
+	{
+		uint32_t	frames		= 0;	//Выполнено обменов
+		uint32_t	timeouts	= 0;	//Из них без ответа
+		int64_t		busy_us		= 0;	//Суммарное время от начала передачи до конца ответа
+		int64_t		idle_wait_us	= 0;	//Суммарное ожидание обязательной паузы
+		int64_t		last_response_us	= 0;	//Время ответа последнего обмена от начала передачи
+		bool		last_received		= false;	//Последний обмен получил кадр (пусть и с ошибкой разбора): last_response_us - его время
+		int64_t		last_gap_us	= -1;	//Пауза от конца прошлого приёма до начала передачи последнего обмена
+		int64_t		start_time	= 0;	//Начало накопления статистики
+	};
+	const BusStats&	stats() const	{return bus_stats;}
+
+	//Оценка полупериода и асимметрии ответов котла
+	const OT_Decoder::Clock&	clock() const	{return rx_clock;}
+
+private:
+	BusStats	bus_stats;
 };
 
 #endif	//RMT_OPENTHERM_H
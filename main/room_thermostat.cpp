@@ -6,13 +6,22 @@ using json = nlohmann::json;
 #include "room_thermostat.h"
 #include "thermo.h"
 #include "mqtt.h"
+#include "telemetry.h"
 
 RoomThermostat::RoomThermostat(uint8_t temp_index, uint8_t rad_index, const std::string& str, const std::string& topic_name)
 {
 	room_temp_index	= temp_index;
 	room_rad_index	= rad_index;
 	name			= str;
-	topic			= topic_name;
+
+	//Отладочные переменные считаются раз в минуту, неизменные повторяются раз в 10 минут
+	const Telemetry::Rule	rule{0.01f, 0, 600000, 3};
+	metrics.temp_f		= telemetry.add(mqtt_topic(topic_name, "temp_f"), rule);
+	metrics.dt			= telemetry.add(mqtt_topic(topic_name, "dt"), rule);
+	metrics.Idt			= telemetry.add(mqtt_topic(topic_name, "Idt"), rule);
+	metrics.ch_temp_zad	= telemetry.add(mqtt_topic(topic_name, "ch_temp_zad"), rule);
+	metrics.modulation	= telemetry.add(mqtt_topic(topic_name, "modulation"), rule);
+	metrics.e_temp		= telemetry.add(mqtt_topic(topic_name, "e_temp"), rule);
 }
 
 void	RoomThermostat::setParams(const float& temp, const float& room_mod_max, const json& j)
@@ -84,19 +93,10 @@ void	RoomThermostat::Life(const float timeStep)
 	else if(out.ch_temp_zad > 60.f)	out.ch_temp_zad	= 60.f;
 
 	//Отладочные переменные
-	if(mqtt_client){
-		char	buf[256];
-		sprintf(buf, "%g", temp_f);
-		esp_mqtt_client_publish(mqtt_client, (topic + "temp_f").c_str(), buf, 0, 0, 0);
-		sprintf(buf, "%g", dt);
-		esp_mqtt_client_publish(mqtt_client, (topic + "dt").c_str(), buf, 0, 0, 0);
-		sprintf(buf, "%g", Idt);
-		esp_mqtt_client_publish(mqtt_client, (topic + "Idt").c_str(), buf, 0, 0, 0);
-		sprintf(buf, "%g", out.ch_temp_zad);
-		esp_mqtt_client_publish(mqtt_client, (topic + "ch_temp_zad").c_str(), buf, 0, 0, 0);
-		sprintf(buf, "%g", mod_zad);
-		esp_mqtt_client_publish(mqtt_client, (topic + "modulation").c_str(), buf, 0, 0, 0);
-		sprintf(buf, "%g", e_temp);
-		esp_mqtt_client_publish(mqtt_client, (topic + "e_temp").c_str(), buf, 0, 0, 0);
-	}
+	telemetry.update(metrics.temp_f, temp_f);
+	telemetry.update(metrics.dt, dt);
+	telemetry.update(metrics.Idt, Idt);
+	telemetry.update(metrics.ch_temp_zad, out.ch_temp_zad);
+	telemetry.update(metrics.modulation, mod_zad);
+	telemetry.update(metrics.e_temp, e_temp);
 }
\ No newline at end of file
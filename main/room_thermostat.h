@@ -25,7 +25,10 @@ private:
 	float		Idt			= 25;		//Интеграл ошибки
 
 	Params_t	params;
-	std::string	topic;
+	struct Metrics	//Отладочные метрики Telemetry
+	{
+		uint16_t	temp_f, dt, Idt, ch_temp_zad, modulation, e_temp;
+	}metrics;
 
 public:
 	RoomThermostat(uint8_t temp_index, uint8_t rad_index, const std::string& str_name, const std::string& topic_name);
@@ -0,0 +1,366 @@
+#include <cstring>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "settings_cache.h"
+
+static const char*	TAG = "settings";
+
+SettingsCache	settings_cache;
+
+void	SettingsCache::start(UBaseType_t priority, BaseType_t core)
+{
+	xTaskCreatePinnedToCore(task, "settings", 4096, this, priority, &flush_task, core);
+}
+
+void	SettingsCache::task(void* arg)
+{
+	SettingsCache*	cache		= static_cast<SettingsCache*>(arg);
+	uint32_t		delay_ms	= flush_delay_ms;
+	for(;;)
+	{
+		//Первое изменение будит задачу, изменения за время ожидания уходят тем же сбросом
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		vTaskDelay(pdMS_TO_TICKS(delay_ms));
+		cache->flush();
+
+		//Ключи после ошибки записи остаются изменёнными, а set будит задачу только для чистых ключей:
+		//повтор назначается здесь же, с удвоением паузы
+		bool	failed;
+		{
+			std::lock_guard<std::mutex>	lock(cache->mutex);
+			failed	= cache->failed;
+		}
+		if(failed){
+			delay_ms	= std::min(delay_ms*2, max_retry_delay_ms);
+			xTaskNotifyGive(cache->flush_task);
+		}
+		else
+			delay_ms	= flush_delay_ms;
+	}
+}
+
+SettingsCache::Entry*	SettingsCache::find(const char* ns, const char* key, Type type)
+{
+	for(size_t i = 0; i < count; i++)
+		if(!strcmp(entries[i].ns, ns) && !strcmp(entries[i].key, key))
+			return &entries[i];
+
+	//Ограничение NVS: не более 15 символов в имени раздела и ключа
+	if(strlen(ns) >= sizeof(Entry::ns) || strlen(key) >= sizeof(Entry::key))
+	{
+		ESP_LOGE(TAG, "Слишком длинное имя %s/%s", ns, key);
+		return nullptr;
+	}
+	if(count >= max_entries)
+	{
+		ESP_LOGE(TAG, "Нет места для %s/%s", ns, key);
+		return nullptr;
+	}
+
+	//Первое обращение: чтение из NVS
+	Entry&	entry	= entries[count++];
+	strcpy(entry.ns, ns);
+	strcpy(entry.key, key);
+	entry.type		= type;
+	entry.value		= 0;
+	entry.present	= false;
+	entry.dirty		= false;
+
+	nvs_handle_t	nvs_settings;
+	if(nvs_open(ns, NVS_READONLY, &nvs_settings) == ESP_OK)
+	{
+		switch(type)
+		{
+			case Type::u8:	{uint8_t	val;	if(nvs_get_u8(nvs_settings, key, &val) == ESP_OK)	{entry.value = val; entry.present = true;}}	break;
+			case Type::u16:	{uint16_t	val;	if(nvs_get_u16(nvs_settings, key, &val) == ESP_OK)	{entry.value = val; entry.present = true;}}	break;
+			case Type::i16:	{int16_t	val;	if(nvs_get_i16(nvs_settings, key, &val) == ESP_OK)	{entry.value = val; entry.present = true;}}	break;
+		}
+		nvs_close(nvs_settings);
+	}
+
+	return &entry;
+}
+
+bool	SettingsCache::get(const char* ns, const char* key, Type type, int32_t* value)
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	Entry*	entry	= find(ns, key, type);
+	if(!entry || !entry->present)
+		return false;
+
+	*value	= entry->value;
+	return true;
+}
+
+bool	SettingsCache::get_u8(const char* ns, const char* key, uint8_t* value)
+{
+	int32_t	val;
+	if(!get(ns, key, Type::u8, &val))
+		return false;
+
+	*value	= val;
+	return true;
+}
+
+bool	SettingsCache::get_u16(const char* ns, const char* key, uint16_t* value)
+{
+	int32_t	val;
+	if(!get(ns, key, Type::u16, &val))
+		return false;
+
+	*value	= val;
+	return true;
+}
+
+bool	SettingsCache::get_i16(const char* ns, const char* key, int16_t* value)
+{
+	int32_t	val;
+	if(!get(ns, key, Type::i16, &val))
+		return false;
+
+	*value	= val;
+	return true;
+}
+
+void	SettingsCache::set(const char* ns, const char* key, Type type, int32_t value)
+{
+	bool	wake	= false;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.sets++;
+		Entry*	entry	= find(ns, key, type);
+		if(!entry)
+			return;
+
+		if(entry->present && entry->value == value)
+		{
+			stat.unchanged++;
+			return;
+		}
+
+		entry->value	= value;
+		entry->present	= true;
+		wake			= !entry->dirty;
+		entry->dirty	= true;
+	}
+
+	if(wake && flush_task)
+		xTaskNotifyGive(flush_task);
+}
+
+bool	SettingsCache::set_blob(const char* ns, const char* key, const void* data, size_t size)
+{
+	if(strlen(ns) >= sizeof(Blob::ns) || strlen(key) >= sizeof(Blob::key) || size > max_blob_size)
+	{
+		ESP_LOGE(TAG, "Недопустимый блоб %s/%s: %d байт", ns, key, int(size));
+		return false;
+	}
+
+	bool	wake	= false;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		stat.sets++;
+		Blob*	blob	= nullptr;
+		for(size_t i = 0; i < blob_count; i++)
+			if(!strcmp(blobs[i].ns, ns) && !strcmp(blobs[i].key, key))
+				blob	= &blobs[i];
+
+		if(!blob)
+		{
+			if(blob_count >= max_blobs)
+			{
+				ESP_LOGE(TAG, "Нет места для блоба %s/%s", ns, key);
+				return false;
+			}
+			blob	= &blobs[blob_count++];
+			strcpy(blob->ns, ns);
+			strcpy(blob->key, key);
+			blob->size	= 0;
+			blob->dirty	= false;
+		}
+		else if(blob->size == size && !memcmp(blob->data, data, size))
+		{
+			stat.unchanged++;
+			return true;
+		}
+
+		memcpy(blob->data, data, size);
+		blob->size	= size;
+		wake		= !blob->dirty;
+		blob->dirty	= true;
+	}
+
+	if(wake && flush_task)
+		xTaskNotifyGive(flush_task);
+	return true;
+}
+
+size_t	SettingsCache::flush()
+{
+	//Снимок изменённых ключей, запись в NVS идёт без блокировки кэша
+	std::lock_guard<std::mutex>	flush_lock(flush_mutex);
+	Entry*	pending		= flushing;
+	size_t	num_pending	= 0;
+	size_t	num_blobs	= 0;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		for(size_t i = 0; i < count; i++)
+			if(entries[i].dirty)
+			{
+				pending[num_pending++]	= entries[i];
+				entries[i].dirty		= false;
+			}
+		for(size_t i = 0; i < blob_count; i++)
+			if(blobs[i].dirty)
+			{
+				flushing_blobs[num_blobs++]	= blobs[i];
+				blobs[i].dirty				= false;
+			}
+		if(!num_pending && !num_blobs)
+			failed	= false;
+	}
+	if(!num_pending && !num_blobs)
+		return 0;
+
+	int64_t		start		= esp_timer_get_time();
+	uint32_t	commits		= 0;
+	uint32_t	errors		= 0;
+	size_t		written		= 0;
+	bool		done[max_entries]	= {};
+	for(size_t i = 0; i < num_pending; i++)
+	{
+		if(done[i])
+			continue;
+
+		//Все ключи одного раздела - одним commit
+		nvs_handle_t	nvs_settings;
+		esp_err_t		err		= nvs_open(pending[i].ns, NVS_READWRITE, &nvs_settings);
+		bool			opened	= err == ESP_OK;
+		size_t			num_ns	= 0;
+		for(size_t j = i; j < num_pending; j++)
+		{
+			if(done[j] || strcmp(pending[j].ns, pending[i].ns))
+				continue;
+
+			done[j]	= true;
+			num_ns++;
+			if(err != ESP_OK)
+				continue;
+
+			switch(pending[j].type)
+			{
+				case Type::u8:	err	= nvs_set_u8(nvs_settings, pending[j].key, uint8_t(pending[j].value));		break;
+				case Type::u16:	err	= nvs_set_u16(nvs_settings, pending[j].key, uint16_t(pending[j].value));	break;
+				case Type::i16:	err	= nvs_set_i16(nvs_settings, pending[j].key, int16_t(pending[j].value));		break;
+			}
+		}
+
+		if(err == ESP_OK)
+		{
+			err	= nvs_commit(nvs_settings);
+			commits++;
+		}
+		if(opened)
+			nvs_close(nvs_settings);
+
+		if(err == ESP_OK)
+			written	+= num_ns;
+		else
+		{
+			ESP_LOGE(TAG, "Ошибка записи раздела %s: %s", pending[i].ns, esp_err_to_name(err));
+			errors++;
+
+			//Ключи раздела остаются изменёнными до следующего сброса, если их не переписали
+			std::lock_guard<std::mutex>	lock(mutex);
+			for(size_t j = 0; j < count; j++)
+				if(!strcmp(entries[j].ns, pending[i].ns))
+					for(size_t k = 0; k < num_pending; k++)
+						if(!strcmp(pending[k].ns, entries[j].ns) && !strcmp(pending[k].key, entries[j].key))
+							entries[j].dirty	= true;
+		}
+	}
+
+	//Блобы редки и велики: каждый своим commit
+	for(size_t i = 0; i < num_blobs; i++)
+	{
+		const Blob&		blob	= flushing_blobs[i];
+		nvs_handle_t	nvs_settings;
+		esp_err_t		err		= nvs_open(blob.ns, NVS_READWRITE, &nvs_settings);
+		if(err == ESP_OK)
+		{
+			err	= nvs_set_blob(nvs_settings, blob.key, blob.data, blob.size);
+			if(err == ESP_OK)
+			{
+				err	= nvs_commit(nvs_settings);
+				commits++;
+			}
+			nvs_close(nvs_settings);
+		}
+
+		if(err == ESP_OK)
+			written++;
+		else
+		{
+			ESP_LOGE(TAG, "Ошибка записи блоба %s/%s: %s", blob.ns, blob.key, esp_err_to_name(err));
+			errors++;
+
+			std::lock_guard<std::mutex>	lock(mutex);
+			for(size_t j = 0; j < blob_count; j++)
+				if(!strcmp(blobs[j].ns, blob.ns) && !strcmp(blobs[j].key, blob.key))
+					blobs[j].dirty	= true;
+		}
+	}
+	int64_t	duration	= esp_timer_get_time() - start;
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	stat.flushes++;
+	stat.commits		+= commits;
+	stat.written		+= written;
+	stat.errors			+= errors;
+	stat.last_flush_us	= duration;
+	failed				= errors != 0;
+	if(duration > stat.max_flush_us)
+		stat.max_flush_us	= duration;
+
+	ESP_LOGI(TAG, "Записано ключей: %d, commit: %d, %d мс", int(written), int(commits), int(duration/1000));
+	return written;
+}
+
+size_t	SettingsCache::dirty() const
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	size_t	num	= 0;
+	for(size_t i = 0; i < count; i++)
+		if(entries[i].dirty)	num++;
+	for(size_t i = 0; i < blob_count; i++)
+		if(blobs[i].dirty)		num++;
+
+	return num;
+}
+
+json	SettingsCache::json_stats() const
+{
+	size_t	num_dirty	= dirty();
+	std::lock_guard<std::mutex>	lock(mutex);
+	return json{
+		{"keys", count},
+		{"blobs", blob_count},
+		{"dirty", num_dirty},
+		{"sets", stat.sets},
+		{"unchanged", stat.unchanged},
+		{"flushes", stat.flushes},
+		{"commits", stat.commits},
+		{"written", stat.written},
+		{"errors", stat.errors},
+		{"last_flush_ms", stat.last_flush_us*0.001},
+		{"max_flush_ms", stat.max_flush_us*0.001}
+	};
+}
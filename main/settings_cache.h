@@ -0,0 +1,93 @@
+#ifndef SETTINGS_CACHE_H
+#define SETTINGS_CACHE_H
+
+#include <mutex>
+
+//Кэш настроек NVS в RAM с отложенной записью.
+//Каждый ключ читается из NVS один раз, запись помечает его изменённым только при новом значении.
+//Изменённые ключи пишутся пачкой (один commit на раздел) из задачи с низким приоритетом
+class SettingsCache
+{
+public:
+	struct Stats
+	{
+		uint32_t	sets		= 0;	//Вызовов set_*
+		uint32_t	unchanged	= 0;	//...из них с тем же значением
+		uint32_t	flushes		= 0;	//Сбросов с записью
+		uint32_t	commits		= 0;	//nvs_commit (по одному на раздел за сброс)
+		uint32_t	written		= 0;	//Записанных ключей
+		uint32_t	errors		= 0;
+		int64_t		last_flush_us	= 0;
+		int64_t		max_flush_us	= 0;	//Самый долгий сброс
+	};
+
+private:
+	enum class Type: uint8_t{u8, u16, i16};
+	struct Entry
+	{
+		char		ns[16];
+		char		key[16];
+		Type		type;
+		int32_t		value;
+		bool		present;	//Ключ есть в NVS или был записан
+		bool		dirty;
+	};
+	//Двоичное значение (карта ID котла): пишется тем же отложенным сбросом, отдельным nvs_set_blob
+	static constexpr size_t		max_blob_size		= 160;
+	struct Blob
+	{
+		char		ns[16];
+		char		key[16];
+		uint8_t		data[max_blob_size];
+		size_t		size;
+		bool		dirty;
+	};
+	static constexpr size_t		max_entries			= 32;
+	static constexpr size_t		max_blobs			= 4;
+	static constexpr uint32_t	flush_delay_ms		= 5000;		//Ожидание следующих изменений перед записью
+	static constexpr uint32_t	max_retry_delay_ms	= 300000;	//Наибольшая пауза повтора после ошибки записи
+
+	Entry				entries[max_entries];
+	size_t				count		= 0;
+	Blob				blobs[max_blobs];
+	size_t				blob_count	= 0;
+	Stats				stat;
+	bool				failed		= false;	//Прошлый сброс не записал часть ключей
+	mutable std::mutex	mutex;
+	TaskHandle_t		flush_task	= nullptr;
+
+	//Копия изменённых ключей для записи без блокировки кэша. Член, а не локальная переменная:
+	//~1.4 КБ на стеке задачи settings (4 КБ) и вызывающих flush задач - слишком много
+	Entry				flushing[max_entries];
+	Blob				flushing_blobs[max_blobs];
+	std::mutex			flush_mutex;		//Сбросы из задачи settings, Telegram и TCP по очереди
+
+	Entry*	find(const char* ns, const char* key, Type type);	//Под mutex. При первом обращении читает NVS
+	bool	get(const char* ns, const char* key, Type type, int32_t* value);
+	void	set(const char* ns, const char* key, Type type, int32_t value);
+	static void	task(void* arg);
+
+public:
+	//Задача отложенной записи
+	void	start(UBaseType_t priority, BaseType_t core);
+
+	bool	get_u8(const char* ns, const char* key, uint8_t* value);
+	bool	get_u16(const char* ns, const char* key, uint16_t* value);
+	bool	get_i16(const char* ns, const char* key, int16_t* value);
+	void	set_u8(const char* ns, const char* key, uint8_t value)		{set(ns, key, Type::u8, value);}
+	void	set_u16(const char* ns, const char* key, uint16_t value)	{set(ns, key, Type::u16, value);}
+	void	set_i16(const char* ns, const char* key, int16_t value)		{set(ns, key, Type::i16, value);}
+	//Копия данных уходит в кэш, вызывающий не ждёт NVS. Читается блоб напрямую из NVS при запуске.
+	//false - имя слишком длинное, данные больше max_blob_size или нет места
+	bool	set_blob(const char* ns, const char* key, const void* data, size_t size);
+
+	//Немедленная запись всех изменённых ключей (например, перед перезагрузкой). Возвращает число ключей
+	size_t	flush();
+
+	size_t	dirty() const;
+	json	json_stats() const;
+};
+
+extern SettingsCache	settings_cache;
+
+#endif	//SETTINGS_CACHE_H
@@ -20,6 +20,10 @@ using json = nlohmann::json;
 #include "boiler_task.h"
 #include "mqtt.h"
 #include "tcp_server.h"
+#include "settings_cache.h"
+#include "command_bus.h"
+#include "telemetry.h"
+#include "mqtt_outbox.h"
 
 static const char *TAG = "tcp_server";
 char	rx_buffer[1024];
@@ -28,6 +32,16 @@ bool	send_to_socket(const int sock, const json& j);
 constexpr gpio_num_t	pin_led				= GPIO_NUM_2;
 bool	tcp_server_is_listening	= false;
 
+//Команда задаче котла с ожиданием своего ответа
+static json	boiler_command(BoilerCommand_t type, const json& params)
+{
+	json	boiler_response;
+	if(!command_bus.call(type, CommandSource_t::tcp, params, &boiler_response))
+		return {{"result", "no answer from task_boiler"}};
+
+	return {{"result", "ok"}, {"response", boiler_response}};
+}
+
 void	tcp_server(void *pvParameters)
 {
 	gpio_pad_select_gpio(pin_led);
@@ -114,7 +128,8 @@ void	tcp_server(void *pvParameters)
 
 void	parse_tcp_message(const int sock)
 {
-	json	response;
+	json					response;
+	std::vector<uint8_t>	binary;		//Двоичный ответ вместо json
 
 	//Приём строки
 	int	len	= recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
@@ -152,11 +167,20 @@ void	parse_tcp_message(const int sock)
 				//Статус
 				if(command == "status"){
 					json j;
-					if(pControlStatus)
-						j["control"]			= *pControlStatus;
+					j["control"]				= control_json_status();
 					if(pBoiler)
 						j["Котёл"]				= pBoiler->json_status();
+					json	cascade	= cascade_json_status();
+					if(!cascade.empty())
+						j["Каскад"]				= cascade;
+					if(pGateway)
+						j["Шлюз"]				= pGateway->json_status();
 					j["Датчики температуры"]	= thermo_json_status();
+					j["Настройки"]				= settings_cache.json_stats();
+					j["Команды"]				= command_bus.json_stats();
+					j["Телеметрия"]				= telemetry.json_stats();
+					j["Накопитель MQTT"]		= mqtt_outbox.json_stats();
+					j["Команды MQTT"]			= mqtt_json_stats();
 					j["Связь"]					= {
 						{"OpenTherm", pBoiler && pBoiler->openTherm_is_correct()},
 						{"MQTT", (mqtt_client != nullptr)},
@@ -185,85 +209,82 @@ void	parse_tcp_message(const int sock)
 					if(!j.contains("boiler_data"))	response	= {{"result", "Отсутствует boiler_data"}};
 					else{
 						if(!j.at("boiler_data").is_object())	response	= {{"result", "boiler_data не объект"}};
-						else{
-							json	boiler_data	= j.at("boiler_data");
-
-							//Постановка сообщения в очередь
-							fromTCP_to_ot*	msg	= new fromTCP_to_ot(TCP_message_t::set_boiler_data, boiler_data);
-							xQueueGenericSend(from_TCP_ot_queue, &msg, 10, queueSEND_TO_FRONT);
-
-							//Ожидание ответа
-							toTCP_from_ot*	boiler_response	= nullptr;
-							if(xQueueReceive(to_TCP_ot_queue, &boiler_response, pdMS_TO_TICKS(5000)) == pdPASS){
-								response	= {{"result", "ok"},{"response", boiler_response->response}};
-								if(boiler_response)	delete boiler_response;
-							}
-							else{
-								response	= {{"result", "no answer from task_boiler"}};
-							}
-						}
+						else									response	= boiler_command(BoilerCommand_t::set_boiler_data, j.at("boiler_data"));
 					}
 				}
 
 				//Принудительный сброс ошибки
 				else if(command == "BLOR"){
-					//Постановка сообщения в очередь
-					fromTCP_to_ot*	msg	= new fromTCP_to_ot(TCP_message_t::BLOR, json{{"params", ""}});
-					xQueueGenericSend(from_TCP_ot_queue, &msg, 10, queueSEND_TO_FRONT);
-
-					//Ожидание ответа
-					toTCP_from_ot*	boiler_response	= nullptr;
-					if(xQueueReceive(to_TCP_ot_queue, &boiler_response, pdMS_TO_TICKS(5000)) == pdPASS){
-						response	= {{"result", "ok"}, {"response", boiler_response->response}};
-						if(boiler_response)	delete boiler_response;
-					}
-					else{response	= {{"result", "no answer from task_boiler"}};}
+					response	= boiler_command(BoilerCommand_t::BLOR, json{{"params", ""}});
 				}
 
 				//Тестирование обмена с котлом
 				else if(command == "test_ot_command"){
 					if(!j.contains("ot_data"))				response	= {{"result", "Отсутствует ot_data"}};
 					else if(!j.at("ot_data").is_object())	response	= {{"result", "ot_data не объект"}};
-					else{
-						json	ot_data	= j.at("ot_data");
-
-						//Постановка сообщения в очередь
-						fromTCP_to_ot*	msg	= new fromTCP_to_ot(TCP_message_t::test_ot_command, ot_data);
-						xQueueGenericSend(from_TCP_ot_queue, &msg, 10, queueSEND_TO_FRONT);
-
-						//Ожидание ответа
-						toTCP_from_ot*	boiler_response	= nullptr;
-						if(xQueueReceive(to_TCP_ot_queue, &boiler_response, pdMS_TO_TICKS(5000)) == pdPASS){
-							response	= {{"result", "ok"}, {"response", boiler_response->response}};
-							if(boiler_response)	delete boiler_response;
-						}
-						else{response	= {{"result", "no answer from task_boiler"}};}
+					else									response	= boiler_command(BoilerCommand_t::test_ot_command, j.at("ot_data"));
+				}
+
+				//Карта поддерживаемых котлом ID. С "sweep": true - повторный обход ведущего котла
+				else if(command == "capabilities"){
+					json		params	= j.contains("params") ? j.at("params") : json::object();
+					size_t		bus		= (params.is_object() && params.contains("bus") && params.at("bus").is_number_unsigned()) ? params.at("bus").get<size_t>() : 0;
+					const OT_Boiler*	boiler	= ot_bus_boiler(bus);
+					if(!boiler)				response	= {{"result", "Нет котла на шине " + std::to_string(bus)}};
+					else if(params.is_object() && params.value("sweep", false)){
+						if(bus != 0)		response	= {{"result", "Повторный обход только для ведущего котла"}};
+						else		response	= boiler_command(BoilerCommand_t::capability_sweep, params);
 					}
+					else					response	= {{"result", "ok"}, {"response", boiler->json_capabilities()}};
+				}
+
+				//Исходы обменов и время ответа котла по каждому ID
+				else if(command == "id_stats"){
+					json		params	= j.contains("params") ? j.at("params") : json::object();
+					size_t		bus		= (params.is_object() && params.contains("bus") && params.at("bus").is_number_unsigned()) ? params.at("bus").get<size_t>() : 0;
+					const OT_Boiler*	boiler	= ot_bus_boiler(bus);
+					if(!boiler)				response	= {{"result", "Нет котла на шине " + std::to_string(bus)}};
+					else					response	= {{"result", "ok"}, {"response", boiler->json_id_stats()}};
 				}
 
 				//Включение моего термостата
 				else if(command == "PID_thermostat"){
 					if(!j.contains("params"))				response	= {{"result", "Отсутствует params"}};
 					else if(!j.at("params").is_object())	response	= {{"result", "params не объект"}};
-					else{
-						json	params	= j.at("params");
-
-						//Постановка сообщения в очередь
-						fromTCP_to_ot*	msg	= new fromTCP_to_ot(TCP_message_t::PID_thermostat, params);
-						xQueueGenericSend(from_TCP_ot_queue, &msg, 10, queueSEND_TO_FRONT);
-
-						//Ожидание ответа
-						toTCP_from_ot*	boiler_response	= nullptr;
-						if(xQueueReceive(to_TCP_ot_queue, &boiler_response, pdMS_TO_TICKS(5000)) == pdPASS){
-							response	= {{"result", "ok"}, {"response", boiler_response->response}};
-							if(boiler_response)	delete boiler_response;
-						}
-						else{response	= {{"result", "no answer from task_boiler"}};}
+					else									response	= boiler_command(BoilerCommand_t::PID_thermostat, j.at("params"));
+				}
+
+				//Подмена данных шлюза между термостатом и котлом
+				else if(command == "gateway"){
+					if(!pGateway)								response	= {{"result", "Шлюз отключён"}};
+					else if(!j.contains("params"))				response	= {{"result", "Отсутствует params"}};
+					else if(!j.at("params").is_object())		response	= {{"result", "params не объект"}};
+					else										response	= {{"result", "ok"}, {"response", pGateway->command(j.at("params"))}};
+				}
+
+				//Выгрузка самописца обменов: в ответ идёт двоичный блок OT_Recorder
+				else if(command == "flight_recorder"){
+					json		params	= j.contains("params") ? j.at("params") : json::object();
+					size_t		bus		= (params.is_object() && params.contains("bus") && params.at("bus").is_number_unsigned()) ? params.at("bus").get<size_t>() : 0;
+					const OT_Boiler*	boiler	= ot_bus_boiler(bus);
+					if(!boiler)				response	= {{"result", "Нет котла на шине " + std::to_string(bus)}};
+					else if(params.is_object() && params.value("save", false)){
+						if(boiler->save_flight_recorder())	response	= {{"result", "ok"}, {"response", boiler->flight_recorder_file()}};
+						else								response	= {{"result", "Не удалось сохранить самописец"}};
 					}
+					else					binary		= boiler->flight_recorder();
+				}
+
+				//Режим телеметрии: отдельные топики и/или кадр, формат и период кадра. Без params - текущий
+				else if(command == "telemetry"){
+					json	params	= j.contains("params") ? j.at("params") : json::object();
+					if(!params.is_object())		response	= {{"result", "params не объект"}};
+					else						response	= {{"result", "ok"}, {"response", telemetry.command(params)}};
 				}
 
 				//Принудительная перезагрузка
 				else if(command == "reboot"){
+					settings_cache.flush();
 					esp_restart();
 				}
 
@@ -277,17 +298,17 @@ void	parse_tcp_message(const int sock)
 		}
 	}
 
-	//Очистка очереди ответов
-	toTCP_from_ot*	boiler_response	= nullptr;
-	while(xQueueReceive(to_TCP_ot_queue, &boiler_response, pdMS_TO_TICKS(0)) == pdPASS){
-		if(boiler_response)	delete boiler_response;
-	}
-
 	//Отправка ответа
 	std::string	msg	= response.dump();
-	ESP_LOGI(TAG, "response: %s", msg.c_str());
 	const char*	buf	= msg.c_str();
 	size_t	buf_len	= msg.length();
+	if(!binary.empty()){
+		ESP_LOGI(TAG, "response: %d bytes", int(binary.size()));
+		buf		= reinterpret_cast<const char*>(binary.data());
+		buf_len	= binary.size();
+	}
+	else
+		ESP_LOGI(TAG, "response: %s", msg.c_str());
 	size_t	to_write = buf_len;
 	while(to_write > 0)
 	{
@@ -26,11 +26,13 @@ using json = nlohmann::json;
 #include "boiler_task.h"
 #include "mqtt.h"
 #include "tcp_server.h"
+#include "settings_cache.h"
+#include "command_bus.h"
 
 static const char*	TAG	= "telegram";
 static char	http_reply[16384];
 void	send_to_gpio(const Telegram_client::Message& message, const telegram_message_t& command);
-void	send_to_ot(const Telegram_client::Message& message, const telegram_ot_message_t& command);
+void	send_to_ot(const Telegram_client::Message& message, BoilerCommand_t command);
 
 void	telegram(void* unused)
 {
@@ -134,6 +136,7 @@ void	telegram(void* unused)
 				{
 					ESP_LOGI("telegram", "Успешно, перезагрузка...");
 					bot.sendMessage("Успешно, перезагрузка...", message.chat_id);
+					settings_cache.flush();
 					esp_restart();
 				}
 				else
@@ -161,6 +164,7 @@ void	telegram(void* unused)
 			else if(message.text.rfind("/reboot", 0) == 0)
 			{
 				bot.getMessages(0);
+				settings_cache.flush();
 				esp_restart();
 			}
 			else if(message.text.rfind("/status", 0) == 0)
@@ -180,6 +184,9 @@ void	telegram(void* unused)
 			{
 				json j;
 				if(pBoiler)	j["Котёл"]		= pBoiler->json_status();
+				json	cascade	= cascade_json_status();
+				if(!cascade.empty())	j["Каскад"]	= cascade;
+				if(pGateway)			j["Шлюз"]	= pGateway->json_status();
 				j["Датчики температуры"]	= thermo_json_status();
 				j["Связь"]					= {
 					{"OpenTherm", pBoiler && pBoiler->openTherm_is_correct()},
@@ -206,8 +213,8 @@ void	telegram(void* unused)
 			else if((message.text.rfind("/thermostat", 0) == 0))		send_to_gpio(message, telegram_message_t::program);
 			else if((message.text.rfind("/get_log", 0) == 0))			send_log(&bot, message.chat_id, false);
 			else if((message.text.rfind("/get_new_log", 0) == 0))		send_log(&bot, message.chat_id, true);
-			else if((message.text.rfind("/set_boiler_data", 0) == 0))	send_to_ot(message, telegram_ot_message_t::set_boiler_data);
-			else if((message.text.rfind("/BLOR", 0) == 0))				send_to_ot(message, telegram_ot_message_t::BLOR);
+			else if((message.text.rfind("/set_boiler_data", 0) == 0))	send_to_ot(message, BoilerCommand_t::set_boiler_data);
+			else if((message.text.rfind("/BLOR", 0) == 0))				send_to_ot(message, BoilerCommand_t::BLOR);
 			else if((message.text.rfind("/set_heads_3", 0) == 0))
 			{
 				//Времянка для теста термоголовок
@@ -236,13 +243,38 @@ void	send_to_gpio(const Telegram_client::Message& message, const telegram_messag
 	xQueueGenericSend(from_telegram_gpio_queue, &msg, 10, queueSEND_TO_BACK);
 }
 
-void	send_to_ot(const Telegram_client::Message& message, const telegram_ot_message_t& command)
+static void	send_to_telegram(const std::string& text, int64_t chat_id, int64_t reply_id)
 {
-	fromTelegram_ot*	msg	= new fromTelegram_ot;
-	msg->chat_id	= message.chat_id;
-	msg->reply_id	= message.message_id;
-	msg->type		= command;
-	msg->text		= message.text;
+	toTelegram*	send	= new toTelegram;
+	send->text		= text;
+	send->chat_id	= chat_id;
+	send->reply_id	= reply_id;
+
+	xQueueGenericSend(to_telegram_queue, &send, 10, queueSEND_TO_BACK);
+}
+
+void	send_to_ot(const Telegram_client::Message& message, BoilerCommand_t command)
+{
+	const int64_t	chat_id		= message.chat_id;
+	const int64_t	reply_id	= message.message_id;
+
+	json	params	= json::object();
+	if(command == BoilerCommand_t::set_boiler_data)
+	{
+		std::string	text	= message.text.substr(strlen("/set_boiler_data"));
+		params	= json::parse(text, nullptr, false);
+		if(params.is_discarded())
+		{
+			send_to_telegram("json::parse error\n" + text, chat_id, reply_id);
+			return;
+		}
+	}
 
-	xQueueGenericSend(from_telegram_ot_queue, &msg, 10, queueSEND_TO_BACK);
+	//Ответ придёт в задаче котла, отсюда он уходит через общую очередь сообщений
+	uint32_t	id	= command_bus.submit(command, CommandSource_t::telegram, params, [command, chat_id, reply_id](uint32_t, const json& response){
+		if(command == BoilerCommand_t::BLOR)	send_to_telegram(std::string("BLOR ") + response.value("BLOR", "fail"), chat_id, reply_id);
+		else									send_to_telegram(response.dump(4), chat_id, reply_id);
+	});
+	if(!id)
+		send_to_telegram("Котёл занят, команда не принята", chat_id, reply_id);
 }
@@ -0,0 +1,397 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "mqtt.h"
+#include "mqtt_outbox.h"
+#include "settings_cache.h"
+#include "telemetry.h"
+
+static const char*	TAG = "telemetry";
+
+Telemetry	telemetry;
+
+void	Telemetry::start(UBaseType_t priority, BaseType_t core)
+{
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		started	= true;
+	}
+	//Кадр собирается на стеке задачи: json всего состояния и его CBOR
+	xTaskCreatePinnedToCore(task, "telemetry", 8192, this, priority, nullptr, core);
+}
+
+void	Telemetry::task(void* arg)
+{
+	Telemetry*	engine	= static_cast<Telemetry*>(arg);
+	for(;;)
+	{
+		engine->poll();
+		vTaskDelay(pdMS_TO_TICKS(poll_period_ms));
+	}
+}
+
+int64_t	Telemetry::stagger(size_t index, int64_t now) const
+{
+	//Доли периода по золотому сечению: соседние метрики получают далёкие друг от друга сроки
+	double	phase	= fmod(index*0.6180339887, 1.);
+	return now + int64_t(metrics[index].rule.heartbeat_ms*1000.*(0.5 + 0.5*phase));
+}
+
+void	Telemetry::set_mode(Mode new_mode, uint16_t topic, uint32_t period_ms, FrameFormat format)
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	mode			= new_mode;
+	frame_topic		= topic;
+	frame_period_ms	= period_ms;
+	frame_format	= format;
+	frame_us		= esp_timer_get_time();
+	if(mode != Mode::topics && topic == mqtt_no_topic)
+	{
+		ESP_LOGE(TAG, "Кадр телеметрии без топика, только отдельные топики");
+		mode	= Mode::topics;
+	}
+}
+
+void	Telemetry::restore_mode(Mode mode, uint16_t topic, uint32_t period_ms, FrameFormat format)
+{
+	uint8_t		val;
+	uint16_t	period_s;
+	if(settings_cache.get_u8(nvs_namespace, "mode", &val) && val <= uint8_t(Mode::both))				mode		= Mode(val);
+	if(settings_cache.get_u8(nvs_namespace, "format", &val) && val <= uint8_t(FrameFormat::cbor))		format		= FrameFormat(val);
+	if(settings_cache.get_u16(nvs_namespace, "period_s", &period_s) && period_s >= 1 && period_s <= 3600)	period_ms	= period_s*1000u;
+	set_mode(mode, topic, period_ms, format);
+}
+
+json	Telemetry::command(const json& params)
+{
+	Mode		new_mode;
+	FrameFormat	format;
+	uint32_t	period_ms;
+	uint16_t	topic;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		new_mode	= mode;
+		format		= frame_format;
+		period_ms	= frame_period_ms;
+		topic		= frame_topic;
+	}
+
+	if(params.contains("mode")){
+		const json&	v	= params.at("mode");
+		if(v == "topics")		new_mode	= Mode::topics;
+		else if(v == "frame")	new_mode	= Mode::frame;
+		else if(v == "both")	new_mode	= Mode::both;
+		else					return {{"fail", "mode: topics, frame или both"}};
+	}
+	if(params.contains("format")){
+		const json&	v	= params.at("format");
+		if(v == "json")			format	= FrameFormat::json;
+		else if(v == "cbor")	format	= FrameFormat::cbor;
+		else					return {{"fail", "format: json или cbor"}};
+	}
+	if(params.contains("period_s")){
+		const json&	v	= params.at("period_s");
+		if(!v.is_number_integer() || v.get<int64_t>() < 1 || v.get<int64_t>() > 3600)
+			return {{"fail", "period_s: 1..3600"}};
+		period_ms	= uint32_t(v.get<int64_t>())*1000;
+	}
+
+	set_mode(new_mode, topic, period_ms, format);
+
+	std::lock_guard<std::mutex>	lock(mutex);
+	settings_cache.set_u8(nvs_namespace, "mode", uint8_t(mode));
+	settings_cache.set_u8(nvs_namespace, "format", uint8_t(frame_format));
+	settings_cache.set_u16(nvs_namespace, "period_s", uint16_t(frame_period_ms/1000));
+	return {
+		{"mode", mode == Mode::topics ? "topics" : (mode == Mode::frame ? "frame" : "both")},
+		{"format", frame_format == FrameFormat::cbor ? "cbor" : "json"},
+		{"period_s", frame_period_ms/1000}
+	};
+}
+
+void	Telemetry::frame_group(const std::string& prefix, const char* name)
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	if(started || frame_groups.size() > 0xff)
+	{
+		ESP_LOGE(TAG, "Группа кадра %s не добавлена", name);
+		return;
+	}
+	frame_groups.push_back({prefix, name});
+}
+
+Telemetry::Handle	Telemetry::add(uint16_t topic, const Rule& rule)
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	if(count >= max_metrics || topic == mqtt_no_topic)
+	{
+		ESP_LOGE(TAG, "Метрика %s не зарегистрирована", topic == mqtt_no_topic ? "без топика" : mqtt_topic_name(topic));
+		return no_metric;
+	}
+
+	Metric&	m		= metrics[count];
+	m				= Metric();
+	m.topic			= topic;
+	m.rule			= rule;
+	m.heartbeat_us	= stagger(count, esp_timer_get_time());
+	return Handle(count++);
+}
+
+void	Telemetry::format(const Metric& m, char* text, size_t size)
+{
+	snprintf(text, size, "%.*f", int(m.rule.precision), m.value);
+}
+
+void	Telemetry::prepare(Metric& m, int64_t now, Message* msg)
+{
+	m.published		= m.value;
+	m.is_published	= true;
+	m.kept			= false;
+	m.pending		= false;
+	m.published_us	= now;
+	if(m.rule.heartbeat_ms)
+		m.heartbeat_us	= now + int64_t(m.rule.heartbeat_ms)*1000;
+
+	msg->topic	= m.topic;
+	format(m, msg->text, sizeof(msg->text));
+}
+
+void	Telemetry::keep(Metric& m, int64_t now, Message* msg)
+{
+	//Изменение уходит в outbox с отметкой времени (вызывающий после снятия блокировки). Outbox доставит его
+	//после подключения, поэтому для повторов оно опубликовано сейчас
+	msg->topic	= m.topic;
+	format(m, msg->text, sizeof(msg->text));
+
+	m.published		= m.value;
+	m.is_published	= true;
+	m.kept			= true;
+	m.pending		= false;
+	m.published_us	= now;
+	if(m.rule.heartbeat_ms)
+		m.heartbeat_us	= now + int64_t(m.rule.heartbeat_ms)*1000;
+	stat.offline++;
+}
+
+void	Telemetry::update(Handle metric, float value)
+{
+	Message	msg;
+	bool	offline	= false;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		if(metric >= count)
+			return;
+
+		Metric&	m	= metrics[metric];
+		int64_t	now	= esp_timer_get_time();
+		m.value		= value;
+		m.has_value	= true;
+		stat.updates++;
+		if(mode == Mode::frame && mqtt_client){
+			//Значение уйдёт в кадре. Без связи зона и интервал отсчитываются от него, как от опубликованного
+			m.published		= value;
+			m.is_published	= true;
+			m.kept			= false;
+			m.pending		= false;
+			m.published_us	= now;
+			return;
+		}
+
+		if(m.is_published && (value == m.published || fabsf(value - m.published) < m.rule.deadband)){
+			//Значение вернулось к опубликованному: отложенная публикация больше не нужна
+			m.pending	= false;
+			stat.suppressed++;
+			return;
+		}
+		if(m.is_published && now - m.published_us < int64_t(m.rule.min_interval_ms)*1000){
+			if(!m.pending)	stat.deferred++;
+			m.pending	= true;
+			return;
+		}
+		offline	= !mqtt_client;
+		if(offline)
+			keep(m, now, &msg);
+		else{
+			prepare(m, now, &msg);
+			stat.sent++;
+		}
+	}
+
+	//Сеть и outbox - без блокировки, чтобы задачи котла и датчиков не ждали друг друга
+	if(offline)	mqtt_outbox.store(msg.topic, msg.text);
+	else		mqtt_publish(msg.topic, msg.text);
+}
+
+void	Telemetry::poll()
+{
+	Message	msgs[max_heartbeats + 8];
+	size_t	num_msgs	= 0;
+	Message	kept[8];
+	size_t	num_kept	= 0;
+	size_t		num_values	= 0;
+	uint32_t	seq			= 0;
+	FrameFormat	format		= FrameFormat::json;
+	uint16_t	topic		= mqtt_no_topic;
+	bool		kept_frame	= false;
+	{
+		std::lock_guard<std::mutex>	lock(mutex);
+		int64_t	now	= esp_timer_get_time();
+
+		//После подключения состояние уходит повторами, разнесёнными по времени. Значения из outbox не повторяются:
+		//их доставит он сам
+		bool	connected	= mqtt_client != nullptr;
+		if(connected && !online)
+		{
+			for(size_t i = 0; i < count; i++)
+			{
+				if(!metrics[i].kept)
+					metrics[i].heartbeat_us	= now + (stagger(i, now) - now)/60;
+				metrics[i].kept	= false;
+			}
+			frame_us	= now;
+		}
+		online	= connected;
+
+		size_t	heartbeats	= 0;
+		for(size_t i = 0; i < count && num_msgs < sizeof(msgs)/sizeof(msgs[0]) && num_kept < sizeof(kept)/sizeof(kept[0]); i++)
+		{
+			Metric&	m	= metrics[i];
+			if(!m.has_value)
+				continue;
+
+			//Без связи отложенное изменение уходит в outbox в любом режиме, при связи в режиме кадра его несёт кадр
+			if(m.pending && now - m.published_us >= int64_t(m.rule.min_interval_ms)*1000){
+				if(!online)
+					keep(m, now, &kept[num_kept++]);
+				else if(mode == Mode::frame)
+					m.pending	= false;
+				else{
+					prepare(m, now, &msgs[num_msgs++]);
+					stat.sent++;
+				}
+			}
+			else if(!online || mode == Mode::frame)
+				continue;
+			else if(m.rule.heartbeat_ms && now >= m.heartbeat_us && heartbeats < max_heartbeats){
+				prepare(m, now, &msgs[num_msgs++]);
+				heartbeats++;
+				stat.heartbeats++;
+			}
+		}
+
+		//Кадр всего состояния: один пакет вместо десятков. Под mutex только копия значений.
+		//Без связи кадр любого формата уходит в mqtt_outbox, реже обычного
+		if(mode != Mode::topics && now >= frame_us)
+		{
+			frame_us	= now + int64_t(online ? frame_period_ms : std::max(frame_period_ms, offline_frame_ms))*1000;
+			kept_frame	= !online;
+			num_values	= snapshot_frame();
+			seq			= ++frame_seq;
+			format		= frame_format;
+			topic		= frame_topic;
+		}
+	}
+
+	std::vector<uint8_t>	frame;
+	if(seq)
+	{
+		frame	= build_frame(num_values, seq, format);
+		std::lock_guard<std::mutex>	lock(mutex);
+		if(kept_frame)	stat.offline_frames++;
+		else			stat.frames++;
+		stat.frame_bytes	= frame.size();
+	}
+
+	for(size_t i = 0; i < num_kept; i++)
+		mqtt_outbox.store(kept[i].topic, kept[i].text);
+	for(size_t i = 0; i < num_msgs; i++)
+		mqtt_publish(msgs[i].topic, msgs[i].text);
+	if(kept_frame)
+		mqtt_outbox.store_frame(topic, frame.data(), frame.size());
+	else if(!frame.empty())
+		mqtt_publish(topic, reinterpret_cast<const char*>(frame.data()), frame.size());
+
+	//Без связи накопленное переносится из RAM в SPIFFS, после подключения отправляется по времени
+	mqtt_outbox.poll(online ? replay_per_poll : 0);
+}
+
+size_t	Telemetry::snapshot_frame()
+{
+	size_t	num	= 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		const Metric&	m		= metrics[i];
+		const char*		name	= mqtt_topic_name(m.topic);
+		if(!m.has_value || !name)
+			continue;
+
+		for(size_t g = 0; g < frame_groups.size(); g++)
+			if(strncmp(name, frame_groups[g].prefix.c_str(), frame_groups[g].prefix.length()) == 0)
+			{
+				frame_values[num++]	= {m.topic, uint8_t(g), m.rule.precision, m.value};
+				break;
+			}
+	}
+	return num;
+}
+
+std::vector<uint8_t>	Telemetry::build_frame(size_t num_values, uint32_t seq, FrameFormat format) const
+{
+	timeval	tv;
+	gettimeofday(&tv, nullptr);
+
+	json	j	= {
+		{"seq", seq},
+		{"t", int64_t(tv.tv_sec)*1000 + tv.tv_usec/1000}
+	};
+	for(size_t i = 0; i < num_values; i++)
+	{
+		//Имена топиков не меняются после регистрации, группы - после start
+		const FrameValue&	v		= frame_values[i];
+		const FrameGroup&	group	= frame_groups[v.group];
+		const char*			key		= mqtt_topic_name(v.topic) + group.prefix.length();
+
+		//Округление до точности метрики, чтобы в кадр не попадали хвосты float
+		if(v.precision == 0)
+			j[group.name][key]	= int64_t(lroundf(v.value));
+		else{
+			double	scale	= pow(10., v.precision);
+			j[group.name][key]	= round(v.value*scale)/scale;
+		}
+	}
+
+	if(format == FrameFormat::cbor)
+		return json::to_cbor(j);
+
+	std::string	text	= j.dump();
+	return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+json	Telemetry::json_stats() const
+{
+	std::lock_guard<std::mutex>	lock(mutex);
+	return json{
+		{"metrics", count},
+		{"updates", stat.updates},
+		{"sent", stat.sent},
+		{"heartbeats", stat.heartbeats},
+		{"suppressed", stat.suppressed},
+		{"deferred", stat.deferred},
+		{"offline", stat.offline},
+		{"mode", mode == Mode::topics ? "topics" : (mode == Mode::frame ? "frame" : "both")},
+		{"format", frame_format == FrameFormat::cbor ? "cbor" : "json"},
+		{"period_s", frame_period_ms/1000},
+		{"frames", stat.frames},
+		{"offline_frames", stat.offline_frames},
+		{"frame_bytes", stat.frame_bytes}
+	};
+}
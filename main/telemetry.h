@@ -0,0 +1,140 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Публикация телеметрии в MQTT по единым правилам для котла, датчиков температуры и термостатов.
+//Значение уходит, когда отошло от опубликованного не меньше чем на deadband, но не чаще min_interval_ms;
+//изменение внутри интервала публикуется в его конце. Без изменений значение повторяется раз в heartbeat_ms,
+//чтобы не было разрывов графиков. Сроки повторов разнесены по метрикам и выбираются не больше
+//нескольких за проход, поэтому полной отправки всего состояния одним залпом нет.
+//Без связи с брокером изменения по тем же правилам копятся в mqtt_outbox с отметкой времени, в том числе в режиме кадра.
+//Значение, ушедшее в mqtt_outbox, считается опубликованным: после подключения его доставляет outbox, а повтор
+//по heartbeat идёт в обычный срок. Остальные метрики после подключения повторяются разнесённо и быстрее обычного.
+//Вместо отдельных топиков или вместе с ними всё состояние может уходить одним кадром раз в период:
+//{"seq": номер, "t": мс UTC, "<группа>": {"<остаток топика>": значение, ...}, ...} в JSON или CBOR.
+//Без связи кадры в любом формате копятся в mqtt_outbox не чаще offline_frame_ms.
+//Режим, формат и период кадра - настройки раздела "telemetry", меняются командой без перезагрузки
+class Telemetry
+{
+public:
+	using Handle	= uint16_t;
+	static constexpr Handle	no_metric	= 0xffff;
+
+	enum class Mode: uint8_t{topics, frame, both};
+	enum class FrameFormat: uint8_t{json, cbor};
+
+	struct Rule
+	{
+		float		deadband		= 0;		//Изменение, меньше которого значение не публикуется
+		uint32_t	min_interval_ms	= 0;		//Не чаще
+		uint32_t	heartbeat_ms	= 3600000;	//Не реже (0 - без повторов)
+		uint8_t		precision		= 2;		//Знаков после запятой
+	};
+
+	struct Stats
+	{
+		uint32_t	updates		= 0;	//Вызовов update
+		uint32_t	sent		= 0;	//Публикаций по изменению
+		uint32_t	heartbeats	= 0;	//Повторов без изменения
+		uint32_t	suppressed	= 0;	//Изменений внутри deadband
+		uint32_t	deferred	= 0;	//Изменений, отложенных до конца min_interval
+		uint32_t	offline		= 0;	//Изменений без MQTT, отданных в mqtt_outbox
+		uint32_t	frames		= 0;	//Отправленных кадров
+		uint32_t	offline_frames	= 0;	//Кадров без связи, отданных в mqtt_outbox
+		uint32_t	frame_bytes	= 0;	//Размер последнего кадра
+	};
+
+private:
+	struct Metric
+	{
+		uint16_t	topic;				//mqtt_topic_t
+		Rule		rule;
+		float		value;
+		float		published;
+		bool		has_value;
+		bool		is_published;
+		bool		kept;				//Текущее значение ушло в mqtt_outbox: после подключения без ускоренного повтора
+		bool		pending;			//Изменение ждёт конца min_interval
+		int64_t		published_us;
+		int64_t		heartbeat_us;		//Срок следующего повтора
+	};
+	struct Message
+	{
+		uint16_t	topic;
+		char		text[16];
+	};
+	struct FrameGroup
+	{
+		std::string	prefix;				//Начало топиков метрик группы
+		std::string	name;				//Ключ группы в кадре
+	};
+	struct FrameValue
+	{
+		uint16_t	topic;				//mqtt_topic_t
+		uint8_t		group;				//Индекс в frame_groups
+		uint8_t		precision;
+		float		value;
+	};
+	static constexpr size_t		max_metrics			= 96;
+	static constexpr size_t		max_heartbeats		= 2;	//Повторов за проход задачи
+	static constexpr uint32_t	poll_period_ms		= 500;
+	static constexpr size_t		replay_per_poll		= 10;	//Отправок из mqtt_outbox за проход
+	static constexpr uint32_t	offline_frame_ms	= 60000;	//Период кадров без связи, не меньше периода кадра
+	static constexpr const char*	nvs_namespace	= "telemetry";
+
+	Metric				metrics[max_metrics];
+	size_t				count		= 0;
+	Stats				stat;
+	bool				online		= false;
+	bool				started		= false;
+	mutable std::mutex	mutex;
+
+	//Кадр всего состояния
+	Mode					mode			= Mode::topics;
+	FrameFormat				frame_format	= FrameFormat::json;
+	uint16_t				frame_topic		= 0xffff;	//mqtt_topic_t
+	uint32_t				frame_period_ms	= 0;
+	int64_t					frame_us		= 0;		//Срок следующего кадра
+	uint32_t				frame_seq		= 0;
+	std::vector<FrameGroup>	frame_groups;		//Только до start, дальше читается без mutex
+
+	//Копия значений для кадра: снимается под mutex, кадр собирается без него. Только задача телеметрии
+	FrameValue				frame_values[max_metrics];
+
+	int64_t	stagger(size_t index, int64_t now) const;		//Первый срок повтора метрики
+	void	prepare(Metric& m, int64_t now, Message* msg);	//Под mutex: отметка публикации и текст
+	void	keep(Metric& m, int64_t now, Message* msg);		//Под mutex: изменение без MQTT, msg - для mqtt_outbox
+	size_t	snapshot_frame();								//Под mutex: значения в frame_values, возвращает их число
+	std::vector<uint8_t>	build_frame(size_t num_values, uint32_t seq, FrameFormat format) const;
+	static void	format(const Metric& m, char* text, size_t size);
+	static void	task(void* arg);
+
+public:
+	void	start(UBaseType_t priority, BaseType_t core);
+
+	//Режим публикации. Кадр уходит в topic раз в period_ms (для Mode::topics не используется).
+	//Метрики попадают в кадр по группам: топик начинается с prefix, ключ - остаток топика. Группы - до start
+	void	set_mode(Mode mode, uint16_t topic = 0xffff, uint32_t period_ms = 10000, FrameFormat format = FrameFormat::json);
+	//То же с сохранёнными настройками, переданные значения - для их отсутствия
+	void	restore_mode(Mode mode, uint16_t topic, uint32_t period_ms, FrameFormat format);
+	//Команда TCP: {"mode": "topics|frame|both", "format": "json|cbor", "period_s": 1..3600}, все поля необязательны.
+	//Новый режим применяется сразу и сохраняется в настройках
+	json	command(const json& params);
+	void	frame_group(const std::string& prefix, const char* name);
+
+	Handle	add(uint16_t topic, const Rule& rule);
+	void	update(Handle metric, float value);
+	void	update(Handle metric, bool value)	{update(metric, value ? 1.f : 0.f);}
+
+	//Отложенные изменения и повторы. Вызывается задачей телеметрии
+	void	poll();
+
+	json	json_stats() const;
+};
+
+extern Telemetry	telemetry;
+
+#endif	//TELEMETRY_H
@@ -21,6 +21,7 @@ using json = nlohmann::json;
 #include "ds18b20.h"
 #include "thermo.h"
 #include "mqtt.h"
+#include "telemetry.h"
 
 static const char*	TAG = "thermo";
 
@@ -30,7 +31,6 @@ constexpr	gpio_num_t	pin_ds18b20	= GPIO_NUM_15;	//Разъем Т1
 //constexpr	gpio_num_t	pin_ds18b20	= GPIO_NUM_26;	//Разъем Т2
 std::vector<thermo_info>	thermometers;
 const std::string			thermo_topic(SecureConfig::thermo_topic);
-constexpr	int64_t			mqtt_period	= 3600;	//Количество секунд между полной отправкой всех датчиков в MQTT
 
 //Расширитель портов
 constexpr gpio_num_t	pinSCL	= GPIO_NUM_18;
@@ -123,9 +123,13 @@ void	thermo(void* unused)
 		}
 	}
 
+	//Метрики датчиков собираются один раз, после установки имён. Дребезг в 0.1 градуса не публикуется
+	for(thermo_info& info : thermometers)
+		info.metric	= telemetry.add(mqtt_topic(thermo_topic, info.name.c_str()), Telemetry::Rule{0.1f, 0, 3600000, 2});
+	const mqtt_topic_t	errors_topic	= mqtt_topic(SecureConfig::thermo_errors_topic);
+
 	//Значение порта
 	uint8_t	relay_state	= 0;
-	int64_t	periodical_mqtt_time	= esp_timer_get_time();
 
 	/////////////////////////////////////////////////////////////////////
 	//  Главный цикл
@@ -156,42 +160,15 @@ void	thermo(void* unused)
 				if(info.error_code)
 				{
 					info.errors_count++;
-					if(mqtt_client) esp_mqtt_client_publish(mqtt_client, SecureConfig::thermo_errors_topic, esp_err_to_name(info.error_code), 0, 0, 0);
+					mqtt_publish(errors_topic, esp_err_to_name(info.error_code));
 					continue;
 				}
 
 				ESP_LOGI(TAG, "rom_code = 0x%llx, name = %s,\tt = %lf", info.rom_code, info.name.c_str(), info.value);
 
-				if(value != info.value)
-				{
-					//Обновление значения
-					info.value		= value;
-
-					//Отправка в MQTT с фильтрацией дребезга
-					float	delta	= value - info.sended_value;
-					if(mqtt_client && (abs(delta) > 0.1f))
-					{
-						info.sended_value	= value;
-						char	value[16];
-						sprintf(value, "%.2f", info.value);
-						esp_mqtt_client_publish(mqtt_client, (thermo_topic + info.name).c_str(), value, 0, 0, 0);
-					}
-				}
-			}
-
-			//Периодическая отправка всех значений в MQTT, чтобы не было разрывов графиков
-			if(esp_timer_get_time() - periodical_mqtt_time > mqtt_period*1000000)
-			{
-				periodical_mqtt_time	= esp_timer_get_time();
-				if(mqtt_client)
-				{
-					char	value[16];
-					for(thermo_info& info : thermometers)
-					{
-						sprintf(value, "%.2f", info.value);
-						esp_mqtt_client_publish(mqtt_client, (thermo_topic + info.name).c_str(), value, 0, 0, 0);
-					}
-				}
+				//Обновление значения и публикация с фильтрацией дребезга
+				info.value	= value;
+				telemetry.update(info.metric, value);
 			}
 		}
 
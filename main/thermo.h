@@ -16,7 +16,7 @@ struct	thermo_info
 	esp_err_t			error_code	= ESP_OK;
 	int					errors_count = 0;
 	float				value = 0;
-	float				sended_value	= 0;	//Последнее отправленное в MQTT значение
+	uint16_t			metric		= 0xffff;	//Метрика Telemetry
 };
 
 extern bool RMT_thermo_is_enabled;
@@ -0,0 +1,238 @@
+//Воспроизведение трасс приёма OpenTherm через OT_Decoder на хосте.
+//Выдаёт скорость разбора (пакетов в секунду) и долю ошибок разбора.
+//
+//	ot_replay [--synthetic N] [--distortion P] [--half-bit H] [--asymmetry A] [--fixed-clock]
+//	          [--seed S] [--iterations K] [--max-error-rate R] [trace.txt ...]
+//	ot_replay --encoder N
+//	ot_replay --dump recorder.bin
+//
+//Все трассы разбираются как ответы одного ведомого с накопленной оценкой тактовой частоты.
+//--fixed-clock отключает подстройку и разбирает по номинальным длительностям.
+//--encoder сверяет кусочное кодирование OT_Encoder с побитовым для N случайных запросов.
+//Трассы можно брать из выгрузки самописца (команда flight_recorder TCP-сервера), --dump печатает её текстом,
+//--save-recorder записывает синтезированные трассы в формате самописца.
+//Код возврата не нулевой, если доля ошибок больше --max-error-rate.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ot_decoder.h"
+#include "ot_encoder.h"
+#include "ot_exchange.h"
+#include "ot_recorder.h"
+#include "ot_trace.h"
+
+struct ReplayResult
+{
+	size_t	frames				= 0;
+	size_t	strange_duration	= 0;
+	size_t	no_symbols			= 0;
+	size_t	parity_fail			= 0;
+	size_t	mismatch			= 0;
+
+	size_t	errors() const	{return strange_duration + no_symbols + parity_fail + mismatch;}
+};
+
+//Проверка кодирования кусками произвольного размера и скорость кодирования целого кадра
+static int	check_encoder(size_t count, unsigned seed)
+{
+	std::mt19937	rng(seed);
+	std::uniform_int_distribution<size_t>	chunk(1, OT_Encoder::frame_symbols);
+	size_t	failed	= 0;
+	for(size_t n = 0; n < count; n++)
+	{
+		uint32_t	request	= rng();
+
+		//Эталон: стартовый бит, биты запроса старшим вперёд, стоповый бит
+		uint32_t	expected[OT_Encoder::frame_symbols];
+		expected[0]		= OT_Encoder::bit1;
+		for(size_t bit = 0; bit < 32; bit++)
+			expected[bit+1]	= (request & (0x80000000u >> bit)) ? OT_Encoder::bit1 : OT_Encoder::bit0;
+		expected[33]	= OT_Encoder::bit1;
+
+		ot_symbol_t	symbols[OT_Encoder::frame_symbols];
+		size_t		written	= 0;
+		while(written < OT_Encoder::frame_symbols)
+			written	+= OT_Encoder::encode(request, written, symbols + written, chunk(rng));
+
+		for(size_t i = 0; i < OT_Encoder::frame_symbols; i++)
+			if(symbols[i].val != expected[i]){
+				failed++;
+				break;
+			}
+	}
+
+	ot_symbol_t	symbols[OT_Encoder::frame_symbols];
+	uint32_t	sink	= 0;
+	auto	start	= std::chrono::steady_clock::now();
+	for(size_t n = 0; n < count; n++)
+	{
+		OT_Encoder::encode(uint32_t(n*2654435761u), 0, symbols, OT_Encoder::frame_symbols);
+		sink	^= symbols[n % OT_Encoder::frame_symbols].val;
+	}
+	double	seconds	= std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("encoded:          %zu (chunked), mismatch %zu\n", count, failed);
+	printf("encode:           %.1f ns/frame (%08x)\n", 1e9*seconds/count, unsigned(sink));
+	return failed ? 1 : 0;
+}
+
+//Запись трасс в формате выгрузки самописца, как её отдаёт ESP32
+static int	save_to_recorder(const std::vector<OT_Trace>& traces, const std::string& filename)
+{
+	OT_Recorder	recorder(traces.size());
+	uint32_t	time_ms	= 0;
+	for(const OT_Trace& trace : traces)
+	{
+		time_ms	+= 1000;
+		recorder.record(time_ms, trace.request, trace.expected, static_cast<uint8_t>(OT_Status::sucsess), 20, trace.symbols.data(), trace.symbols.size());
+	}
+
+	std::vector<uint8_t>	blob(recorder.serialized_size());
+	blob.resize(recorder.serialize(blob.data(), blob.size(), time_ms));
+
+	FILE*	file	= fopen(filename.c_str(), "wb");
+	if(!file || fwrite(blob.data(), 1, blob.size(), file) != blob.size())
+	{
+		fprintf(stderr, "cannot write %s\n", filename.c_str());
+		if(file)	fclose(file);
+		return 2;
+	}
+	fclose(file);
+
+	printf("recorder:         %zu records, %zu bytes\n", recorder.size(), blob.size());
+	return 0;
+}
+
+static void	usage()
+{
+	printf("usage: ot_replay [--synthetic N] [--distortion P] [--half-bit H] [--asymmetry A] [--fixed-clock]\n");
+	printf("                 [--seed S] [--iterations K] [--max-error-rate R] [trace.txt ...]\n");
+	printf("       ot_replay --encoder N\n");
+	printf("       ot_replay --dump recorder.bin\n");
+	printf("       ot_replay --synthetic N --save-recorder recorder.bin\n");
+}
+
+int	main(int argc, char** argv)
+{
+	size_t		synthetic		= 0;
+	float		distortion		= 0.1f;
+	unsigned	seed			= 1;
+	size_t		iterations		= 10;
+	double		max_error_rate	= -1;
+	OT_SynthParams	synth;
+	bool		fixed_clock		= false;
+	size_t		encoder_checks	= 0;
+	std::string	save_recorder;
+	std::vector<OT_Trace>	traces;
+
+	for(int i = 1; i < argc; i++)
+	{
+		const char*	arg	= argv[i];
+		bool		has_value	= (i + 1 < argc);
+		if(!strcmp(arg, "--synthetic") && has_value)			synthetic		= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--distortion") && has_value)		distortion		= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--half-bit") && has_value)		synth.half_bit	= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--asymmetry") && has_value)		synth.asymmetry	= strtol(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--encoder") && has_value)		encoder_checks	= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--fixed-clock"))					fixed_clock		= true;
+		else if(!strcmp(arg, "--seed") && has_value)			seed			= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--iterations") && has_value)		iterations		= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--max-error-rate") && has_value)	max_error_rate	= strtod(argv[++i], nullptr);
+		else if(!strcmp(arg, "--dump") && has_value)			return ot_dump_recorder(argv[++i]) ? 0 : 2;
+		else if(!strcmp(arg, "--save-recorder") && has_value)	save_recorder	= argv[++i];
+		else if(!strcmp(arg, "--help"))							{usage(); return 0;}
+		else if(arg[0] == '-')									{usage(); return 2;}
+		else if(!ot_load_traces(arg, traces))
+		{
+			fprintf(stderr, "cannot read %s\n", arg);
+			return 2;
+		}
+	}
+
+	if(encoder_checks)
+		return check_encoder(encoder_checks, seed);
+
+	//Синтетические ответы: номинальные, с перенесёнными фронтами и с укороченным первым импульсом
+	std::mt19937	rng(seed);
+	for(size_t i = 0; i < synthetic; i++)
+	{
+		OT_SynthParams	params	= synth;
+		switch(i % 3)
+		{
+			case 1:	params.distortion	= distortion;		break;
+			case 2:	params.distortion	= distortion;
+					params.truncated_first	= true;			break;
+			default:										break;
+		}
+
+		OT_Trace	trace;
+		trace.expected		= ot_random_frame(rng);
+		trace.has_expected	= true;
+		trace.symbols		= ot_synthesize(trace.expected, params, rng);
+		traces.push_back(trace);
+	}
+
+	if(traces.empty())
+	{
+		usage();
+		return 2;
+	}
+
+	if(!save_recorder.empty())
+		return save_to_recorder(traces, save_recorder);
+	if(iterations == 0)
+		iterations	= 1;
+
+	//Разбор меняет символы на месте, поэтому каждый проход идёт по копии
+	size_t	max_symbols	= 0;
+	for(const OT_Trace& trace : traces)
+		if(trace.symbols.size() > max_symbols)	max_symbols	= trace.symbols.size();
+	std::vector<ot_symbol_t>	work(max_symbols);
+
+	ReplayResult		result;
+	OT_Decoder::Clock	clock;
+	auto	start	= std::chrono::steady_clock::now();
+	for(size_t it = 0; it < iterations; it++)
+	{
+		for(const OT_Trace& trace : traces)
+		{
+			std::copy(trace.symbols.begin(), trace.symbols.end(), work.begin());
+
+			uint32_t			frame;
+			OT_Decoder::Status	status	= OT_Decoder::decode(work.data(), trace.symbols.size(), &frame, fixed_clock ? nullptr : &clock);
+			if(it != 0)
+				continue;
+
+			result.frames++;
+			if(status == OT_Decoder::Status::strange_duration)		result.strange_duration++;
+			else if(status == OT_Decoder::Status::no_symbols)		result.no_symbols++;
+			else if(!OT_Decoder::parity_ok(frame))					result.parity_fail++;
+			else if(trace.has_expected && frame != trace.expected)	result.mismatch++;
+		}
+	}
+	auto	stop	= std::chrono::steady_clock::now();
+
+	double	seconds		= std::chrono::duration<double>(stop - start).count();
+	double	decoded		= double(traces.size())*iterations;
+	double	error_rate	= double(result.errors())/result.frames;
+
+	printf("frames:           %zu (x%zu iterations)\n", result.frames, iterations);
+	printf("strange_duration: %zu\n", result.strange_duration);
+	printf("no_symbols:       %zu\n", result.no_symbols);
+	printf("parity_fail:      %zu\n", result.parity_fail);
+	printf("mismatch:         %zu\n", result.mismatch);
+	printf("error rate:       %.6f\n", error_rate);
+	printf("clock estimate:   half_bit %.2f us, asymmetry %.2f us (%u frames)\n", clock.half_bit_q4/16.0, clock.asymmetry_q4/16.0, unsigned(clock.updates));
+	printf("throughput:       %.0f frames/s (%.1f ns/frame)\n", decoded/seconds, 1e9*seconds/decoded);
+
+	if(max_error_rate >= 0 && error_rate > max_error_rate)
+	{
+		fprintf(stderr, "error rate %.6f exceeds %.6f\n", error_rate, max_error_rate);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+#include "ot_sim.h"
+
+OT_SimSlave::OT_SimSlave(unsigned seed): rng(seed)
+{
+	//ID, которые опрашивает и записывает OT_Boiler, с правдоподобными значениями
+	const struct {uint8_t id; uint16_t value;}	known[]	= {
+		{0,		0x000a},	//Статус: отопление и горелка
+		{1,		50 << 8},	//Заданная температура теплоносителя
+		{2,		0},			//Master configuration
+		{3,		0x0100},	//Slave configuration
+		{4,		0},			//Remote request
+		{5,		0},			//Код ошибки
+		{14,	100 << 8},	//Максимальная модуляция
+		{17,	35 << 8},	//Модуляция
+		{25,	55 << 8},	//Температура теплоносителя
+		{26,	40 << 8},	//Температура горячей воды
+		{36,	3 << 8},	//Ток ионизации
+		{56,	38 << 8},	//Заданная температура горячей воды
+		{57,	82 << 8},	//Максимальная температура теплоносителя
+		{115,	0},			//OEM диагностический код
+	};
+	for(const auto& item : known)
+	{
+		supported[item.id]	= true;
+		values[item.id]		= item.value;
+	}
+}
+
+void	OT_SimSlave::account()
+{
+	switch(expected)
+	{
+		case OT_Status::timeout:			injected.timeout++;		break;
+		case OT_Status::rx_invalid:			injected.rx_invalid++;	break;
+		case OT_Status::parityFail:			injected.parity++;		break;
+		case OT_Status::unknownID:			injected.unknown_id++;	break;
+		case OT_Status::SPARE_fail:			injected.spare++;		break;
+		case OT_Status::responseID_fail:	injected.wrong_id++;	break;
+		default:													break;
+	}
+}
+
+bool	OT_SimSlave::chance(float probability)
+{
+	return probability > 0 && std::uniform_real_distribution<float>(0.f, 1.f)(rng) < probability;
+}
+
+OT_Transport::Result	OT_SimSlave::processOT(const uint32_t request, uint32_t* response)
+{
+	*response	= 0;
+	expected	= OT_Status::sucsess;
+	undetected	= false;
+	sent		= 0;
+
+	//Пауза после прошлого ответа, передача запроса, задержка ответа ведомого (20..800 мс, обычно быстро) и сам ответ
+	bus_time_s	+= 0.100 + 0.034 + std::uniform_real_distribution<double>(0.020, 0.080)(rng) + 0.034;
+
+	OT_Message_t	req;
+	req.all	= request;
+	if(!OT_Decoder::parity_ok(req.all) || chance(faults.timeout))
+	{
+		//Ведомый молчит: ведущий ждёт окно ответа целиком
+		expected	= OT_Status::timeout;
+		bus_time_s	+= 0.8;
+		account();
+		return Result::receive_timeout;
+	}
+
+	OT_Message_t	resp;
+	resp.all		= 0;
+	resp.bit.id		= req.bit.id;
+	resp.bit.data	= req.bit.data;
+	switch(static_cast<OT_MsgType>(req.bit.msg_type))
+	{
+		case OT_MsgType::READ_DATA:
+			resp.bit.msg_type	= static_cast<uint8_t>(OT_MsgType::READ_ACK);
+			resp.bit.data		= values[req.bit.id];
+			break;
+
+		case OT_MsgType::WRITE_DATA:
+			resp.bit.msg_type	= static_cast<uint8_t>(OT_MsgType::WRITE_ACK);
+			values[req.bit.id]	= req.bit.data;
+			break;
+
+		default:
+			resp.bit.msg_type	= static_cast<uint8_t>(OT_MsgType::DATA_INVALID);
+			break;
+	}
+	if(supported[req.bit.id] && invalid[req.bit.id] && static_cast<OT_MsgType>(req.bit.msg_type) == OT_MsgType::READ_DATA)
+	{
+		resp.bit.msg_type	= static_cast<uint8_t>(OT_MsgType::DATA_INVALID);
+		expected	= OT_Status::dataInvalid;
+	}
+	if(!supported[req.bit.id])
+	{
+		resp.bit.msg_type	= static_cast<uint8_t>(OT_MsgType::UNKNOWN_DATAID);
+		expected	= OT_Status::unknownID;
+	}
+
+	//Неисправности протокола: не больше одной на ответ, чтобы её можно было сверить со счётчиком
+	if(chance(faults.parity))
+	{
+		expected	= OT_Status::parityFail;
+	}
+	else if(expected == OT_Status::sucsess && chance(faults.wrong_id))
+	{
+		resp.bit.id	= req.bit.id ^ 0x01;
+		expected	= OT_Status::responseID_fail;
+	}
+	else if(expected == OT_Status::sucsess && chance(faults.spare))
+	{
+		resp.bit.spare	= 0x5;
+		expected	= OT_Status::SPARE_fail;
+	}
+	resp.bit.parity	= OT_Decoder::parity_ok(resp.all) ? 0 : 1;
+	if(expected == OT_Status::parityFail)
+		resp.bit.data	^= 0x0010;
+	sent	= resp.all;
+
+	//Физический уровень
+	OT_SynthParams	line	= faults.line;
+	line.truncated_first	= chance(faults.truncated_first);
+	std::vector<ot_symbol_t>	symbols	= ot_synthesize(resp.all, line, rng);
+
+	uint32_t			frame	= 0;
+	OT_Decoder::Status	status	= OT_Decoder::decode(symbols.data(), symbols.size(), &frame, &clock);
+	if(status != OT_Decoder::Status::ok)
+	{
+		expected	= OT_Status::rx_invalid;
+		account();
+		return Result::fail;
+	}
+
+	//Ошибка приёма, которую декодер не распознал. Чётность её обнаружит, если искажено нечётное число битов
+	if(frame != sent)
+	{
+		injected.corrupted++;
+		if(OT_Decoder::parity_ok(frame)){
+			//Результат обмена зависит от того, какие биты искажены. Он не предсказуем и в injected не учитывается
+			injected.silent++;
+			undetected	= true;
+			*response	= frame;
+			return Result::sucsess;
+		}
+		expected	= OT_Status::parityFail;
+	}
+
+	account();
+	*response	= frame;
+	return Result::sucsess;
+}
@@ -0,0 +1,67 @@
+#ifndef OT_SIM_H
+#define OT_SIM_H
+
+#include <cstdint>
+#include <random>
+#include "ot_exchange.h"
+#include "ot_decoder.h"
+#include "ot_trace.h"
+
+//Вероятности неисправностей, вносимых симулятором ведомого
+struct OT_SimFaults
+{
+	OT_SynthParams	line;					//Физический уровень: полупериод, асимметрия, дрожание, искажения
+	float			truncated_first	= 0.f;	//Укороченный первый импульс
+	float			parity			= 0.f;	//Искажённый бит данных без исправления чётности
+	float			wrong_id		= 0.f;	//Ответ с чужим ID
+	float			timeout			= 0.f;	//Ответа нет
+	float			spare			= 0.f;	//Ненулевые биты SPARE
+};
+
+//Сколько обменов должно завершиться каждой ошибкой (с учётом того, что неисправности перекрывают друг друга)
+struct OT_SimInjected
+{
+	uint64_t	parity		= 0;
+	uint64_t	wrong_id	= 0;
+	uint64_t	timeout		= 0;
+	uint64_t	spare		= 0;
+	uint64_t	unknown_id	= 0;	//Запросы неподдерживаемых ID
+	uint64_t	rx_invalid	= 0;	//Ответ не разобран декодером
+	uint64_t	corrupted	= 0;	//Декодер вернул не тот кадр, что был передан (входит в parity, если чётность это обнаружила)
+	uint64_t	silent		= 0;	//Искажение, которое чётность не обнаружила
+};
+
+//Симулятор котла на шине OpenTherm.
+//Отвечает на READ/WRITE для ID, которые опрашивает OT_Boiler, синтезирует символы ответа
+//так, как их принимает канал RMT, и разбирает их тем же OT_Decoder, что и прерывание приёма
+class OT_SimSlave: public OT_Transport
+{
+private:
+	std::mt19937		rng;
+	OT_Decoder::Clock	clock;
+	uint16_t			values[256]		= {};
+	bool				supported[256]	= {};
+	bool				invalid[256]	= {};	//Известный ID без значения: ответ DATA_INVALID
+
+	bool	chance(float probability);
+	void	account();	//Учёт итогового результата обмена в injected
+
+public:
+	OT_SimFaults	faults;
+	OT_SimInjected	injected;
+	double			bus_time_s	= 0;	//Время шины с паузами и задержкой ответа по спецификации
+	OT_Status		expected	= OT_Status::sucsess;	//Какой результат должен получить ведущий за последний обмен
+	uint32_t		sent		= 0;	//Последний переданный ответ
+	bool			undetected	= false;//Последний ответ искажён на линии так, что чётность сошлась
+
+	explicit OT_SimSlave(unsigned seed);
+
+	Result		processOT(const uint32_t request, uint32_t* response) override;
+
+	uint16_t	value(uint8_t id) const	{return values[id];}
+	bool		is_supported(uint8_t id) const	{return supported[id];}
+	bool		is_invalid(uint8_t id) const	{return invalid[id];}
+	void		set_invalid(uint8_t id)			{supported[id] = true; invalid[id] = true;}
+};
+
+#endif	//OT_SIM_H
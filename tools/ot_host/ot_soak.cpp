@@ -0,0 +1,495 @@
+//Длительный прогон обмена OpenTherm с симулятором котла на хосте.
+//Запросы идут через ot_exchange - ту же проверку ответа, что и в OT_Boiler::processOT.
+//
+//	ot_soak [--transactions N] [--seed S] [--jitter US] [--distortion P] [--truncated P]
+//	        [--parity P] [--wrong-id P] [--spare P] [--timeout P] [--unknown P]
+//	ot_soak --schedule SECONDS [faults...]
+//	ot_soak --sweep [faults...]
+//	ot_soak --seqlock N
+//	ot_soak --repeat
+//
+//Сверяется каждый обмен: статус совпадает с неисправностью, внесённой симулятором,
+//данные успешного обмена совпадают с таблицей котла, а итоговые счётчики OT_FailsCounter
+//совпадают с числом внесённых неисправностей. Статистика OT_IdStats сверяется с теми же счётчиками
+//и со временем ответа симулятора, последние значения OT_DataStore - с таблицей котла. Код возврата не нулевой при любом расхождении.
+//--schedule гоняет по времени шины симулятора то же расписание, что OT_Boiler, и проверяет,
+//что статус (ID 0) опрашивается не реже 1 Гц без пропуска сроков.
+//--sweep обходит все ID, как OT_Boiler при первом запуске, и сверяет карту OT_Capabilities с таблицей котла.
+//--seqlock публикует N снимков из одного потока и читает их из другого: каждая копия должна быть целой.
+//--repeat проверяет OT_Repeats: удачный повтор освобождает слот, повтор без результата не идёт бесконечно.
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "ot_scheduler.h"
+#include "ot_repeat.h"
+#include "ot_capability.h"
+#include "ot_seqlock.h"
+#include "ot_id_stats.h"
+#include "ot_data.h"
+#include "ot_sim.h"
+
+static void	usage()
+{
+	printf("usage: ot_soak [--transactions N] [--seed S] [--jitter US] [--distortion P] [--truncated P]\n");
+	printf("               [--parity P] [--wrong-id P] [--spare P] [--timeout P] [--unknown P]\n");
+	printf("       ot_soak --schedule SECONDS [faults...]\n");
+	printf("       ot_soak --sweep [faults...]\n");
+	printf("       ot_soak --seqlock N\n");
+	printf("       ot_soak --repeat\n");
+}
+
+//Снимок заметного размера, как у OT_Boiler: все поля выводятся из номера записи
+struct SeqlockProbe
+{
+	uint32_t	index;
+	uint32_t	words[255];
+};
+
+static int	run_seqlock(uint32_t writes)
+{
+	OT_Seqlock<SeqlockProbe>	snapshot;
+	std::atomic<bool>			done{false};
+
+	std::thread	writer([&](){
+		SeqlockProbe	probe;
+		for(uint32_t n = 1; n <= writes; n++)
+		{
+			probe.index	= n;
+			for(uint32_t i = 0; i < 255; i++)
+				probe.words[i]	= n*2654435761u + i;
+			snapshot.write(probe);
+		}
+		done	= true;
+	});
+
+	size_t		reads	= 0;
+	size_t		torn	= 0;
+	size_t		backwards	= 0;
+	uint32_t	last	= 0;
+	SeqlockProbe	probe;
+	while(!done)
+	{
+		uint32_t	generation	= snapshot.read(&probe);
+		reads++;
+		if(generation < last)	backwards++;
+		last	= generation;
+		if(generation == 0)
+			continue;
+
+		bool	whole	= probe.index == generation;
+		for(uint32_t i = 0; whole && i < 255; i++)
+			whole	= probe.words[i] == probe.index*2654435761u + i;
+		if(!whole)	torn++;
+	}
+	writer.join();
+
+	printf("seqlock:          %u writes, %zu reads, last generation %u\n", unsigned(writes), reads, unsigned(snapshot.generation()));
+	printf("torn reads:       %zu\n", torn);
+	printf("out of order:     %zu\n", backwards);
+	if(torn || backwards || snapshot.generation() != writes)
+	{
+		fprintf(stderr, "seqlock failed\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+//Повторы, как в OT_Boiler::run_repeat, по модельному времени шагами 100 мс.
+//action(attempt) выполняет повтор и сообщает результат (или не сообщает) через report
+template<typename Action>
+static size_t	drive_repeats(OT_Repeats& repeats, int64_t& now, double seconds, Action action)
+{
+	size_t	retries	= 0;
+	for(int64_t end = now + int64_t(seconds*1e6); now < end; now += 100000)
+	{
+		int	type	= repeats.begin(now);
+		if(type < 0)
+			continue;
+		action(size_t(type), retries++);
+		repeats.end(now);
+	}
+	return retries;
+}
+
+static int	run_repeat()
+{
+	size_t	errors	= 0;
+	auto	check	= [&](bool ok, const char* what){
+		if(!ok){
+			fprintf(stderr, "repeat: %s\n", what);
+			errors++;
+		}
+	};
+
+	//Сброс блокировки: первая попытка и два повтора неудачны, третий повтор удачен
+	{
+		OT_Repeats	repeats;
+		int64_t		now	= 0;
+		const size_t	blor	= 9;
+		check(repeats.report(blor, false, now) == OT_Repeats::Result::queued, "failure is not queued");
+		check(repeats.report(blor, false, now) == OT_Repeats::Result::coalesced, "second failure is not coalesced");
+		size_t	retries	= drive_repeats(repeats, now, 600, [&](size_t type, size_t attempt){
+			repeats.report(type, attempt >= 2, now);
+		});
+		check(retries == 3, "successful retry is repeated");
+		check(repeats.pending() == 0 && !repeats.slot(blor).pending, "slot is not cleared after successful retry");
+		check(repeats.stats().succeeded == 1 && repeats.stats().given_up == 0, "wrong success counters");
+	}
+
+	//Повтор, который не сообщает результат: после max_attempts попыток слот освобождается
+	{
+		OT_Repeats	repeats;
+		int64_t		now	= 0;
+		repeats.report(3, false, now);
+		size_t	retries	= drive_repeats(repeats, now, 3600, [](size_t, size_t){});
+		check(retries == OT_Repeats::max_attempts, "unreported retry is not bounded");
+		check(repeats.pending() == 0, "unreported retry stays pending");
+		check(repeats.stats().given_up == 1 && repeats.stats().unreported == OT_Repeats::max_attempts, "wrong unreported counters");
+	}
+
+	//Удачная команда вне повтора снимает ожидание без учёта как удачного повтора
+	{
+		OT_Repeats	repeats;
+		int64_t		now	= 0;
+		repeats.report(5, false, now);
+		repeats.report(5, true, now);
+		check(repeats.pending() == 0 && repeats.stats().succeeded == 0, "direct success does not clear slot");
+		check(drive_repeats(repeats, now, 60, [](size_t, size_t){}) == 0, "cleared slot is retried");
+	}
+
+	printf("repeat:           %zu errors\n", errors);
+	return errors ? 1 : 0;
+}
+
+//Обход ID, как в OT_Boiler::run_sweep. ID без ответа из-за ошибок обмена остаются в опросе и после повторной проверки
+//без неисправностей классифицируются верно
+static int	run_sweep(OT_SimSlave& slave)
+{
+	slave.set_invalid(27);	//Датчик уличной температуры не подключён
+
+	OT_Capabilities	capabilities;
+	OT_FailsCounter	fails;
+	size_t			exchanges	= 0;
+	capabilities.start();
+	for(int id; (id = capabilities.next_probe()) >= 0; exchanges++)
+	{
+		OT_Response	response	= ot_exchange(slave, OT_Command::read, uint8_t(id), 0, false, fails);
+		capabilities.probe_result(uint8_t(id), response.status);
+	}
+
+	//Без ответа - не то же, что неизвестный котлу ID: такой ID остаётся в опросе
+	size_t	silent		= capabilities.count(OT_Support::no_response);
+	size_t	excluded	= 0;
+	for(size_t i = 0; i < OT_Capabilities::id_count; i++)
+		if(capabilities.get(uint8_t(i)) == OT_Support::no_response && capabilities.is_unsupported(uint8_t(i)))
+			excluded++;
+
+	//Повторная проверка после восстановления связи: котёл отвечает, ID без ответа не остаётся
+	slave.faults	= OT_SimFaults();
+	bool	reprobed	= capabilities.reprobe() == (silent != 0);
+	for(int id; (id = capabilities.next_probe()) >= 0; exchanges++)
+	{
+		OT_Response	response	= ot_exchange(slave, OT_Command::read, uint8_t(id), 0, false, fails);
+		capabilities.probe_result(uint8_t(id), response.status);
+	}
+	reprobed	= reprobed && capabilities.reprobe_recovered() == silent;
+
+	size_t	wrong	= 0;
+	for(size_t i = 0; i < OT_Capabilities::id_count; i++)
+	{
+		uint8_t		id	= uint8_t(i);
+		OT_Support	expected;
+		if(id == 0)											expected	= OT_Support::read_only;
+		else if(ot_access(id) == OT_Access::write)			expected	= OT_Support::untested;
+		else if(!slave.is_supported(id))					expected	= OT_Support::unknown;
+		else if(slave.is_invalid(id))						expected	= OT_Support::data_invalid;
+		else if(ot_access(id) == OT_Access::read)			expected	= OT_Support::read_only;
+		else												expected	= OT_Support::supported;
+
+		OT_Support	support	= capabilities.get(id);
+		if(support != expected)
+		{
+			fprintf(stderr, "id %u: %s, expected %s\n", id, OT_Capabilities::to_string(support), OT_Capabilities::to_string(expected));
+			wrong++;
+		}
+	}
+
+	//Карта переживает перезагрузку без изменений
+	uint8_t			blob[OT_Capabilities::blob_size];
+	OT_Capabilities	loaded;
+	bool	round_trip	= loaded.parse(blob, capabilities.serialize(blob, sizeof(blob))) && loaded.is_complete();
+	for(size_t i = 0; round_trip && i < OT_Capabilities::id_count; i++)
+		round_trip	= loaded.get(uint8_t(i)) == capabilities.get(uint8_t(i));
+
+	printf("sweep:            %zu exchanges, %.1f s of bus time\n", exchanges, slave.bus_time_s);
+	const OT_Support	classes[]	= {OT_Support::untested, OT_Support::supported, OT_Support::read_only,
+		OT_Support::unknown, OT_Support::data_invalid, OT_Support::no_response};
+	for(OT_Support support : classes)
+		printf("%-17s %zu\n", OT_Capabilities::to_string(support), capabilities.count(support));
+	printf("reprobed:         %zu\n", silent);
+	printf("misclassified:    %zu\n", wrong);
+
+	if(wrong || excluded || !reprobed || !capabilities.is_complete() || !round_trip)
+	{
+		fprintf(stderr, "sweep failed\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+//Расписание OT_Boiler: статус, модуляция, температуры и ток ионизации
+static int	run_schedule(OT_SimSlave& slave, double seconds)
+{
+	struct {uint8_t id; uint32_t period_ms; uint32_t max_period_ms; uint8_t priority;}	table[]	= {
+		{0, 1000, 1000, 0}, {17, 1000, 8000, 1}, {25, 2000, 30000, 2}, {26, 2000, 60000, 3}, {36, 5000, 60000, 4}
+	};
+
+	OT_Scheduler	scheduler(0);
+	for(const auto& row : table)
+		scheduler.add(row.id, row.period_ms, row.priority, 0, row.max_period_ms);
+	uint16_t	last[OT_Scheduler::max_jobs]	= {};
+
+	OT_FailsCounter	fails;
+	auto	now_us	= [&](){return int64_t(slave.bus_time_s*1e6);};
+	while(slave.bus_time_s < seconds)
+	{
+		int	job	= scheduler.next(now_us());
+		if(job < 0)
+		{
+			//Шина простаивает до ближайшего выхода
+			slave.bus_time_s	+= scheduler.idle_for_us(now_us())*1e-6;
+			continue;
+		}
+
+		int64_t		start		= now_us();
+		OT_Response	response	= ot_exchange(slave, OT_Command::read, scheduler.job(job).id, 0, false, fails);
+		scheduler.complete(job, start, now_us());
+
+		//Значения симулятора стоят на месте, поэтому адаптивные периоды должны уйти к наибольшим
+		if(response.status == OT_Status::sucsess)
+		{
+			scheduler.adapt(job, response.data != last[job]);
+			last[job]	= response.data;
+		}
+	}
+
+	const OT_Scheduler::Stats&	stats	= scheduler.stats();
+	printf("schedule:         %.0f s simulated, %u exchanges, %.1f ms each\n", seconds, unsigned(stats.runs), stats.cost_us/1000.);
+	printf("utilization:      %.3f (demand %.3f)\n", scheduler.utilization(now_us()), scheduler.demand());
+	for(size_t i = 0; i < scheduler.size(); i++)
+	{
+		const OT_Scheduler::Job&	job	= scheduler.job(i);
+		printf("id %3u:           %.3f Hz, period %u ms, misses %u, max late %.1f ms\n", job.id, job.runs/seconds, unsigned(job.period_ms), unsigned(job.misses), job.max_late_us/1000.);
+	}
+
+	const OT_Scheduler::Job&	status	= scheduler.job(0);
+	if(status.misses || status.runs < uint32_t(seconds) - 1)
+	{
+		fprintf(stderr, "status polled below 1 Hz\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int	main(int argc, char** argv)
+{
+	size_t		transactions	= 100000;
+	double		schedule		= 0;
+	bool		sweep			= false;
+	bool		repeat			= false;
+	uint32_t	seqlock			= 0;
+	unsigned	seed			= 1;
+	float		unknown			= 0.01f;
+	OT_SimFaults	faults;
+
+	for(int i = 1; i < argc; i++)
+	{
+		const char*	arg	= argv[i];
+		bool		has_value	= (i + 1 < argc);
+		if(!strcmp(arg, "--transactions") && has_value)		transactions			= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--seed") && has_value)		seed					= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--jitter") && has_value)		faults.line.jitter		= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--distortion") && has_value)	faults.line.distortion	= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--truncated") && has_value)	faults.truncated_first	= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--parity") && has_value)		faults.parity			= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--wrong-id") && has_value)	faults.wrong_id			= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--spare") && has_value)		faults.spare			= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--timeout") && has_value)		faults.timeout			= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--schedule") && has_value)	schedule				= strtod(argv[++i], nullptr);
+		else if(!strcmp(arg, "--unknown") && has_value)		unknown					= strtof(argv[++i], nullptr);
+		else if(!strcmp(arg, "--sweep"))					sweep					= true;
+		else if(!strcmp(arg, "--repeat"))					repeat					= true;
+		else if(!strcmp(arg, "--seqlock") && has_value)		seqlock					= strtoul(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--help"))						{usage(); return 0;}
+		else												{usage(); return 2;}
+	}
+
+	if(seqlock > 0)
+		return run_seqlock(seqlock);
+	if(repeat)
+		return run_repeat();
+
+	OT_SimSlave		slave(seed);
+	slave.faults	= faults;
+	if(schedule > 0)
+		return run_schedule(slave, schedule);
+	if(sweep)
+		return run_sweep(slave);
+
+	OT_FailsCounter	fails;
+	OT_IdStats		id_stats;
+	OT_DataStore	data_store;
+
+	//Те же ID, что опрашивает и записывает OT_Boiler
+	const uint8_t	read_ids[]	= {0, 3, 5, 14, 17, 25, 26, 36, 56, 57, 115};
+	const uint8_t	write_ids[]	= {1, 2, 4, 14, 56, 57};
+
+	std::mt19937	rng(seed ^ 0x5a5a5a5a);
+	std::uniform_real_distribution<float>	chance(0.f, 1.f);
+	size_t	status_mismatch	= 0;
+	size_t	data_mismatch	= 0;
+	size_t	succeeded		= 0;
+	uint64_t	undetected[16]	= {};	//Результаты обменов с необнаруженным искажением на линии, по OT_Status
+
+	auto	start	= std::chrono::steady_clock::now();
+	for(size_t n = 0; n < transactions; n++)
+	{
+		OT_Command	cmd;
+		uint8_t		id;
+		uint16_t	data	= 0;
+		if(chance(rng) < unknown)
+		{
+			cmd	= OT_Command::read;
+			id	= 200 + rng() % 50;
+		}
+		else if(rng() & 1)
+		{
+			cmd	= OT_Command::read;
+			id	= read_ids[rng() % sizeof(read_ids)];
+		}
+		else
+		{
+			cmd		= OT_Command::write;
+			id		= write_ids[rng() % sizeof(write_ids)];
+			data	= rng();
+		}
+
+		//Время ответа по шине симулятора: без обязательной паузы перед запросом
+		double		bus_start	= slave.bus_time_s;
+		OT_Response	response	= ot_exchange(slave, cmd, id, data, false, fails);
+		int64_t		response_us	= int64_t((slave.bus_time_s - bus_start - 0.100)*1e6);
+		id_stats.record(id, response.status, response.status == OT_Status::timeout ? -1 : response_us, 100000);
+		if(slave.undetected)
+		{
+			//Такой ответ нечем сверить: он учитывается отдельно и проваливает прогон в конце
+			undetected[static_cast<size_t>(response.status)]++;
+			continue;
+		}
+
+		if(response.status != slave.expected)
+		{
+			if(status_mismatch < 10)
+				fprintf(stderr, "#%zu id %u: status %s, expected %s (request 0x%08x, response 0x%08x, sent 0x%08x)\n",
+					n, id, ot_status_to_string(response.status), ot_status_to_string(slave.expected),
+					unsigned(response.request), unsigned(response.response), unsigned(slave.sent));
+			status_mismatch++;
+		}
+
+		if(response.status == OT_Status::sucsess)
+		{
+			succeeded++;
+			if(response.data != slave.value(id))	data_mismatch++;
+			data_store.update(id, response.data, uint32_t(slave.bus_time_s*1000));
+		}
+	}
+	double	seconds	= std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	//Каждая внесённая неисправность учтена ровно одним счётчиком
+	struct {const char* name; uint64_t counted; uint64_t injected;}	totals[]	= {
+		{"timeout",			fails.timeout,			slave.injected.timeout},
+		{"rx_invalid",		fails.rx_invalid,		slave.injected.rx_invalid},
+		{"parityFail",		fails.parityFail,		slave.injected.parity},
+		{"unknownID",		fails.unknownID,		slave.injected.unknown_id},
+		{"SPARE_fail",		fails.SPARE_fail,		slave.injected.spare},
+		{"responseID_fail",	fails.responseID_fail,	slave.injected.wrong_id},
+		{"ACK_fail",		fails.ACK_fail,			0},
+		{"dataInvalid",		fails.dataInvalid,		0},
+		{"msgType_unknown",	fails.msgType_unknown,	0},
+	};
+	const OT_Status	statuses[]	= {OT_Status::timeout, OT_Status::rx_invalid, OT_Status::parityFail, OT_Status::unknownID,
+		OT_Status::SPARE_fail, OT_Status::responseID_fail, OT_Status::ACK_fail, OT_Status::dataInvalid, OT_Status::msgType_unknown};
+	for(size_t i = 0; i < sizeof(statuses)/sizeof(statuses[0]); i++)
+		totals[i].injected	+= undetected[static_cast<size_t>(statuses[i])];
+
+	size_t	counter_mismatch	= 0;
+	printf("transactions:     %zu, succeeded %zu\n", transactions, succeeded);
+	for(const auto& total : totals)
+	{
+		bool	match	= (total.counted == total.injected);
+		printf("%-17s %llu (injected %llu)%s\n", total.name, (unsigned long long)total.counted, (unsigned long long)total.injected, match ? "" : "  MISMATCH");
+		if(!match)	counter_mismatch++;
+	}
+	//Статистика по ID: исходы сходятся с OT_FailsCounter, ответы симулятора укладываются в 88..148 мс
+	size_t	id_mismatch	= 0;
+	{
+		uint64_t	by_status[OT_IdStats::status_count]	= {};
+		uint64_t	attempts	= 0;
+		uint64_t	responses	= 0;
+		uint64_t	histogram	= 0;
+		uint16_t	min_ms		= UINT16_MAX;
+		uint16_t	max_ms		= 0;
+		auto	add	= [&](const OT_IdStats::Entry& e){
+			attempts	+= e.attempts;
+			responses	+= e.responses;
+			for(size_t i = 0; i < OT_IdStats::status_count; i++)		by_status[i]	+= e.status[i];
+			for(size_t i = 0; i < OT_IdStats::response_buckets; i++)	histogram		+= e.histogram[i];
+			if(e.responses && e.response_min_ms < min_ms)	min_ms	= e.response_min_ms;
+			if(e.responses && e.response_max_ms > max_ms)	max_ms	= e.response_max_ms;
+		};
+		for(size_t i = 0; i < id_stats.size(); i++)
+			add(id_stats.entry(i));
+		add(id_stats.overflow());
+
+		for(size_t i = 0; i < sizeof(statuses)/sizeof(statuses[0]); i++)
+			if(by_status[static_cast<size_t>(statuses[i])] != totals[i].counted)	id_mismatch++;
+		if(attempts != transactions || responses != transactions - fails.timeout || histogram != responses)	id_mismatch++;
+		if(responses && (min_ms < 88 || max_ms > 148))								id_mismatch++;
+		if(id_stats.overflow().attempts && id_stats.size() != OT_IdStats::max_ids)	id_mismatch++;
+		const OT_IdStats::Gap&	gap	= id_stats.gap();
+		if(gap.count != transactions || gap.min_us != 100000 || gap.max_us != 100000)	id_mismatch++;
+
+		printf("id stats:         %zu IDs, %u in other, response %u..%u ms%s\n", id_stats.size(), unsigned(id_stats.overflow().attempts),
+			unsigned(min_ms), unsigned(max_ms), id_mismatch ? "  MISMATCH" : "");
+	}
+	//Хранилище значений: последнее значение каждого ID совпадает с котлом, разбор по типу из спецификации
+	for(size_t i = 0; i < data_store.size(); i++)
+	{
+		OT_Value	value;
+		uint8_t		id	= data_store.id(i);
+		if(!data_store.get(id, &value) || value.raw != slave.value(id) || value.type != ot_data_type(id))	data_mismatch++;
+	}
+	for(unsigned id = 0; id < 256; id++)
+	{
+		const OT_DataIdDesc*	desc	= ot_data_desc(id);
+		if(desc && desc->id != id)	data_mismatch++;
+	}
+
+	printf("line corrupted:   %llu, undetected %llu\n", (unsigned long long)slave.injected.corrupted, (unsigned long long)slave.injected.silent);
+	printf("status mismatch:  %zu\n", status_mismatch);
+	printf("data mismatch:    %zu\n", data_mismatch);
+	printf("bus time:         %.1f h simulated\n", slave.bus_time_s/3600);
+	printf("throughput:       %.0f transactions/s\n", transactions/seconds);
+
+	if(status_mismatch || data_mismatch || counter_mismatch || id_mismatch || slave.injected.silent)
+	{
+		fprintf(stderr, "soak failed\n");
+		return 1;
+	}
+
+	return 0;
+}
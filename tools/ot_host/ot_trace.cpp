@@ -0,0 +1,231 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "ot_trace.h"
+#include "ot_exchange.h"
+#include "ot_recorder.h"
+
+static bool	parse_hex_field(const std::string& line, const char* name, uint32_t* value)
+{
+	size_t	pos	= line.find(name);
+	if(pos == std::string::npos)
+		return false;
+
+	return sscanf(line.c_str() + pos + strlen(name), " 0x%x", value) == 1;
+}
+
+//Выгрузка самописца OT_Recorder: успешно принятые ответы известны и сверяются
+static bool	load_recorder(std::ifstream& file, std::vector<OT_Trace>& traces)
+{
+	std::vector<uint8_t>	data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	OT_Recorder::Header					header;
+	std::vector<OT_Recorder::Record>	records;
+	if(!OT_Recorder::parse(data.data(), data.size(), &header, records))
+		return false;
+
+	for(const OT_Recorder::Record& rec : records)
+	{
+		if(!rec.num_symbols)
+			continue;
+
+		OT_Trace	trace;
+		trace.request		= rec.request;
+		trace.expected		= rec.response;
+		trace.has_expected	= static_cast<OT_Status>(rec.status) == OT_Status::sucsess;
+		for(size_t i = 0; i < rec.num_symbols; i++)
+		{
+			ot_symbol_t	symbol;
+			symbol.val	= rec.symbols[i];
+			trace.symbols.push_back(symbol);
+		}
+		traces.push_back(trace);
+	}
+
+	return true;
+}
+
+bool	ot_load_traces(const std::string& filename, std::vector<OT_Trace>& traces)
+{
+	std::ifstream	file(filename, std::ios::binary);
+	if(!file)
+		return false;
+
+	uint32_t	magic	= 0;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.clear();
+	file.seekg(0);
+	if(magic == OT_Recorder::magic)
+		return load_recorder(file, traces);
+
+	OT_Trace	current;
+	auto	finish	= [&](){
+		if(!current.symbols.empty())
+			traces.push_back(current);
+		current	= OT_Trace();
+	};
+
+	std::string	line;
+	while(std::getline(file, line))
+	{
+		if(line.find_first_not_of(" \t\r") == std::string::npos){
+			finish();
+			continue;
+		}
+
+		uint32_t	value;
+		if(parse_hex_field(line, "request:", &value)){
+			finish();
+			current.request	= value;
+			continue;
+		}
+
+		if(parse_hex_field(line, "expect:", &value)){
+			current.expected		= value;
+			current.has_expected	= true;
+			continue;
+		}
+
+		//Все символы в строке
+		size_t	count	= 0;
+		size_t	pos		= 0;
+		while((pos = line.find('(', pos)) != std::string::npos)
+		{
+			unsigned	l0, d0, l1, d1;
+			if(sscanf(line.c_str() + pos, "(%u: %u; %u: %u)", &l0, &d0, &l1, &d1) == 4)
+			{
+				//Символ финализации завершает пакет
+				if(d1 == 8888){
+					finish();
+					count	= 0;
+				}
+				else{
+					ot_symbol_t	symbol;
+					symbol.val			= 0;
+					symbol.level0		= l0;
+					symbol.duration0	= d0;
+					symbol.level1		= l1;
+					symbol.duration1	= d1;
+					current.symbols.push_back(symbol);
+					count++;
+				}
+			}
+			pos++;
+		}
+
+		if(count > 1)
+			finish();
+	}
+	finish();
+
+	return true;
+}
+
+std::vector<ot_symbol_t>	ot_synthesize(uint32_t frame, const OT_SynthParams& params, std::mt19937& rng)
+{
+	//Полубиты линии начиная со второй половины стартового бита: бит b передаётся как (!b, b)
+	std::vector<uint8_t>	halves;
+	halves.push_back(1);
+	for(uint32_t bitmask = 0x80000000; bitmask != 0; bitmask >>= 1)
+	{
+		uint8_t	b	= (frame & bitmask) ? 1 : 0;
+		halves.push_back(!b);
+		halves.push_back(b);
+	}
+	halves.push_back(0);
+	halves.push_back(1);
+
+	//Объединение в участки постоянного уровня
+	struct Run{uint8_t level; int duration;};
+	std::vector<Run>	runs;
+	for(uint8_t level : halves)
+	{
+		if(!runs.empty() && runs.back().level == level)
+			runs.back().duration	+= params.half_bit;
+		else
+			runs.push_back({level, params.half_bit});
+	}
+
+	for(Run& run : runs)
+		run.duration	+= run.level ? params.asymmetry : -params.asymmetry;
+
+	//Дрожание и перенос фронтов
+	std::uniform_int_distribution<int>		jitter(-params.jitter, params.jitter);
+	std::uniform_real_distribution<float>	chance(0.f, 1.f);
+	for(size_t i = 0; i + 1 < runs.size(); i++)
+	{
+		int	shift	= jitter(rng);
+		//Искажение котла: спад после высокого уровня запаздывает ("не 550, а 800")
+		if(i > 0 && runs[i].level && params.distortion > 0 && chance(rng) < params.distortion)
+			shift	+= params.distortion_us;
+
+		//Фронт не должен съедать участок целиком
+		if(runs[i].duration + shift < 200 || runs[i+1].duration - shift < 200)
+			shift	= 0;
+
+		runs[i].duration	+= shift;
+		runs[i+1].duration	-= shift;
+	}
+
+	//Поздний старт приёма укорачивает одиночный первый импульс.
+	//Для двойного импульса это неотличимо от переноса фронта, такой случай не синтезируется
+	if(params.truncated_first && runs[0].duration < 3*params.half_bit/2 + params.asymmetry)
+	{
+		std::uniform_int_distribution<int>	cut(50, 300);
+		runs[0].duration	-= cut(rng);
+	}
+
+	//Упаковка в символы RMT: высокий уровень, затем низкий. Последний низкий уровень обрывается таймаутом
+	std::vector<ot_symbol_t>	symbols;
+	for(size_t i = 0; i < runs.size(); i += 2)
+	{
+		ot_symbol_t	symbol;
+		symbol.val			= 0;
+		symbol.level0		= 1;
+		symbol.duration0	= runs[i].duration;
+		symbol.level1		= 0;
+		symbol.duration1	= (i + 1 < runs.size()) ? runs[i+1].duration : 0;
+		symbols.push_back(symbol);
+	}
+
+	return symbols;
+}
+
+uint32_t	ot_random_frame(std::mt19937& rng)
+{
+	uint32_t	frame	= rng() & 0x7fffffff;
+	if(!OT_Decoder::parity_ok(frame))
+		frame	|= 0x80000000;
+
+	return frame;
+}
+
+bool	ot_dump_recorder(const std::string& filename)
+{
+	std::ifstream			file(filename, std::ios::binary);
+	std::vector<uint8_t>	data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	OT_Recorder::Header					header;
+	std::vector<OT_Recorder::Record>	records;
+	if(!file || !OT_Recorder::parse(data.data(), data.size(), &header, records))
+		return false;
+
+	printf("# %s: %u records of %u, uptime %.3f s\n", filename.c_str(), unsigned(header.count), unsigned(header.total), header.uptime_ms/1000.0);
+	for(const OT_Recorder::Record& rec : records)
+	{
+		printf("# %.3f s, wait %u ms, %s\n", rec.time_ms/1000.0, unsigned(rec.wait_ms), ot_status_to_string(static_cast<OT_Status>(rec.status)));
+		printf("request: 0x%08x\n", unsigned(rec.request));
+		if(static_cast<OT_Status>(rec.status) == OT_Status::sucsess)
+			printf("expect: 0x%08x\n", unsigned(rec.response));
+		for(size_t i = 0; i < rec.num_symbols; i++)
+		{
+			ot_symbol_t	symbol;
+			symbol.val	= rec.symbols[i];
+			printf("(%d: %d; %d: %d)\n", symbol.level0, symbol.duration0, symbol.level1, symbol.duration1);
+		}
+		printf("\n");
+	}
+
+	return true;
+}
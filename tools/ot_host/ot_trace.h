@@ -0,0 +1,46 @@
+#ifndef OT_TRACE_H
+#define OT_TRACE_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "ot_decoder.h"
+
+//Записанный или синтезированный приём одного ответа котла
+struct OT_Trace
+{
+	uint32_t					request		= 0;
+	uint32_t					expected	= 0;	//Ожидаемый ответ, если известен
+	bool						has_expected	= false;
+	std::vector<ot_symbol_t>	symbols;
+};
+
+//Чтение трасс в формате отладочной печати "(1: 550; 0: 470)".
+//Пакеты разделяются пустой строкой, строкой "request: 0x..." или символом финализации (x: 8888).
+//Строка "expect: 0x..." задаёт ожидаемый ответ. Строка с несколькими символами
+//(например, json из топика fails) считается отдельным пакетом.
+//Файл выгрузки самописца OT_Recorder (команда flight_recorder TCP-сервера) читается целиком.
+bool	ot_load_traces(const std::string& filename, std::vector<OT_Trace>& traces);
+
+//Параметры синтеза ответа котла: длительности полубитов со сдвигом фронтов
+struct OT_SynthParams
+{
+	uint16_t	half_bit		= 510;	//Половина периода бита, мкс
+	int16_t		asymmetry		= 40;	//Удлинение высокого уровня за счёт низкого, мкс
+	uint16_t	jitter			= 10;	//Случайное отклонение каждого фронта, ± мкс
+	float		distortion		= 0.f;	//Вероятность запаздывания спада внутри пакета
+	uint16_t	distortion_us	= 250;	//Величина запаздывания, мкс
+	bool		truncated_first	= false;//Укороченный первый импульс (поздний старт приёма)
+};
+
+//Синтез символов RMT для ответа frame так, как их принимает канал RX
+std::vector<ot_symbol_t>	ot_synthesize(uint32_t frame, const OT_SynthParams& params, std::mt19937& rng);
+
+//Печать выгрузки самописца: заголовок записи и символы в формате отладочной печати
+bool	ot_dump_recorder(const std::string& filename);
+
+//Случайный корректный ответ (чётность выставлена)
+uint32_t	ot_random_frame(std::mt19937& rng);
+
+#endif	//OT_TRACE_H